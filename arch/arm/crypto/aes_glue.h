@@ -0,0 +1,21 @@
+/*
+ * ARM assembler AES block functions, exported by aes_glue.c for the bit
+ * sliced NEON implementation
+ */
+
+#ifndef _ARM_CRYPTO_AES_GLUE_H
+#define _ARM_CRYPTO_AES_GLUE_H
+
+#include <crypto/aes.h>
+
+asmlinkage void __aes_arm_encrypt(const u32 *rk, int rounds, const u8 *in,
+				  u8 *out);
+asmlinkage void __aes_arm_decrypt(const u32 *rk, int rounds, const u8 *in,
+				  u8 *out);
+
+static inline int aes_rounds(const struct crypto_aes_ctx *ctx)
+{
+	return 6 + ctx->key_length / 4;
+}
+
+#endif /* _ARM_CRYPTO_AES_GLUE_H */
@@ -0,0 +1,358 @@
+/*
+ * Glue Code for the bit sliced NEON AES, XTS and CTR modes
+ *
+ * aesbs_encrypt8()/aesbs_decrypt8() work on eight blocks at a time, so
+ * only the modes where consecutive blocks are independent are offered.
+ * Whatever is left of a walk step after the groups of eight, and whole
+ * requests made where NEON may not be used, go through the table based
+ * ARM assembler AES, which shares the key schedule.
+ */
+
+#include <linux/module.h>
+#include <linux/hardirq.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/b128ops.h>
+#include <crypto/gf128mul.h>
+#include <asm/neon.h>
+
+#include "aes_glue.h"
+
+#define BS_BLOCKS	8
+#define BS_BYTES	(BS_BLOCKS * AES_BLOCK_SIZE)
+
+/* One 128 byte bit sliced round key per round, plus the initial one */
+#define BS_KEY_SIZE	((AES_MAX_KEYLENGTH_U32 / 4) * 128)
+
+asmlinkage void aesbs_encrypt8(u8 *out, const u8 *in, const u8 *rk,
+			       int rounds);
+asmlinkage void aesbs_decrypt8(u8 *out, const u8 *in, const u8 *rk,
+			       int rounds);
+
+struct aesbs_ctx {
+	struct crypto_aes_ctx aes;
+	u8 enc[BS_KEY_SIZE];
+	u8 dec[BS_KEY_SIZE];
+};
+
+struct aesbs_xts_ctx {
+	struct aesbs_ctx data;
+	struct crypto_aes_ctx tweak;
+};
+
+/*
+ * Byte p of the bit sliced state is row p / 4 of column p % 4, and plane
+ * b holds bit b of it, replicated over the eight blocks.
+ *
+ * Neither S-box circuit adds the constant 0x63 of the affine map, so it
+ * is added to every round key that follows a forward SubBytes, and to
+ * every one that precedes an inverse SubBytes. For the equivalent
+ * inverse cipher that is all but the first and the last key respectively.
+ */
+static void aesbs_convert_key(u8 *out, const u32 *rk, int rounds, bool dec)
+{
+	int r, b, p;
+
+	for (r = 0; r <= rounds; r++, rk += 4) {
+		bool c63 = dec ? r < rounds : r > 0;
+
+		for (b = 0; b < 8; b++)
+			for (p = 0; p < 16; p++) {
+				u8 x = rk[p & 3] >> (8 * (p >> 2));
+
+				if (c63)
+					x ^= 0x63;
+				*out++ = -((x >> b) & 1);
+			}
+	}
+}
+
+static int aesbs_expand_key(struct crypto_tfm *tfm, struct aesbs_ctx *ctx,
+			    const u8 *in_key, unsigned int key_len)
+{
+	int rounds;
+
+	if (crypto_aes_expand_key(&ctx->aes, in_key, key_len)) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+
+	rounds = aes_rounds(&ctx->aes);
+	aesbs_convert_key(ctx->enc, ctx->aes.key_enc, rounds, false);
+	aesbs_convert_key(ctx->dec, ctx->aes.key_dec, rounds, true);
+	return 0;
+}
+
+static int aesbs_ctr_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	return aesbs_expand_key(tfm, crypto_tfm_ctx(tfm), in_key, key_len);
+}
+
+static int aesbs_xts_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	/* data key first, then the tweak key, of equal sizes */
+	if ((key_len & 1) ||
+	    crypto_aes_expand_key(&ctx->tweak, in_key + key_len / 2,
+				  key_len / 2)) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+
+	return aesbs_expand_key(tfm, &ctx->data, in_key, key_len / 2);
+}
+
+/*
+ * The bit sliced code only pays off for whole groups of eight, and the
+ * NEON unit may only be claimed from process context.
+ */
+static inline bool aesbs_use_neon(unsigned int nbytes)
+{
+	return nbytes >= BS_BYTES && !in_interrupt();
+}
+
+/*
+ * XTS on one walk step: C = E(P ^ T) ^ T with T multiplied by x from one
+ * block to the next. Returns the number of bytes left unprocessed.
+ */
+static unsigned int aesbs_xts_step(struct aesbs_ctx *ctx, u8 *dst,
+				   const u8 *src, unsigned int nbytes,
+				   be128 *iv, bool enc)
+{
+	int rounds = aes_rounds(&ctx->aes);
+	be128 t[BS_BLOCKS];
+	int i;
+
+	if (aesbs_use_neon(nbytes)) {
+		kernel_neon_begin();
+		do {
+			for (i = 0; i < BS_BLOCKS; i++) {
+				t[i] = *iv;
+				be128_xor((be128 *)dst + i, (be128 *)src + i, iv);
+				gf128mul_x_ble(iv, iv);
+			}
+			if (enc)
+				aesbs_encrypt8(dst, dst, ctx->enc, rounds);
+			else
+				aesbs_decrypt8(dst, dst, ctx->dec, rounds);
+			for (i = 0; i < BS_BLOCKS; i++)
+				be128_xor((be128 *)dst + i, (be128 *)dst + i,
+					  &t[i]);
+
+			src += BS_BYTES;
+			dst += BS_BYTES;
+		} while ((nbytes -= BS_BYTES) >= BS_BYTES);
+		kernel_neon_end();
+	}
+
+	for (; nbytes >= AES_BLOCK_SIZE; nbytes -= AES_BLOCK_SIZE) {
+		be128_xor((be128 *)dst, (be128 *)src, iv);
+		if (enc)
+			__aes_arm_encrypt(ctx->aes.key_enc, rounds, dst, dst);
+		else
+			__aes_arm_decrypt(ctx->aes.key_dec, rounds, dst, dst);
+		be128_xor((be128 *)dst, (be128 *)dst, iv);
+		gf128mul_x_ble(iv, iv);
+
+		src += AES_BLOCK_SIZE;
+		dst += AES_BLOCK_SIZE;
+	}
+
+	return nbytes;
+}
+
+static int aesbs_xts_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes, bool enc)
+{
+	struct aesbs_xts_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, BS_BYTES);
+	if (!walk.nbytes)
+		return err;
+
+	/* the initial tweak is the IV encrypted with the second key */
+	__aes_arm_encrypt(ctx->tweak.key_enc, aes_rounds(&ctx->tweak),
+			  walk.iv, walk.iv);
+
+	while (walk.nbytes) {
+		nbytes = aesbs_xts_step(&ctx->data, walk.dst.virt.addr,
+					walk.src.virt.addr, walk.nbytes,
+					(be128 *)walk.iv, enc);
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+
+	return err;
+}
+
+static int aesbs_xts_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, true);
+}
+
+static int aesbs_xts_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, false);
+}
+
+/*
+ * CTR on one walk step. The final partial block, if any, is only
+ * processed when it is the last one of the request.
+ */
+static unsigned int aesbs_ctr_step(struct aesbs_ctx *ctx, u8 *dst,
+				   const u8 *src, unsigned int nbytes,
+				   u8 *ctrblk)
+{
+	int rounds = aes_rounds(&ctx->aes);
+	u8 ks[BS_BYTES] __aligned(8);
+	int i;
+
+	if (aesbs_use_neon(nbytes)) {
+		kernel_neon_begin();
+		do {
+			for (i = 0; i < BS_BLOCKS; i++) {
+				memcpy(ks + i * AES_BLOCK_SIZE, ctrblk,
+				       AES_BLOCK_SIZE);
+				crypto_inc(ctrblk, AES_BLOCK_SIZE);
+			}
+			aesbs_encrypt8(ks, ks, ctx->enc, rounds);
+			if (dst != src)
+				memcpy(dst, src, BS_BYTES);
+			crypto_xor(dst, ks, BS_BYTES);
+
+			src += BS_BYTES;
+			dst += BS_BYTES;
+		} while ((nbytes -= BS_BYTES) >= BS_BYTES);
+		kernel_neon_end();
+	}
+
+	for (; nbytes >= AES_BLOCK_SIZE; nbytes -= AES_BLOCK_SIZE) {
+		__aes_arm_encrypt(ctx->aes.key_enc, rounds, ctrblk, ks);
+		crypto_inc(ctrblk, AES_BLOCK_SIZE);
+		if (dst != src)
+			memcpy(dst, src, AES_BLOCK_SIZE);
+		crypto_xor(dst, ks, AES_BLOCK_SIZE);
+
+		src += AES_BLOCK_SIZE;
+		dst += AES_BLOCK_SIZE;
+	}
+
+	return nbytes;
+}
+
+static int aesbs_ctr_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	u8 ks[AES_BLOCK_SIZE];
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, BS_BYTES);
+
+	while (walk.nbytes >= AES_BLOCK_SIZE) {
+		nbytes = aesbs_ctr_step(ctx, walk.dst.virt.addr,
+					walk.src.virt.addr, walk.nbytes,
+					walk.iv);
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+
+	if (walk.nbytes) {
+		__aes_arm_encrypt(ctx->aes.key_enc, aes_rounds(&ctx->aes),
+				  walk.iv, ks);
+		crypto_xor(ks, walk.src.virt.addr, walk.nbytes);
+		memcpy(walk.dst.virt.addr, ks, walk.nbytes);
+		crypto_inc(walk.iv, AES_BLOCK_SIZE);
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+
+	return err;
+}
+
+static struct crypto_alg aesbs_algs[] = { {
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_xts_ctx),
+	.cra_alignmask		= 7,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(aesbs_algs[0].cra_list),
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+			.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_xts_setkey,
+			.encrypt	= aesbs_xts_encrypt,
+			.decrypt	= aesbs_xts_decrypt,
+		},
+	},
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_alignmask		= 7,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(aesbs_algs[1].cra_list),
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_ctr_setkey,
+			.encrypt	= aesbs_ctr_crypt,
+			.decrypt	= aesbs_ctr_crypt,
+			.geniv		= "chainiv",
+		},
+	},
+} };
+
+static int __init aesbs_mod_init(void)
+{
+	int err;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	err = crypto_register_alg(&aesbs_algs[0]);
+	if (err)
+		return err;
+
+	err = crypto_register_alg(&aesbs_algs[1]);
+	if (err)
+		crypto_unregister_alg(&aesbs_algs[0]);
+	return err;
+}
+
+static void __exit aesbs_mod_exit(void)
+{
+	crypto_unregister_alg(&aesbs_algs[1]);
+	crypto_unregister_alg(&aesbs_algs[0]);
+}
+
+module_init(aesbs_mod_init);
+module_exit(aesbs_mod_exit);
+
+MODULE_DESCRIPTION("Bit sliced AES in XTS and CTR modes using NEON");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("xts(aes)");
+MODULE_ALIAS("ctr(aes)");
@@ -154,6 +154,13 @@ extern void __pgd_error(const char *file, int line, pgd_t);
 #define SUPERSECTION_SIZE	(1UL << SUPERSECTION_SHIFT)
 #define SUPERSECTION_MASK	(~(SUPERSECTION_SIZE-1))
 
+/*
+ * Large page (64K) address mask and size definitions.
+ */
+#define LARGE_PAGE_SHIFT	16
+#define LARGE_PAGE_SIZE		(1UL << LARGE_PAGE_SHIFT)
+#define LARGE_PAGE_MASK		(~(LARGE_PAGE_SIZE-1))
+
 /*
  * "Linux" PTE definitions.
  *
@@ -0,0 +1,104 @@
+/*
+ *  linux/arch/arm/lib/csum_neon.c
+ *
+ *  Checksum routines choosing between NEON and the integer code
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The NEON loop does 64 bytes per iteration at about a third of the
+ * instructions of the adcs loop, but claiming the unit costs a VFP state
+ * save, plus a reload trap later if a task was using VFP. Below
+ * CSUM_NEON_MIN bytes that is not worth it, and neither can NEON be used
+ * in interrupt context, which is where most receive side checksums are
+ * computed; both cases keep the integer code. So does the tail of a
+ * buffer beyond its last whole 64 byte block.
+ */
+#include <linux/kernel.h>
+#include <linux/hardirq.h>
+#include <linux/uaccess.h>
+#include <net/checksum.h>
+#include <asm/neon.h>
+
+#define CSUM_NEON_MIN	256
+
+/* csumpartial*.S, built under these names when this file is used */
+__wsum __csum_partial_arm(const void *buff, int len, __wsum sum);
+__wsum __csum_partial_copy_arm(const void *src, void *dst, int len,
+			       __wsum sum);
+__wsum __csum_partial_copy_from_user_arm(const void __user *src, void *dst,
+					 int len, __wsum sum, int *err_ptr);
+
+/* csumpartialneon.S */
+__wsum __csum_partial_neon(const void *buff, int blocks, __wsum sum);
+int __csum_partial_copy_neon(const void *src, void *dst, int blocks,
+			     __wsum *sum);
+
+static inline bool csum_use_neon(int len)
+{
+	return len >= CSUM_NEON_MIN && cpu_has_neon() && !in_interrupt();
+}
+
+__wsum csum_partial(const void *buff, int len, __wsum sum)
+{
+	if (csum_use_neon(len)) {
+		int done = len & ~63;
+
+		kernel_neon_begin();
+		sum = __csum_partial_neon(buff, done / 64, sum);
+		kernel_neon_end();
+
+		buff += done;
+		len -= done;
+	}
+	return __csum_partial_arm(buff, len, sum);
+}
+
+__wsum csum_partial_copy_nocheck(const void *src, void *dst, int len,
+				 __wsum sum)
+{
+	if (csum_use_neon(len)) {
+		int done = len & ~63;
+
+		kernel_neon_begin();
+		__csum_partial_copy_neon(src, dst, done / 64, &sum);
+		kernel_neon_end();
+
+		src += done;
+		dst += done;
+		len -= done;
+	}
+	return __csum_partial_copy_arm(src, dst, len, sum);
+}
+
+/*
+ * The NEON code cannot sleep, so it runs with page faults disabled. If
+ * one is hit, possibly just on a page not yet faulted in, the whole copy
+ * is redone by the integer code, which takes the fault normally and
+ * sets *err_ptr if it really is one.
+ */
+__wsum csum_partial_copy_from_user(const void __user *src, void *dst,
+				   int len, __wsum sum, int *err_ptr)
+{
+	if (csum_use_neon(len)) {
+		int done = len & ~63;
+		__wsum nsum = sum;
+		int err;
+
+		pagefault_disable();
+		kernel_neon_begin();
+		err = __csum_partial_copy_neon((__force const void *)src, dst,
+					       done / 64, &nsum);
+		kernel_neon_end();
+		pagefault_enable();
+
+		if (!err) {
+			sum = nsum;
+			src += done;
+			dst += done;
+			len -= done;
+		}
+	}
+	return __csum_partial_copy_from_user_arm(src, dst, len, sum, err_ptr);
+}
@@ -17,6 +17,7 @@
 #include <linux/init.h>
 #include <linux/device.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-contiguous.h>
 #include <linux/highmem.h>
 
 #include <asm/memory.h>
@@ -24,6 +25,9 @@
 #include <asm/cacheflush.h>
 #include <asm/tlbflush.h>
 #include <asm/sizes.h>
+#include <asm/mach/map.h>
+
+#include "mm.h"
 
 static u64 get_coherent_dma_mask(struct device *dev)
 {
@@ -133,7 +137,7 @@ static pte_t *consistent_pte[NUM_CONSISTENT_PTES];
 
 static struct arm_vmregion_head consistent_head = {
 	.vm_lock	= __SPIN_LOCK_UNLOCKED(&consistent_head.vm_lock),
-	.vm_list	= LIST_HEAD_INIT(consistent_head.vm_list),
+	.vm_root	= RB_ROOT,
 	.vm_start	= CONSISTENT_BASE,
 	.vm_end		= CONSISTENT_END,
 };
@@ -189,6 +193,12 @@ static int __init consistent_init(void)
 
 core_initcall(consistent_init);
 
+static int __init consistent_debugfs_init(void)
+{
+	return arm_vmregion_create_debugfs("dma-mappings", &consistent_head);
+}
+late_initcall(consistent_debugfs_init);
+
 static void *
 __dma_alloc_remap(struct page *page, size_t size, gfp_t gfp, pgprot_t prot)
 {
@@ -294,10 +304,134 @@ static void __dma_free_remap(void *cpu_addr, size_t size)
 	arm_vmregion_free(&consistent_head, c);
 }
 
+static inline bool __in_consistent_region(void *cpu_addr)
+{
+	unsigned long addr = (unsigned long)cpu_addr;
+
+	return addr >= CONSISTENT_BASE && addr < CONSISTENT_END;
+}
+
+#ifdef CONFIG_CMA
+/*
+ * Contiguous areas are handed out with their existing kernel linear
+ * mapping, with its attributes changed to those the caller asked for,
+ * instead of taking space in the small consistent region.  For that the
+ * area has to be mapped with pages rather than sections.
+ */
+struct dma_contig_early_reserve {
+	phys_addr_t base;
+	unsigned long size;
+};
+
+static struct dma_contig_early_reserve dma_mmu_remap[MAX_CMA_AREAS] __initdata;
+
+static int dma_mmu_remap_num __initdata;
+
+void __init dma_contiguous_early_fixup(phys_addr_t base, unsigned long size)
+{
+	dma_mmu_remap[dma_mmu_remap_num].base = base;
+	dma_mmu_remap[dma_mmu_remap_num].size = size;
+	dma_mmu_remap_num++;
+}
+
+void __init dma_contiguous_remap(void)
+{
+	int i;
+
+	for (i = 0; i < dma_mmu_remap_num; i++) {
+		phys_addr_t start = dma_mmu_remap[i].base;
+		phys_addr_t end = start + dma_mmu_remap[i].size;
+		struct map_desc map;
+		unsigned long addr;
+
+		if (end > arm_lowmem_limit)
+			end = arm_lowmem_limit;
+		if (start >= end)
+			continue;
+
+		map.pfn = __phys_to_pfn(start);
+		map.virtual = __phys_to_virt(start);
+		map.length = end - start;
+		map.type = MT_MEMORY_DMA_READY;
+
+		/* Clear the section mappings map_lowmem() put there */
+		for (addr = __phys_to_virt(start); addr < __phys_to_virt(end);
+		     addr += PGDIR_SIZE)
+			pmd_clear(pmd_off_k(addr));
+
+		iotable_init(&map, 1);
+		flush_tlb_kernel_range(__phys_to_virt(start),
+				       __phys_to_virt(end));
+	}
+}
+
+static int __dma_update_pte(pte_t *pte, pgtable_t token, unsigned long addr,
+			    void *data)
+{
+	struct page *page = virt_to_page(addr);
+	pgprot_t prot = *(pgprot_t *)data;
+
+	set_pte_ext(pte, mk_pte(page, prot), 0);
+	return 0;
+}
+
+static void __dma_remap(struct page *page, size_t size, pgprot_t prot)
+{
+	unsigned long start = (unsigned long)page_address(page);
+	unsigned long end = start + size;
+
+	apply_to_page_range(&init_mm, start, size, __dma_update_pte, &prot);
+	dsb();
+	flush_tlb_kernel_range(start, end);
+}
+
+static void *__alloc_from_contiguous(struct device *dev, size_t size,
+				     pgprot_t prot, struct page **ret_page)
+{
+	unsigned long order = get_order(size);
+	size_t count = size >> PAGE_SHIFT;
+	struct page *page;
+	void *ptr;
+
+	page = dma_alloc_from_contiguous(dev, count, order);
+	if (!page)
+		return NULL;
+
+	/*
+	 * Zero the buffer and push it out of the caches through the
+	 * cacheable mapping before that mapping goes away.
+	 */
+	ptr = page_address(page);
+	memset(ptr, 0, size);
+	dmac_flush_range(ptr, ptr + size);
+	outer_flush_range(__pa(ptr), __pa(ptr) + size);
+
+	__dma_remap(page, size, prot);
+	*ret_page = page;
+	return ptr;
+}
+
+static void __free_from_contiguous(struct device *dev, struct page *page,
+				   size_t size)
+{
+	__dma_remap(page, size, pgprot_kernel);
+	dma_release_from_contiguous(dev, page, size >> PAGE_SHIFT);
+}
+
+#else	/* !CONFIG_CMA */
+
+#define __alloc_from_contiguous(dev, size, prot, ret)	NULL
+#define __free_from_contiguous(dev, page, size)		do { } while (0)
+
+#endif	/* CONFIG_CMA */
+
 #else	/* !CONFIG_MMU */
 
 #define __dma_alloc_remap(page, size, gfp, prot)	page_address(page)
 #define __dma_free_remap(addr, size)			do { } while (0)
+#define __in_consistent_region(addr)			true
+#define __alloc_from_contiguous(dev, size, prot, ret)	NULL
+#define __free_from_contiguous(dev, page, size)		do { } while (0)
 
 #endif	/* CONFIG_MMU */
 
@@ -311,6 +445,20 @@ __dma_alloc(struct device *dev, size_t size, dma_addr_t *handle, gfp_t gfp,
 	*handle = ~0;
 	size = PAGE_ALIGN(size);
 
+	/*
+	 * Callers that can sleep get their buffer from the contiguous
+	 * area if there is one; atomic ones, and anything the area cannot
+	 * satisfy, still come from the consistent region.
+	 */
+	if (!arch_is_coherent() && (gfp & __GFP_WAIT) &&
+	    get_coherent_dma_mask(dev)) {
+		addr = __alloc_from_contiguous(dev, size, prot, &page);
+		if (addr) {
+			*handle = pfn_to_dma(dev, page_to_pfn(page));
+			return addr;
+		}
+	}
+
 	page = __dma_alloc_buffer(dev, size, gfp);
 	if (!page)
 		return NULL;
@@ -380,6 +528,19 @@ static int dma_mmap(struct device *dev, struct vm_area_struct *vma,
 					      user_size << PAGE_SHIFT,
 					      vma->vm_page_prot);
 		}
+	} else if (!arch_is_coherent() && !__in_consistent_region(cpu_addr)) {
+		/* A contiguous area buffer, mapped where it lies */
+		unsigned long off = vma->vm_pgoff;
+
+		kern_size = PAGE_ALIGN(size) >> PAGE_SHIFT;
+
+		if (off < kern_size &&
+		    user_size <= (kern_size - off)) {
+			ret = remap_pfn_range(vma, vma->vm_start,
+					      dma_to_pfn(dev, dma_addr) + off,
+					      user_size << PAGE_SHIFT,
+					      vma->vm_page_prot);
+		}
 	}
 #endif	/* CONFIG_MMU */
 
@@ -415,6 +576,12 @@ void dma_free_coherent(struct device *dev, size_t size, void *cpu_addr, dma_addr
 
 	size = PAGE_ALIGN(size);
 
+	if (!arch_is_coherent() && !__in_consistent_region(cpu_addr)) {
+		__free_from_contiguous(dev, pfn_to_page(dma_to_pfn(dev, handle)),
+				       size);
+		return;
+	}
+
 	if (!arch_is_coherent())
 		__dma_free_remap(cpu_addr, size);
 
@@ -19,6 +19,7 @@
 #include <linux/highmem.h>
 #include <linux/gfp.h>
 #include <linux/memblock.h>
+#include <linux/dma-contiguous.h>
 #include <linux/sort.h>
 
 #include <asm/mach-types.h>
@@ -358,6 +359,9 @@ void __init arm_memblock_init(struct meminfo *mi, struct machine_desc *mdesc)
 	if (mdesc->reserve)
 		mdesc->reserve();
 
+	/* reserve memory for DMA contiguous allocations */
+	dma_contiguous_reserve(arm_lowmem_limit);
+
 	memblock_analyze();
 	memblock_dump_all();
 }
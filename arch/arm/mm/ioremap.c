@@ -25,6 +25,8 @@
 #include <linux/mm.h>
 #include <linux/vmalloc.h>
 #include <linux/io.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
 
 #include <asm/cputype.h>
 #include <asm/cacheflush.h>
@@ -42,6 +44,188 @@
  */
 #define VM_ARM_SECTION_MAPPING	0x80000000
 
+/*
+ * Sizes of the mappings set up in the vmalloc area, for
+ * /sys/kernel/mm/vmap/mapped_*.
+ */
+enum {
+	VMAP_MAPPED_4K,
+	VMAP_MAPPED_64K,
+	VMAP_MAPPED_1M,
+	VMAP_MAPPED_16M,
+	NR_VMAP_MAPPED
+};
+
+static atomic_long_t vmap_mapped[NR_VMAP_MAPPED];
+
+/*
+ * 64K large pages in the vmalloc area.
+ *
+ * vmalloc() hands vmap_large_pages() areas made of 64K aligned,
+ * physically contiguous runs of pages where it could get them, and
+ * ioremap() ranges are contiguous anyway.  The Linux ptes are left as
+ * they are, so nothing that walks or clears them needs to know: only
+ * the hardware entries of each run are rewritten as one large page
+ * descriptor, which the architecture wants repeated in all 16 of them.
+ * Clearing a Linux pte still clears its hardware entry, and the TLB
+ * flush when the area is unmapped goes page by page over all of it, so
+ * it takes the large page entries too.
+ *
+ * This needs the ARMv6 extended page table format.
+ */
+#define LARGE_PAGE_PTRS		(LARGE_PAGE_SIZE >> PAGE_SHIFT)
+
+int vmap_large_order __read_mostly;
+static int vmap_large_off __initdata;
+
+static int vmap_large_supported(void)
+{
+	return cpu_architecture() >= CPU_ARCH_ARMv6 && (get_cr() & CR_XP);
+}
+
+static u32 large_page_desc(u32 small)
+{
+	return (small & LARGE_PAGE_MASK) | PTE_TYPE_LARGE |
+	       (small & (PTE_EXT_NG | PTE_EXT_SHARED | PTE_EXT_APX |
+			 PTE_EXT_AP_MASK | PTE_CACHEABLE | PTE_BUFFERABLE)) |
+	       PTE_LARGE_TEX((small >> 6) & 7) |
+	       ((small & PTE_EXT_XN) ? PTE_LARGE_XN : 0);
+}
+
+/*
+ * Map the 16 pages at @addr, whose ptes start at @pte, with one large
+ * page if they qualify.  The small page entries may already be in the
+ * TLB, and small and large entries for the same address must never be
+ * live together: the hardware entries are cleared and the range flushed
+ * before the large descriptors go in.  The area is not handed out yet,
+ * so nothing can touch it while it is unmapped.
+ */
+static int vmap_large_run(unsigned long addr, pte_t *pte)
+{
+	u32 *hw = (u32 *)(pte + PTE_HWTABLE_PTRS);
+	u32 desc;
+	int i;
+
+	if (!pte_present(*pte) || (pte_pfn(*pte) & (LARGE_PAGE_PTRS - 1)) ||
+	    !(hw[0] & PTE_TYPE_SMALL))
+		return 0;
+	for (i = 1; i < LARGE_PAGE_PTRS; i++) {
+		if (pte_val(pte[i]) != pte_val(*pte) + (i << PAGE_SHIFT) ||
+		    hw[i] != hw[0] + (i << PAGE_SHIFT))
+			return 0;
+	}
+
+	desc = large_page_desc(hw[0]);
+	for (i = 0; i < LARGE_PAGE_PTRS; i++)
+		hw[i] = 0;
+	clean_dcache_area(hw, LARGE_PAGE_PTRS * sizeof(u32));
+	flush_tlb_kernel_range(addr, addr + LARGE_PAGE_SIZE);
+
+	for (i = 0; i < LARGE_PAGE_PTRS; i++)
+		hw[i] = desc;
+	clean_dcache_area(hw, LARGE_PAGE_PTRS * sizeof(u32));
+	return 1;
+}
+
+void vmap_large_pages(unsigned long start, unsigned long end)
+{
+	unsigned long addr, nr_large = 0;
+
+	if (vmap_large_order) {
+		for (addr = ALIGN(start, LARGE_PAGE_SIZE);
+		     addr + LARGE_PAGE_SIZE <= end; addr += LARGE_PAGE_SIZE) {
+			pmd_t *pmd = pmd_offset(pgd_offset_k(addr), addr);
+
+			if (pmd_none(*pmd) || pmd_bad(*pmd))
+				continue;
+			nr_large += vmap_large_run(addr,
+						   pte_offset_kernel(pmd, addr));
+		}
+	}
+
+	atomic_long_add(nr_large, &vmap_mapped[VMAP_MAPPED_64K]);
+	atomic_long_add(((end - start) >> PAGE_SHIFT) -
+			nr_large * LARGE_PAGE_PTRS,
+			&vmap_mapped[VMAP_MAPPED_4K]);
+}
+
+static int __init vmap_large_setup(char *str)
+{
+	if (!strcmp(str, "off"))
+		vmap_large_off = 1;
+	else if (strcmp(str, "on"))
+		return 0;
+	return 1;
+}
+__setup("vmap_large=", vmap_large_setup);
+
+static int __init vmap_large_init(void)
+{
+	if (!vmap_large_off && vmap_large_supported())
+		vmap_large_order = LARGE_PAGE_SHIFT - PAGE_SHIFT;
+	return 0;
+}
+core_initcall(vmap_large_init);
+
+#ifdef CONFIG_SYSFS
+static ssize_t large_pages_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", vmap_large_order != 0);
+}
+
+static ssize_t large_pages_store(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 const char *buf, size_t count)
+{
+	unsigned long val;
+
+	if (strict_strtoul(buf, 10, &val) || val > 1)
+		return -EINVAL;
+	if (val && !vmap_large_supported())
+		return -EINVAL;
+
+	vmap_large_order = val ? LARGE_PAGE_SHIFT - PAGE_SHIFT : 0;
+	return count;
+}
+static struct kobj_attribute large_pages_attr =
+	__ATTR(large_pages, 0644, large_pages_show, large_pages_store);
+
+#define VMAP_MAPPED_ATTR(_name, _item)					\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%ld\n",					\
+		       atomic_long_read(&vmap_mapped[_item]));		\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+
+VMAP_MAPPED_ATTR(mapped_4k, VMAP_MAPPED_4K);
+VMAP_MAPPED_ATTR(mapped_64k, VMAP_MAPPED_64K);
+VMAP_MAPPED_ATTR(mapped_1m, VMAP_MAPPED_1M);
+VMAP_MAPPED_ATTR(mapped_16m, VMAP_MAPPED_16M);
+
+static struct attribute *vmap_attrs[] = {
+	&large_pages_attr.attr,
+	&mapped_4k_attr.attr,
+	&mapped_64k_attr.attr,
+	&mapped_1m_attr.attr,
+	&mapped_16m_attr.attr,
+	NULL,
+};
+
+static struct attribute_group vmap_attr_group = {
+	.attrs = vmap_attrs,
+	.name = "vmap",
+};
+
+static int __init vmap_sysfs_init(void)
+{
+	return sysfs_create_group(mm_kobj, &vmap_attr_group);
+}
+late_initcall(vmap_sysfs_init);
+#endif /* CONFIG_SYSFS */
+
 int ioremap_page(unsigned long virt, unsigned long phys,
 		 const struct mem_type *mtype)
 {
@@ -228,13 +412,23 @@ void __iomem * __arm_ioremap_pfn_caller(unsigned long pfn,
 	       !((__pfn_to_phys(pfn) | size | addr) & ~SUPERSECTION_MASK)) {
 		area->flags |= VM_ARM_SECTION_MAPPING;
 		err = remap_area_supersections(addr, pfn, size, type);
+		if (!err)
+			atomic_long_add(size >> SUPERSECTION_SHIFT,
+					&vmap_mapped[VMAP_MAPPED_16M]);
 	} else if (!((__pfn_to_phys(pfn) | size | addr) & ~PMD_MASK)) {
 		area->flags |= VM_ARM_SECTION_MAPPING;
 		err = remap_area_sections(addr, pfn, size, type);
+		if (!err)
+			atomic_long_add(size >> SECTION_SHIFT,
+					&vmap_mapped[VMAP_MAPPED_1M]);
 	} else
 #endif
+	{
 		err = ioremap_page_range(addr, addr + size, __pfn_to_phys(pfn),
 					 __pgprot(type->prot_pte));
+		if (!err)
+			vmap_large_pages(addr, addr + size);
+	}
 
 	if (err) {
  		vunmap((void *)addr);
@@ -23,5 +23,13 @@ extern void __flush_dcache_page(struct address_space *mapping, struct page *page
 
 #endif
 
+extern phys_addr_t arm_lowmem_limit;
+
+#ifdef CONFIG_CMA
+void dma_contiguous_remap(void);
+#else
+static inline void dma_contiguous_remap(void) { }
+#endif
+
 void __init bootmem_init(void);
 void arm_mm_memblock_reserve(void);
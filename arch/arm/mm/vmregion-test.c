@@ -0,0 +1,204 @@
+/*
+ * Boot time self test and benchmark for the vmregion allocator
+ *
+ * A private region head, covering address space that is never mapped,
+ * is filled with a large number of live allocations of random sizes and
+ * alignments, and then churned by freeing a random one and allocating
+ * another.  Every address handed out is checked against the sorted list
+ * walk the allocator used to be, and the time per allocation and free is
+ * reported for both.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include <asm/pgtable.h>
+
+#include "vmregion.h"
+
+#define TEST_LIVE	10000
+#define TEST_CHURN	10000
+#define TEST_MAX_PAGES	8
+#define TEST_BASE	0x10000000UL
+
+/* The sorted list walk arm_vmregion_alloc() used to do */
+struct ref_region {
+	struct list_head	list;
+	unsigned long		start;
+	unsigned long		end;
+};
+
+struct ref_head {
+	spinlock_t		lock;
+	struct list_head	list;
+	unsigned long		start;
+	unsigned long		end;
+};
+
+static struct ref_region * __init ref_alloc(struct ref_head *head,
+					    size_t align, size_t size)
+{
+	unsigned long addr = head->end, flags;
+	struct ref_region *c, *new;
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	spin_lock_irqsave(&head->lock, flags);
+	addr = rounddown(addr - size, align);
+	list_for_each_entry_reverse(c, &head->list, list) {
+		if (addr >= c->end)
+			goto found;
+		addr = rounddown(c->start - size, align);
+		if (addr < head->start)
+			goto nospc;
+	}
+ found:
+	list_add(&new->list, &c->list);
+	new->start = addr;
+	new->end = addr + size;
+	spin_unlock_irqrestore(&head->lock, flags);
+	return new;
+
+ nospc:
+	spin_unlock_irqrestore(&head->lock, flags);
+	kfree(new);
+	return NULL;
+}
+
+static void __init ref_free(struct ref_head *head, struct ref_region *c)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&head->lock, flags);
+	list_del(&c->list);
+	spin_unlock_irqrestore(&head->lock, flags);
+	kfree(c);
+}
+
+static struct arm_vmregion *regions[TEST_LIVE] __initdata;
+static struct ref_region *refs[TEST_LIVE] __initdata;
+
+/* Random size and the alignment __dma_alloc_remap() would ask for */
+static void __init random_request(size_t *size, size_t *align)
+{
+	int bit;
+
+	*size = ((random32() % TEST_MAX_PAGES) + 1) << PAGE_SHIFT;
+	bit = fls(*size - 1);
+	if (bit > SECTION_SHIFT)
+		bit = SECTION_SHIFT;
+	*align = 1 << bit;
+}
+
+static int __init alloc_both(struct arm_vmregion_head *head,
+			     struct ref_head *ref, int i,
+			     u64 *ns, u64 *ref_ns)
+{
+	size_t size, align;
+	ktime_t t0;
+
+	random_request(&size, &align);
+
+	t0 = ktime_get();
+	regions[i] = arm_vmregion_alloc(head, align, size, GFP_KERNEL);
+	*ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	t0 = ktime_get();
+	refs[i] = ref_alloc(ref, align, size);
+	*ref_ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	if (!regions[i] || !refs[i] || regions[i]->vm_start != refs[i]->start) {
+		pr_err("vmregion: allocation %d of %zu bytes: got %#lx, "
+		       "list walk gives %#lx\n", i, size,
+		       regions[i] ? regions[i]->vm_start : 0,
+		       refs[i] ? refs[i]->start : 0);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static void __init free_both(struct arm_vmregion_head *head,
+			     struct ref_head *ref, int i,
+			     u64 *ns, u64 *ref_ns)
+{
+	ktime_t t0;
+
+	t0 = ktime_get();
+	if (arm_vmregion_find_remove(head, regions[i]->vm_start) != regions[i])
+		pr_err("vmregion: %#lx not found\n", regions[i]->vm_start);
+	arm_vmregion_free(head, regions[i]);
+	*ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	t0 = ktime_get();
+	ref_free(ref, refs[i]);
+	*ref_ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	regions[i] = NULL;
+	refs[i] = NULL;
+}
+
+static struct arm_vmregion_head head __initdata = {
+	.vm_lock	= __SPIN_LOCK_UNLOCKED(head.vm_lock),
+	.vm_root	= RB_ROOT,
+	.vm_start	= TEST_BASE,
+	.vm_end		= TEST_BASE + (TEST_LIVE * 2 * TEST_MAX_PAGES << PAGE_SHIFT),
+};
+
+static struct ref_head ref __initdata = {
+	.lock		= __SPIN_LOCK_UNLOCKED(ref.lock),
+	.list		= LIST_HEAD_INIT(ref.list),
+	.start		= TEST_BASE,
+	.end		= TEST_BASE + (TEST_LIVE * 2 * TEST_MAX_PAGES << PAGE_SHIFT),
+};
+
+static int __init test_vmregion_init(void)
+{
+	u64 fill_ns = 0, fill_ref_ns = 0, ns = 0, ref_ns = 0;
+	int i, ret = 0;
+
+	for (i = 0; i < TEST_LIVE && !ret; i++)
+		ret = alloc_both(&head, &ref, i, &fill_ns, &fill_ref_ns);
+
+	for (i = 0; i < TEST_CHURN && !ret; i++) {
+		int victim = random32() % TEST_LIVE;
+
+		free_both(&head, &ref, victim, &ns, &ref_ns);
+		ret = alloc_both(&head, &ref, victim, &ns, &ref_ns);
+	}
+
+	for (i = 0; i < TEST_LIVE; i++) {
+		if (regions[i]) {
+			arm_vmregion_free(&head, regions[i]);
+			regions[i] = NULL;
+		}
+		if (refs[i]) {
+			kfree(refs[i]);
+			refs[i] = NULL;
+		}
+	}
+	if (!ret && !RB_EMPTY_ROOT(&head.vm_root)) {
+		pr_err("vmregion: regions left after freeing all\n");
+		ret = -EINVAL;
+	}
+	if (ret)
+		return ret;
+
+	pr_info("vmregion: %d live regions, per allocation: fill %llu ns "
+		"(list %llu ns), alloc+free %llu ns (list %llu ns)\n",
+		TEST_LIVE, div_u64(fill_ns, TEST_LIVE),
+		div_u64(fill_ref_ns, TEST_LIVE), div_u64(ns, TEST_CHURN),
+		div_u64(ref_ns, TEST_CHURN));
+	return 0;
+}
+late_initcall(test_vmregion_init);
@@ -1,5 +1,9 @@
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
 #include <linux/spinlock.h>
-#include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/slab.h>
 
 #include "vmregion.h"
@@ -32,15 +36,121 @@
  * However, vmalloc_head.vm_start is variable (typically, it is dependent on
  * the amount of RAM found at boot time.)  I would imagine that get_vm_area()
  * would have to initialise this each time prior to calling vmregion_alloc().
+ *
+ * Regions are kept in an rbtree sorted by address.  Each one records the
+ * free space between it and the region below (vm_gap), and the largest
+ * such gap anywhere in its subtree (vm_max_gap), so that allocation can
+ * skip every subtree with no gap big enough instead of walking all the
+ * regions in turn.  The space above the highest region is not anybody's
+ * vm_gap and is looked at separately.
+ */
+
+static inline unsigned long vmregion_max_gap(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct arm_vmregion, vm_rb)->vm_max_gap : 0;
+}
+
+static void vmregion_augment_cb(struct rb_node *node, void *unused)
+{
+	struct arm_vmregion *c = rb_entry(node, struct arm_vmregion, vm_rb);
+
+	c->vm_max_gap = max3(c->vm_gap, vmregion_max_gap(node->rb_left),
+			     vmregion_max_gap(node->rb_right));
+}
+
+/* Update vm_max_gap from @node up to the root after its vm_gap changed */
+static void vmregion_propagate(struct rb_node *node)
+{
+	for (; node; node = rb_parent(node))
+		vmregion_augment_cb(node, NULL);
+}
+
+/*
+ * Walk the regions from the highest address down, skipping subtrees
+ * whose largest gap is below @size.  vmregion_gap_last() gives the first
+ * node to look at in the subtree at @node, vmregion_gap_prev() the one
+ * after @node.
  */
+static struct rb_node *vmregion_gap_last(struct rb_node *node, size_t size)
+{
+	while (vmregion_max_gap(node->rb_right) >= size)
+		node = node->rb_right;
+	return node;
+}
+
+static struct rb_node *vmregion_gap_prev(struct rb_node *node, size_t size)
+{
+	struct rb_node *parent;
+
+	if (vmregion_max_gap(node->rb_left) >= size)
+		return vmregion_gap_last(node->rb_left, size);
+
+	while ((parent = rb_parent(node)) && node == parent->rb_left)
+		node = parent;
+	return parent;
+}
+
+static void vmregion_insert(struct arm_vmregion_head *head,
+			    struct arm_vmregion *new)
+{
+	struct rb_node **p = &head->vm_root.rb_node, *parent = NULL;
+	struct rb_node *prev, *next;
+
+	while (*p) {
+		parent = *p;
+		if (new->vm_start < rb_entry(parent, struct arm_vmregion,
+					     vm_rb)->vm_start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&new->vm_rb, parent, p);
+	rb_insert_color(&new->vm_rb, &head->vm_root);
+
+	prev = rb_prev(&new->vm_rb);
+	new->vm_gap = new->vm_start - (prev ? rb_entry(prev,
+			struct arm_vmregion, vm_rb)->vm_end : head->vm_start);
+	rb_augment_insert(&new->vm_rb, vmregion_augment_cb, NULL);
+
+	/* The region above now has less room below it */
+	next = rb_next(&new->vm_rb);
+	if (next) {
+		struct arm_vmregion *c = rb_entry(next, struct arm_vmregion,
+						  vm_rb);
+
+		c->vm_gap = c->vm_start - new->vm_end;
+		vmregion_propagate(next);
+	}
+}
+
+static void vmregion_erase(struct arm_vmregion_head *head,
+			   struct arm_vmregion *c)
+{
+	struct rb_node *next = rb_next(&c->vm_rb), *deepest;
+
+	deepest = rb_augment_erase_begin(&c->vm_rb);
+	rb_erase(&c->vm_rb, &head->vm_root);
+	rb_augment_erase_end(deepest, vmregion_augment_cb, NULL);
+
+	/* The region above gets this one and the gap below it */
+	if (next) {
+		struct arm_vmregion *n = rb_entry(next, struct arm_vmregion,
+						  vm_rb);
+
+		n->vm_gap += c->vm_gap + c->vm_end - c->vm_start;
+		vmregion_propagate(next);
+	}
+}
+
 
 struct arm_vmregion *
 arm_vmregion_alloc(struct arm_vmregion_head *head, size_t align,
 		   size_t size, gfp_t gfp)
 {
-	unsigned long start = head->vm_start, addr = head->vm_end;
+	unsigned long addr, below;
 	unsigned long flags;
 	struct arm_vmregion *c, *new;
+	struct rb_node *node;
 
 	if (head->vm_end - head->vm_start < size) {
 		printk(KERN_WARNING "%s: allocation too big (requested %#x)\n",
@@ -54,23 +164,35 @@ arm_vmregion_alloc(struct arm_vmregion_head *head, size_t align,
 
 	spin_lock_irqsave(&head->vm_lock, flags);
 
-	addr = rounddown(addr - size, align);
-	list_for_each_entry_reverse(c, &head->vm_list, vm_list) {
-		if (addr >= c->vm_end)
-			goto found;
+	/* Allocate from the top down, starting above the highest region */
+	node = rb_last(&head->vm_root);
+	below = node ? rb_entry(node, struct arm_vmregion, vm_rb)->vm_end :
+		head->vm_start;
+	addr = rounddown(head->vm_end - size, align);
+	if (addr >= below)
+		goto found;
+
+	/* Then the highest gap between regions that the request fits */
+	node = head->vm_root.rb_node;
+	if (vmregion_max_gap(node) < size)
+		goto nospc;
+
+	for (node = vmregion_gap_last(node, size); node;
+	     node = vmregion_gap_prev(node, size)) {
+		c = rb_entry(node, struct arm_vmregion, vm_rb);
+		if (c->vm_gap < size)
+			continue;
 		addr = rounddown(c->vm_start - size, align);
-		if (addr < start)
-			goto nospc;
+		if (addr >= c->vm_start - c->vm_gap)
+			goto found;
 	}
+	goto nospc;
 
  found:
-	/*
-	 * Insert this entry after the one we found.
-	 */
-	list_add(&new->vm_list, &c->vm_list);
 	new->vm_start = addr;
 	new->vm_end = addr + size;
 	new->vm_active = 1;
+	vmregion_insert(head, new);
 
 	spin_unlock_irqrestore(&head->vm_lock, flags);
 	return new;
@@ -84,17 +206,22 @@ arm_vmregion_alloc(struct arm_vmregion_head *head, size_t align,
 
 static struct arm_vmregion *__arm_vmregion_find(struct arm_vmregion_head *head, unsigned long addr)
 {
+	struct rb_node *node = head->vm_root.rb_node;
 	struct arm_vmregion *c;
 
-	list_for_each_entry(c, &head->vm_list, vm_list) {
-		if (c->vm_active && c->vm_start == addr)
-			goto out;
+	while (node) {
+		c = rb_entry(node, struct arm_vmregion, vm_rb);
+		if (addr < c->vm_start)
+			node = node->rb_left;
+		else if (addr > c->vm_start)
+			node = node->rb_right;
+		else if (c->vm_active)
+			return c;
+		else
+			break;
 	}
-	c = NULL;
- out:
-	return c;
+	return NULL;
 }
-
 struct arm_vmregion *arm_vmregion_find(struct arm_vmregion_head *head, unsigned long addr)
 {
 	struct arm_vmregion *c;
@@ -124,8 +251,93 @@ void arm_vmregion_free(struct arm_vmregion_head *head, struct arm_vmregion *c)
 	unsigned long flags;
 
 	spin_lock_irqsave(&head->vm_lock, flags);
-	list_del(&c->vm_list);
+	vmregion_erase(head, c);
 	spin_unlock_irqrestore(&head->vm_lock, flags);
 
 	kfree(c);
 }
+
+#ifdef CONFIG_DEBUG_FS
+#define VMREGION_GAP_ORDERS	12
+
+static void vmregion_count_gap(unsigned long gap, unsigned long *nr_gaps,
+			       unsigned long *largest)
+{
+	unsigned long pages = gap >> PAGE_SHIFT;
+
+	if (!pages)
+		return;
+	nr_gaps[min_t(int, ilog2(pages), VMREGION_GAP_ORDERS - 1)]++;
+	if (gap > *largest)
+		*largest = gap;
+}
+
+/*
+ * Space in use and the free extents between regions, by power of two
+ * size, with how much of the free space the largest extent is not.
+ */
+static int vmregion_stats_show(struct seq_file *m, void *v)
+{
+	struct arm_vmregion_head *head = m->private;
+	unsigned long nr_gaps[VMREGION_GAP_ORDERS] = { 0, };
+	unsigned long used = 0, nr_used = 0, nr_free = 0, largest = 0;
+	unsigned long below = head->vm_start, total, free, flags;
+	struct arm_vmregion *c;
+	struct rb_node *node;
+	int i;
+
+	spin_lock_irqsave(&head->vm_lock, flags);
+	for (node = rb_first(&head->vm_root); node; node = rb_next(node)) {
+		c = rb_entry(node, struct arm_vmregion, vm_rb);
+		used += c->vm_end - c->vm_start;
+		nr_used++;
+		vmregion_count_gap(c->vm_gap, nr_gaps, &largest);
+		below = c->vm_end;
+	}
+	vmregion_count_gap(head->vm_end - below, nr_gaps, &largest);
+	spin_unlock_irqrestore(&head->vm_lock, flags);
+
+	total = head->vm_end - head->vm_start;
+	free = total - used;
+	for (i = 0; i < VMREGION_GAP_ORDERS; i++)
+		nr_free += nr_gaps[i];
+
+	seq_printf(m, "area:          0x%08lx-0x%08lx %lu kB\n",
+		   head->vm_start, head->vm_end, total >> 10);
+	seq_printf(m, "used:          %lu kB in %lu regions\n",
+		   used >> 10, nr_used);
+	seq_printf(m, "free:          %lu kB in %lu extents\n",
+		   free >> 10, nr_free);
+	seq_printf(m, "largest free:  %lu kB\n", largest >> 10);
+	seq_printf(m, "fragmentation: %lu%%\n", free >> PAGE_SHIFT ?
+		   ((free - largest) >> PAGE_SHIFT) * 100 /
+		   (free >> PAGE_SHIFT) : 0);
+	seq_printf(m, "free extents by size:\n");
+	for (i = 0; i < VMREGION_GAP_ORDERS; i++)
+		seq_printf(m, "  %s%6lu kB %lu\n",
+			   i == VMREGION_GAP_ORDERS - 1 ? ">=" : "  ",
+			   (PAGE_SIZE << i) >> 10, nr_gaps[i]);
+	return 0;
+}
+
+static int vmregion_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, vmregion_stats_show, inode->i_private);
+}
+
+static const struct file_operations vmregion_stats_fops = {
+	.open		= vmregion_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+int arm_vmregion_create_debugfs(const char *name,
+				struct arm_vmregion_head *head)
+{
+	if (!debugfs_create_file(name, S_IRUSR, NULL, head,
+				 &vmregion_stats_fops))
+		return -ENOMEM;
+	return 0;
+}
+#endif
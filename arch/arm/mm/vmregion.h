@@ -2,21 +2,23 @@
 #define VMREGION_H
 
 #include <linux/spinlock.h>
-#include <linux/list.h>
+#include <linux/rbtree.h>
 
 struct page;
 
 struct arm_vmregion_head {
 	spinlock_t		vm_lock;
-	struct list_head	vm_list;
+	struct rb_root		vm_root;
 	unsigned long		vm_start;
 	unsigned long		vm_end;
 };
 
 struct arm_vmregion {
-	struct list_head	vm_list;
+	struct rb_node		vm_rb;
 	unsigned long		vm_start;
 	unsigned long		vm_end;
+	unsigned long		vm_gap;		/* free space just below vm_start */
+	unsigned long		vm_max_gap;	/* largest vm_gap in this subtree */
 	struct page		*vm_pages;
 	int			vm_active;
 };
@@ -26,4 +28,14 @@ struct arm_vmregion *arm_vmregion_find(struct arm_vmregion_head *, unsigned long
 struct arm_vmregion *arm_vmregion_find_remove(struct arm_vmregion_head *, unsigned long);
 void arm_vmregion_free(struct arm_vmregion_head *, struct arm_vmregion *);
 
+#ifdef CONFIG_DEBUG_FS
+int arm_vmregion_create_debugfs(const char *, struct arm_vmregion_head *);
+#else
+static inline int arm_vmregion_create_debugfs(const char *name,
+					      struct arm_vmregion_head *head)
+{
+	return 0;
+}
+#endif
+
 #endif
@@ -0,0 +1,887 @@
+/*
+ * Just-In-Time compiler for BPF filters on 32bit ARM
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; version 2 of the License.
+ */
+
+#include <linux/bitops.h>
+#include <linux/compiler.h>
+#include <linux/errno.h>
+#include <linux/filter.h>
+#include <linux/log2.h>
+#include <linux/moduleloader.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+#include <asm/cacheflush.h>
+#include <asm/thread_info.h>
+
+#include "bpf_jit_32.h"
+
+/*
+ * ABI:
+ *
+ * r0	scratch register / helper argument and result
+ * r1	scratch register / offset of the packet load
+ * r2	scratch register
+ * r3	scratch register / helper address
+ * r4	BPF register A
+ * r5	BPF register X
+ * r6	pointer to the skb
+ * r7	skb->data
+ * r8	skb_headlen(skb)
+ *
+ * The scratch memory words live on the stack, mem[k] at [sp, #k * 4].
+ * Returns go through the epilogue with the result in r0.
+ */
+
+#define r_scratch	ARM_R0
+#define r_off		ARM_R1
+#define r_A		ARM_R4
+#define r_X		ARM_R5
+#define r_skb		ARM_R6
+#define r_skb_data	ARM_R7
+#define r_skb_hl	ARM_R8
+
+/* The slow path helpers return the value and error as one u64 */
+#ifdef __ARMEB__
+#define r_ret_val	ARM_R1
+#define r_ret_err	ARM_R0
+#else
+#define r_ret_val	ARM_R0
+#define r_ret_err	ARM_R1
+#endif
+
+#define SEEN_MEM	(1 << 0)	/* uses the scratch memory words */
+#define SEEN_DATA	(1 << 1)	/* loads packet data */
+#define SEEN_SKB	(1 << 2)	/* reads skb fields */
+#define SEEN_X		(1 << 3)	/* uses register X */
+#define SEEN_CALL	(1 << 4)	/* calls a C helper */
+
+#define SCRATCH_SIZE	(BPF_MEMWORDS * 4)
+
+struct jit_ctx {
+	const struct sk_filter *skf;
+	unsigned idx;
+	unsigned prologue_bytes;
+	u32 seen;
+	u32 *offsets;
+	u32 *target;
+	unsigned epilogue_bytes;
+};
+
+int bpf_jit_enable __read_mostly;
+
+static u64 jit_get_skb_b(struct sk_buff *skb, unsigned offset)
+{
+	u8 ret;
+	int err;
+
+	err = skb_copy_bits(skb, offset, &ret, 1);
+
+	return (u64)err << 32 | ret;
+}
+
+static u64 jit_get_skb_h(struct sk_buff *skb, unsigned offset)
+{
+	u16 ret;
+	int err;
+
+	err = skb_copy_bits(skb, offset, &ret, 2);
+
+	return (u64)err << 32 | ntohs(ret);
+}
+
+static u64 jit_get_skb_w(struct sk_buff *skb, unsigned offset)
+{
+	u32 ret;
+	int err;
+
+	err = skb_copy_bits(skb, offset, &ret, 4);
+
+	return (u64)err << 32 | ntohl(ret);
+}
+
+/* Cortex-A8 and older cores have no divide instruction */
+static u32 jit_udiv(u32 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline void _emit(int cond, u32 inst, struct jit_ctx *ctx)
+{
+	if (ctx->target != NULL)
+		ctx->target[ctx->idx] = inst | (cond << 28);
+
+	ctx->idx++;
+}
+
+/*
+ * Emit an instruction that will be executed unconditionally.
+ */
+static inline void emit(u32 inst, struct jit_ctx *ctx)
+{
+	_emit(ARM_COND_AL, inst, ctx);
+}
+
+static u16 saved_regs(struct jit_ctx *ctx)
+{
+	u16 ret = 0;
+
+	if ((ctx->skf->len > 1) ||
+	    (ctx->skf->insns[0].code == BPF_S_RET_A))
+		ret |= 1 << r_A;
+	if (ctx->seen & SEEN_CALL)
+		ret |= 1 << ARM_LR;
+	if (ctx->seen & (SEEN_DATA | SEEN_SKB))
+		ret |= 1 << r_skb;
+	if (ctx->seen & SEEN_DATA)
+		ret |= (1 << r_skb_data) | (1 << r_skb_hl);
+	if (ctx->seen & SEEN_X)
+		ret |= 1 << r_X;
+
+	/*
+	 * Keep the stack 8-byte aligned across helper calls. r3 is a
+	 * scratch register, so restoring its stale value is harmless.
+	 */
+	if ((ctx->seen & SEEN_CALL) && (hweight16(ret) & 1))
+		ret |= 1 << ARM_R3;
+
+	return ret;
+}
+
+static void build_prologue(struct jit_ctx *ctx)
+{
+	u16 reg_set = saved_regs(ctx);
+	u16 first_inst = ctx->skf->insns[0].code;
+	u16 off;
+
+	if (reg_set)
+		emit(ARM_PUSH(reg_set), ctx);
+
+	if (ctx->seen & (SEEN_DATA | SEEN_SKB))
+		emit(ARM_MOV_R(r_skb, ARM_R0), ctx);
+
+	if (ctx->seen & SEEN_DATA) {
+		off = offsetof(struct sk_buff, data);
+		emit(ARM_LDR_I(r_skb_data, r_skb, off), ctx);
+		/* headlen = len - data_len */
+		off = offsetof(struct sk_buff, len);
+		emit(ARM_LDR_I(r_skb_hl, r_skb, off), ctx);
+		off = offsetof(struct sk_buff, data_len);
+		emit(ARM_LDR_I(r_scratch, r_skb, off), ctx);
+		emit(ARM_SUB_R(r_skb_hl, r_skb_hl, r_scratch), ctx);
+	}
+
+	/* make sure we don't leak kernel information to user */
+	if (ctx->seen & SEEN_X)
+		emit(ARM_MOV_I(r_X, 0), ctx);
+
+	/* do not leak kernel data to userspace */
+	switch (first_inst) {
+	case BPF_S_RET_K:
+	case BPF_S_LD_W_LEN:
+	case BPF_S_ANC_PROTOCOL:
+	case BPF_S_ANC_IFINDEX:
+	case BPF_S_ANC_MARK:
+	case BPF_S_ANC_RXHASH:
+	case BPF_S_ANC_CPU:
+	case BPF_S_ANC_QUEUE:
+	case BPF_S_LD_W_ABS:
+	case BPF_S_LD_H_ABS:
+	case BPF_S_LD_B_ABS:
+	case BPF_S_LD_IMM:
+		/* first instruction sets A register (or is RET 'constant') */
+		break;
+	default:
+		emit(ARM_MOV_I(r_A, 0), ctx);
+	}
+
+	if (ctx->seen & SEEN_MEM)
+		emit(ARM_SUB_I(ARM_SP, ARM_SP, SCRATCH_SIZE), ctx);
+}
+
+static void build_epilogue(struct jit_ctx *ctx)
+{
+	u16 reg_set = saved_regs(ctx);
+
+	if (ctx->seen & SEEN_MEM)
+		emit(ARM_ADD_I(ARM_SP, ARM_SP, SCRATCH_SIZE), ctx);
+
+	if (reg_set & (1 << ARM_LR)) {
+		reg_set &= ~(1 << ARM_LR);
+		reg_set |= 1 << ARM_PC;
+		emit(ARM_POP(reg_set), ctx);
+		return;
+	}
+
+	if (reg_set)
+		emit(ARM_POP(reg_set), ctx);
+#if __LINUX_ARM_ARCH__ < 5
+	emit(ARM_MOV_R(ARM_PC, ARM_LR), ctx);
+#else
+	emit(ARM_BX(ARM_LR), ctx);
+#endif
+}
+
+/*
+ * Return the 12-bit "modified immediate" encoding of x, or -1 if x is
+ * not an 8-bit value rotated right by an even amount.
+ */
+static int16_t imm8m(u32 x)
+{
+	u32 rot, imm8;
+
+	for (rot = 0; rot < 16; rot++) {
+		imm8 = rot ? (x << 2 * rot) | (x >> (32 - 2 * rot)) : x;
+		if (imm8 <= 0xff)
+			return imm8 | (rot << 8);
+	}
+
+	return -1;
+}
+
+static inline u32 b_imm(unsigned tgt, struct jit_ctx *ctx)
+{
+	u32 imm;
+
+	if (ctx->target == NULL)
+		return 0;
+	/*
+	 * BPF allows only forward jumps and the offset of the target is
+	 * still the one computed during the first pass.
+	 */
+	imm = ctx->offsets[tgt] + ctx->prologue_bytes - (ctx->idx * 4 + 8);
+
+	return imm >> 2;
+}
+
+static inline u32 b_epilogue(struct jit_ctx *ctx)
+{
+	u32 imm;
+
+	if (ctx->target == NULL)
+		return 0;
+	imm = ctx->epilogue_bytes + ctx->prologue_bytes - (ctx->idx * 4 + 8);
+
+	return imm >> 2;
+}
+
+/* Return 0 from the filter if cond holds */
+static inline void emit_err_ret(u8 cond, struct jit_ctx *ctx)
+{
+	_emit(cond, ARM_MOV_I(ARM_R0, 0), ctx);
+	_emit(cond, ARM_B(b_epilogue(ctx)), ctx);
+}
+
+static void emit_mov_i_no8m(int rd, u32 val, struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ < 7
+	/* Build the constant a byte at a time: every byte is encodable */
+	bool first = true;
+	int shift;
+
+	for (shift = 0; shift < 32; shift += 8) {
+		u32 part = val & (0xffU << shift);
+
+		if (!part)
+			continue;
+		if (first)
+			emit(ARM_MOV_I(rd, imm8m(part)), ctx);
+		else
+			emit(ARM_ORR_I(rd, rd, imm8m(part)), ctx);
+		first = false;
+	}
+#else
+	emit(ARM_MOVW(rd, val & 0xffff), ctx);
+	if (val > 0xffff)
+		emit(ARM_MOVT(rd, val >> 16), ctx);
+#endif
+}
+
+/*
+ * Load a 32-bit immediate into rd. The number of instructions depends on
+ * the value only, so both passes emit the same amount of code.
+ */
+static inline void emit_mov_i(int rd, u32 val, struct jit_ctx *ctx)
+{
+	int imm12 = imm8m(val);
+
+	if (imm12 >= 0)
+		emit(ARM_MOV_I(rd, imm12), ctx);
+	else if ((imm12 = imm8m(~val)) >= 0)
+		emit(ARM_MVN_I(rd, imm12), ctx);
+	else
+		emit_mov_i_no8m(rd, val, ctx);
+}
+
+/* rd = rn <op> k, going through r_scratch if k cannot be encoded */
+static void emit_alu_k(u32 op_i, u32 op_r, int rd, int rn, u32 k,
+		       struct jit_ctx *ctx)
+{
+	int imm12 = imm8m(k);
+
+	if (imm12 >= 0) {
+		emit(op_i | rd << 12 | rn << 16 | imm12, ctx);
+	} else {
+		emit_mov_i(r_scratch, k, ctx);
+		emit(op_r | rd << 12 | rn << 16 | r_scratch, ctx);
+	}
+}
+
+static inline void emit_blx_r(u8 tgt_reg, struct jit_ctx *ctx)
+{
+	ctx->seen |= SEEN_CALL;
+#if __LINUX_ARM_ARCH__ < 5
+	emit(ARM_MOV_R(ARM_LR, ARM_PC), ctx);
+	emit(ARM_MOV_R(ARM_PC, tgt_reg), ctx);
+#else
+	emit(ARM_BLX_R(tgt_reg), ctx);
+#endif
+}
+
+/* rd = ntohs(rd) / ntohl(rd) for a value loaded in cpu byte order */
+static void emit_swap16(u8 cond, u8 rd, struct jit_ctx *ctx)
+{
+#ifndef __ARMEB__
+#if __LINUX_ARM_ARCH__ < 6
+	_emit(cond, ARM_AND_I(ARM_R2, rd, 0xff), ctx);
+	_emit(cond, ARM_LSR_I(rd, rd, 8), ctx);
+	_emit(cond, ARM_ORR_S(rd, rd, ARM_R2, SRTYPE_LSL, 8), ctx);
+#else
+	_emit(cond, ARM_REV16(rd, rd), ctx);
+#endif
+#endif
+}
+
+/*
+ * Fast path load of 1 << order bytes at skb->data + r_off into r_A,
+ * executed under cond.
+ */
+static void emit_load_be(u8 cond, u8 order, struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ < 6
+	/* no unaligned accesses: assemble the value a byte at a time */
+	int i;
+
+	_emit(cond, ARM_ADD_R(ARM_R3, r_skb_data, r_off), ctx);
+	_emit(cond, ARM_LDRB_I(r_A, ARM_R3, 0), ctx);
+	for (i = 1; i < (1 << order); i++) {
+		_emit(cond, ARM_LDRB_I(ARM_R2, ARM_R3, i), ctx);
+		_emit(cond, ARM_ORR_S(r_A, ARM_R2, r_A, SRTYPE_LSL, 8), ctx);
+	}
+#else
+	if (order == 0) {
+		_emit(cond, ARM_LDRB_R(r_A, r_skb_data, r_off), ctx);
+	} else if (order == 1) {
+		_emit(cond, ARM_LDRH_R(r_A, r_skb_data, r_off), ctx);
+		emit_swap16(cond, r_A, ctx);
+	} else {
+		_emit(cond, ARM_LDR_R(r_A, r_skb_data, r_off), ctx);
+#ifndef __ARMEB__
+		_emit(cond, ARM_REV(r_A, r_A), ctx);
+#endif
+	}
+#endif
+}
+
+/*
+ * A = 1 << order bytes at offset r_off of the packet. Data in the linear
+ * part is read inline, anything else goes through skb_copy_bits().
+ */
+static void emit_load(u8 order, unsigned i, struct jit_ctx *ctx)
+{
+	static void * const load_func[] = {
+		jit_get_skb_b, jit_get_skb_h, jit_get_skb_w
+	};
+	u8 cond;
+
+	ctx->seen |= SEEN_DATA | SEEN_CALL;
+
+	/* r_off is known to be below 2^31, so this cannot wrap */
+	if (order == 0) {
+		emit(ARM_CMP_R(r_skb_hl, r_off), ctx);
+		cond = ARM_COND_HI;
+	} else {
+		emit(ARM_ADD_I(r_scratch, r_off, 1 << order), ctx);
+		emit(ARM_CMP_R(r_skb_hl, r_scratch), ctx);
+		cond = ARM_COND_HS;
+	}
+	emit_load_be(cond, order, ctx);
+	_emit(cond, ARM_B(b_imm(i + 1, ctx)), ctx);
+
+	/* the slowpath; the offset is already in r1 */
+	emit_mov_i(ARM_R3, (u32)load_func[order], ctx);
+	emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
+	emit_blx_r(ARM_R3, ctx);
+	/* check the result of skb_copy_bits */
+	emit(ARM_CMP_I(r_ret_err, 0), ctx);
+	emit_err_ret(ARM_COND_NE, ctx);
+	emit(ARM_MOV_R(r_A, r_ret_val), ctx);
+}
+
+/* rd = skb field of the given size at offset off */
+static void emit_load_field(u8 rd, u8 rn, unsigned off, unsigned size,
+			    struct jit_ctx *ctx)
+{
+	if (size == 4 && off < 4096) {
+		emit(ARM_LDR_I(rd, rn, off), ctx);
+	} else if (size == 2 && off < 256) {
+		emit(ARM_LDRH_I(rd, rn, off), ctx);
+	} else {
+		emit_mov_i(ARM_R2, off, ctx);
+		if (size == 4)
+			emit(ARM_LDR_R(rd, rn, ARM_R2), ctx);
+		else
+			emit(ARM_LDRH_R(rd, rn, ARM_R2), ctx);
+	}
+}
+
+#define COND_SEL(CODE, TRUE, FALSE)	\
+	case CODE:			\
+		cond_t = TRUE;		\
+		cond_f = FALSE;		\
+		goto cond_jump
+
+static int build_body(struct jit_ctx *ctx)
+{
+	const struct sk_filter *prog = ctx->skf;
+	const struct sock_filter *inst;
+	unsigned i, load_order, off;
+	u8 cond_t, cond_f;
+	int imm12;
+	u32 k;
+
+	for (i = 0; i < prog->len; i++) {
+		inst = &(prog->insns[i]);
+		/* K as an immediate value operand */
+		k = inst->k;
+
+		/* compute offsets only in the fake pass */
+		if (ctx->target == NULL)
+			ctx->offsets[i] = ctx->idx * 4;
+
+		switch (inst->code) {
+		case BPF_S_LD_IMM:
+			emit_mov_i(r_A, k, ctx);
+			break;
+		case BPF_S_LD_W_LEN:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, len) != 4);
+			emit_load_field(r_A, r_skb,
+					offsetof(struct sk_buff, len), 4, ctx);
+			break;
+		case BPF_S_LD_MEM:
+			/* A = scratch[k] */
+			ctx->seen |= SEEN_MEM;
+			emit(ARM_LDR_I(r_A, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_LD_W_ABS:
+			load_order = 2;
+			goto load;
+		case BPF_S_LD_H_ABS:
+			load_order = 1;
+			goto load;
+		case BPF_S_LD_B_ABS:
+			load_order = 0;
+load:
+			/* the interpreter will deal with the negative K */
+			if ((int)k < 0)
+				return -ENOTSUPP;
+			emit_mov_i(r_off, k, ctx);
+			emit_load(load_order, i, ctx);
+			break;
+		case BPF_S_LD_W_IND:
+			load_order = 2;
+			goto load_ind;
+		case BPF_S_LD_H_IND:
+			load_order = 1;
+			goto load_ind;
+		case BPF_S_LD_B_IND:
+			load_order = 0;
+load_ind:
+			ctx->seen |= SEEN_X;
+			emit_alu_k(ARM_INST_ADD_I, ARM_INST_ADD_R, r_off, r_X,
+				   k, ctx);
+			/* as on x86, a negative X + K fails the filter */
+			emit(ARM_CMP_I(r_off, 0), ctx);
+			emit_err_ret(ARM_COND_LT, ctx);
+			emit_load(load_order, i, ctx);
+			break;
+		case BPF_S_LDX_IMM:
+			ctx->seen |= SEEN_X;
+			emit_mov_i(r_X, k, ctx);
+			break;
+		case BPF_S_LDX_W_LEN:
+			ctx->seen |= SEEN_X | SEEN_SKB;
+			emit_load_field(r_X, r_skb,
+					offsetof(struct sk_buff, len), 4, ctx);
+			break;
+		case BPF_S_LDX_MEM:
+			ctx->seen |= SEEN_X | SEEN_MEM;
+			emit(ARM_LDR_I(r_X, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_LDX_B_MSH:
+			/* x = ((*(frame + k)) & 0xf) << 2; */
+			if ((int)k < 0)
+				return -ENOTSUPP;
+			ctx->seen |= SEEN_X | SEEN_DATA | SEEN_CALL;
+			emit_mov_i(r_off, k, ctx);
+			emit(ARM_CMP_R(r_skb_hl, r_off), ctx);
+			_emit(ARM_COND_HI, ARM_LDRB_R(ARM_R0, r_skb_data, r_off),
+			      ctx);
+			_emit(ARM_COND_HI, ARM_AND_I(r_X, ARM_R0, 0x0f), ctx);
+			_emit(ARM_COND_HI, ARM_LSL_I(r_X, r_X, 2), ctx);
+			_emit(ARM_COND_HI, ARM_B(b_imm(i + 1, ctx)), ctx);
+			/* the slowpath */
+			emit_mov_i(ARM_R3, (u32)jit_get_skb_b, ctx);
+			emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
+			emit_blx_r(ARM_R3, ctx);
+			emit(ARM_CMP_I(r_ret_err, 0), ctx);
+			emit_err_ret(ARM_COND_NE, ctx);
+			emit(ARM_AND_I(r_X, r_ret_val, 0x0f), ctx);
+			emit(ARM_LSL_I(r_X, r_X, 2), ctx);
+			break;
+		case BPF_S_ST:
+			ctx->seen |= SEEN_MEM;
+			emit(ARM_STR_I(r_A, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_STX:
+			ctx->seen |= SEEN_MEM | SEEN_X;
+			emit(ARM_STR_I(r_X, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_ALU_ADD_K:
+			/* A += K */
+			if (!k)
+				break;
+			if (imm8m(k) < 0 && imm8m(-k) >= 0)
+				emit(ARM_SUB_I(r_A, r_A, imm8m(-k)), ctx);
+			else
+				emit_alu_k(ARM_INST_ADD_I, ARM_INST_ADD_R,
+					   r_A, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_ADD_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_ADD_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_SUB_K:
+			/* A -= K */
+			if (!k)
+				break;
+			if (imm8m(k) < 0 && imm8m(-k) >= 0)
+				emit(ARM_ADD_I(r_A, r_A, imm8m(-k)), ctx);
+			else
+				emit_alu_k(ARM_INST_SUB_I, ARM_INST_SUB_R,
+					   r_A, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_SUB_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_SUB_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_MUL_K:
+			/* A *= K */
+			emit_mov_i(r_scratch, k, ctx);
+			emit(ARM_MUL(r_A, r_A, r_scratch), ctx);
+			break;
+		case BPF_S_ALU_MUL_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_MUL(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_DIV_K:
+			/*
+			 * K holds reciprocal_value() of the divisor, so
+			 * A = (u64)A * K >> 32.
+			 */
+			emit_mov_i(r_scratch, k, ctx);
+			emit(ARM_UMULL(ARM_R1, r_A, r_scratch, r_A), ctx);
+			break;
+		case BPF_S_ALU_DIV_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_CMP_I(r_X, 0), ctx);
+			emit_err_ret(ARM_COND_EQ, ctx);
+			emit(ARM_MOV_R(ARM_R0, r_A), ctx);
+			emit(ARM_MOV_R(ARM_R1, r_X), ctx);
+			emit_mov_i(ARM_R3, (u32)jit_udiv, ctx);
+			emit_blx_r(ARM_R3, ctx);
+			emit(ARM_MOV_R(r_A, ARM_R0), ctx);
+			break;
+		case BPF_S_ALU_OR_K:
+			/* A |= K */
+			emit_alu_k(ARM_INST_ORR_I, ARM_INST_ORR_R,
+				   r_A, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_OR_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_ORR_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_AND_K:
+			/* A &= K */
+			imm12 = imm8m(~k);
+			if (imm8m(k) < 0 && imm12 >= 0)
+				emit(ARM_BIC_I(r_A, r_A, imm12), ctx);
+			else
+				emit_alu_k(ARM_INST_AND_I, ARM_INST_AND_R,
+					   r_A, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_AND_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_AND_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_LSH_K:
+			if (unlikely(k > 31)) {
+				/* shift by register, as the interpreter does */
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_LSL_R(r_A, r_A, r_scratch), ctx);
+			} else if (k) {
+				emit(ARM_LSL_I(r_A, r_A, k), ctx);
+			}
+			break;
+		case BPF_S_ALU_LSH_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_LSL_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_RSH_K:
+			if (unlikely(k > 31)) {
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_LSR_R(r_A, r_A, r_scratch), ctx);
+			} else if (k) {
+				emit(ARM_LSR_I(r_A, r_A, k), ctx);
+			}
+			break;
+		case BPF_S_ALU_RSH_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_LSR_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_NEG:
+			/* A = -A */
+			emit(ARM_RSB_I(r_A, r_A, 0), ctx);
+			break;
+		case BPF_S_JMP_JA:
+			/* pc += K */
+			emit(ARM_B(b_imm(i + k + 1, ctx)), ctx);
+			break;
+		COND_SEL(BPF_S_JMP_JEQ_K, ARM_COND_EQ, ARM_COND_NE);
+		COND_SEL(BPF_S_JMP_JGT_K, ARM_COND_HI, ARM_COND_LS);
+		COND_SEL(BPF_S_JMP_JGE_K, ARM_COND_HS, ARM_COND_LO);
+		COND_SEL(BPF_S_JMP_JSET_K, ARM_COND_NE, ARM_COND_EQ);
+		COND_SEL(BPF_S_JMP_JEQ_X, ARM_COND_EQ, ARM_COND_NE);
+		COND_SEL(BPF_S_JMP_JGT_X, ARM_COND_HI, ARM_COND_LS);
+		COND_SEL(BPF_S_JMP_JGE_X, ARM_COND_HS, ARM_COND_LO);
+		COND_SEL(BPF_S_JMP_JSET_X, ARM_COND_NE, ARM_COND_EQ);
+cond_jump:
+			/* same targets, can avoid doing the test :) */
+			if (inst->jt == inst->jf) {
+				emit(ARM_B(b_imm(i + inst->jt + 1, ctx)), ctx);
+				break;
+			}
+
+			switch (inst->code) {
+			case BPF_S_JMP_JEQ_K:
+			case BPF_S_JMP_JGT_K:
+			case BPF_S_JMP_JGE_K:
+				imm12 = imm8m(k);
+				if (imm12 >= 0) {
+					emit(ARM_CMP_I(r_A, imm12), ctx);
+				} else if ((imm12 = imm8m(-k)) >= 0) {
+					emit(ARM_CMN_I(r_A, imm12), ctx);
+				} else {
+					emit_mov_i(r_scratch, k, ctx);
+					emit(ARM_CMP_R(r_A, r_scratch), ctx);
+				}
+				break;
+			case BPF_S_JMP_JSET_K:
+				emit_alu_k(ARM_INST_TST_I, ARM_INST_TST_R,
+					   0, r_A, k, ctx);
+				break;
+			case BPF_S_JMP_JSET_X:
+				ctx->seen |= SEEN_X;
+				emit(ARM_TST_R(r_A, r_X), ctx);
+				break;
+			default:
+				ctx->seen |= SEEN_X;
+				emit(ARM_CMP_R(r_A, r_X), ctx);
+				break;
+			}
+
+			/* then branch, falling through to the next insn */
+			if (inst->jt)
+				_emit(cond_t, ARM_B(b_imm(i + inst->jt + 1,
+							  ctx)), ctx);
+			if (inst->jf)
+				_emit(cond_f, ARM_B(b_imm(i + inst->jf + 1,
+							  ctx)), ctx);
+			break;
+		case BPF_S_RET_A:
+			emit(ARM_MOV_R(ARM_R0, r_A), ctx);
+			goto b_epilogue;
+		case BPF_S_RET_K:
+			emit_mov_i(ARM_R0, k, ctx);
+b_epilogue:
+			if (i != ctx->skf->len - 1)
+				emit(ARM_B(b_epilogue(ctx)), ctx);
+			break;
+		case BPF_S_MISC_TAX:
+			/* X = A */
+			ctx->seen |= SEEN_X;
+			emit(ARM_MOV_R(r_X, r_A), ctx);
+			break;
+		case BPF_S_MISC_TXA:
+			/* A = X */
+			ctx->seen |= SEEN_X;
+			emit(ARM_MOV_R(r_A, r_X), ctx);
+			break;
+		case BPF_S_ANC_PROTOCOL:
+			/* A = ntohs(skb->protocol) */
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff,
+						  protocol) != 2);
+			off = offsetof(struct sk_buff, protocol);
+			emit_load_field(r_A, r_skb, off, 2, ctx);
+			emit_swap16(ARM_COND_AL, r_A, ctx);
+			break;
+		case BPF_S_ANC_CPU:
+#ifdef CONFIG_SMP
+			/* r_scratch = current_thread_info() */
+			emit(ARM_MOV_R(r_scratch, ARM_SP), ctx);
+			emit(ARM_LSR_I(r_scratch, r_scratch, ilog2(THREAD_SIZE)),
+			     ctx);
+			emit(ARM_LSL_I(r_scratch, r_scratch, ilog2(THREAD_SIZE)),
+			     ctx);
+			BUILD_BUG_ON(FIELD_SIZEOF(struct thread_info, cpu) != 4);
+			off = offsetof(struct thread_info, cpu);
+			emit(ARM_LDR_I(r_A, r_scratch, off), ctx);
+#else
+			emit(ARM_MOV_I(r_A, 0), ctx);
+#endif
+			break;
+		case BPF_S_ANC_IFINDEX:
+		case BPF_S_ANC_HATYPE:
+			/* A = skb->dev->ifindex / skb->dev->type */
+			ctx->seen |= SEEN_SKB;
+			off = offsetof(struct sk_buff, dev);
+			emit_load_field(r_scratch, r_skb, off, 4, ctx);
+
+			/* r_scratch is 0 already when the error path runs */
+			emit(ARM_CMP_I(r_scratch, 0), ctx);
+			_emit(ARM_COND_EQ, ARM_B(b_epilogue(ctx)), ctx);
+
+			if (inst->code == BPF_S_ANC_IFINDEX) {
+				BUILD_BUG_ON(FIELD_SIZEOF(struct net_device,
+							  ifindex) != 4);
+				off = offsetof(struct net_device, ifindex);
+				emit_load_field(r_A, r_scratch, off, 4, ctx);
+			} else {
+				BUILD_BUG_ON(FIELD_SIZEOF(struct net_device,
+							  type) != 2);
+				off = offsetof(struct net_device, type);
+				emit_load_field(r_A, r_scratch, off, 2, ctx);
+			}
+			break;
+		case BPF_S_ANC_MARK:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, mark) != 4);
+			off = offsetof(struct sk_buff, mark);
+			emit_load_field(r_A, r_skb, off, 4, ctx);
+			break;
+		case BPF_S_ANC_RXHASH:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, rxhash) != 4);
+			off = offsetof(struct sk_buff, rxhash);
+			emit_load_field(r_A, r_skb, off, 4, ctx);
+			break;
+		case BPF_S_ANC_QUEUE:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff,
+						  queue_mapping) != 2);
+			off = offsetof(struct sk_buff, queue_mapping);
+			emit_load_field(r_A, r_skb, off, 2, ctx);
+			break;
+		default:
+			/* hmm, too complex filter, give up with jit compiler */
+			return -ENOTSUPP;
+		}
+	}
+
+	/* compute the epilogue offset in the fake pass */
+	if (ctx->target == NULL)
+		ctx->epilogue_bytes = ctx->idx * 4;
+
+	return 0;
+}
+
+
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	struct jit_ctx ctx;
+	unsigned tmp_idx;
+	unsigned alloc_size;
+
+	if (!bpf_jit_enable)
+		return;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.skf = fp;
+
+	ctx.offsets = kzalloc(4 * ctx.skf->len, GFP_KERNEL);
+	if (ctx.offsets == NULL)
+		return;
+
+	/* fake pass to fill in the ctx->seen and the offsets */
+	if (unlikely(build_body(&ctx)))
+		goto out;
+
+	tmp_idx = ctx.idx;
+	build_prologue(&ctx);
+	ctx.prologue_bytes = (ctx.idx - tmp_idx) * 4;
+
+	build_epilogue(&ctx);
+
+	/* bpf_jit_free() reuses the image as a work_struct */
+	alloc_size = max_t(unsigned, 4 * ctx.idx, sizeof(struct work_struct));
+	ctx.target = module_alloc(alloc_size);
+	if (unlikely(ctx.target == NULL))
+		goto out;
+
+	ctx.idx = 0;
+	build_prologue(&ctx);
+	build_body(&ctx);
+	build_epilogue(&ctx);
+
+	flush_icache_range((u32)ctx.target, (u32)(ctx.target + ctx.idx));
+
+	if (bpf_jit_enable > 1) {
+		pr_err("flen=%u proglen=%u image=%p\n",
+		       fp->len, 4 * ctx.idx, ctx.target);
+		print_hex_dump(KERN_ERR, "JIT code: ", DUMP_PREFIX_ADDRESS,
+			       16, 4, ctx.target, 4 * ctx.idx, false);
+	}
+
+	fp->bpf_func = (void *)ctx.target;
+out:
+	kfree(ctx.offsets);
+	return;
+}
+
+static void bpf_jit_free_worker(struct work_struct *work)
+{
+	module_free(NULL, work);
+}
+
+/* run from softirq, we must use a work_struct to call
+ * module_free() from process context
+ */
+void bpf_jit_free(struct sk_filter *fp)
+{
+	struct work_struct *work;
+
+	if (fp->bpf_func != sk_run_filter) {
+		work = (struct work_struct *)fp->bpf_func;
+
+		INIT_WORK(work, bpf_jit_free_worker);
+		schedule_work(work);
+	}
+}
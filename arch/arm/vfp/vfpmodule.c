@@ -17,6 +17,7 @@
 #include <linux/sched.h>
 #include <linux/smp.h>
 #include <linux/init.h>
+#include <linux/hardirq.h>
 
 #include <asm/cputype.h>
 #include <asm/thread_notify.h>
@@ -498,6 +499,49 @@ void vfp_flush_hwstate(struct thread_info *thread)
 	put_cpu();
 }
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+
+/*
+ * Kernel-side NEON support functions
+ *
+ * The VFP/NEON registers may hold the state of some thread (not
+ * necessarily current on UP, where restoring is done lazily). Save it to
+ * that thread's vfpstate and forget the owner, so that the next VFP
+ * instruction of any thread traps and reloads its own state. Preemption
+ * stays disabled until kernel_neon_end(), as the registers are not
+ * saved for kernel mode users on a context switch.
+ */
+void kernel_neon_begin(void)
+{
+	unsigned int cpu;
+	u32 fpexc;
+
+	BUG_ON(in_interrupt());
+	cpu = get_cpu();
+
+	fpexc = fmrx(FPEXC) | FPEXC_EN;
+	fmxr(FPEXC, fpexc);
+
+	if (last_VFP_context[cpu]) {
+		vfp_save_state(last_VFP_context[cpu], fpexc);
+#ifdef CONFIG_SMP
+		last_VFP_context[cpu]->hard.cpu = cpu;
+#endif
+		last_VFP_context[cpu] = NULL;
+	}
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	/* Disable the NEON/VFP unit. */
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+
+#endif /* CONFIG_KERNEL_MODE_NEON */
+
 /*
  * VFP hardware can lose all context when a CPU goes offline.
  * As we will be running in SMP mode with CPU hotplug, we will save the
@@ -21,6 +21,8 @@
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/net.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 #include <net/sock.h>
 
 struct skcipher_sg_list {
@@ -499,6 +501,189 @@ unlock:
 }
 
 
+static const struct pipe_buf_operations skcipher_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
+	.confirm = generic_pipe_buf_confirm,
+	.release = generic_pipe_buf_release,
+	.steal = generic_pipe_buf_steal,
+	.get = generic_pipe_buf_get,
+};
+
+/*
+ * Lock @pipe once it has a free slot. The pipe lock is taken before the
+ * socket lock, in the same order as when splicing into a socket.
+ */
+static int skcipher_wait_for_pipe(struct pipe_inode_info *pipe,
+				  unsigned int flags)
+{
+	int err;
+
+	pipe_lock(pipe);
+	for (;;) {
+		if (!pipe->readers) {
+			send_sig(SIGPIPE, current, 0);
+			err = -EPIPE;
+			break;
+		}
+		if (pipe->nrbufs < pipe->buffers)
+			return 0;
+
+		err = -EAGAIN;
+		if (flags & SPLICE_F_NONBLOCK)
+			break;
+		err = -ERESTARTSYS;
+		if (signal_pending(current))
+			break;
+
+		/* Readers wake pipe->wait whenever they free a slot */
+		pipe->waiting_writers++;
+		pipe_unlock(pipe);
+		wait_event_interruptible(pipe->wait,
+					 pipe->nrbufs < pipe->buffers ||
+					 !pipe->readers);
+		pipe_lock(pipe);
+		pipe->waiting_writers--;
+	}
+	pipe_unlock(pipe);
+
+	return err;
+}
+
+/*
+ * Run the cipher straight into freshly allocated pages and hand those to
+ * the pipe, so that the result can be spliced on to a TCP socket without
+ * ever being copied. The pages are whole and page aligned, so every
+ * scatterlist entry is a multiple of the block size, which is what DMA
+ * engines such as s5p-sss require of the destination.
+ *
+ * The pipe stays locked from the moment it is seen to have free slots
+ * until the pages are in them, and no more pages are produced than there
+ * are free slots, so input is only consumed once its output is queued.
+ */
+static ssize_t skcipher_splice_read(struct socket *sock, loff_t *ppos,
+				    struct pipe_inode_info *pipe, size_t len,
+				    unsigned int flags)
+{
+	struct sock *sk = sock->sk;
+	struct alg_sock *ask = alg_sk(sk);
+	struct skcipher_ctx *ctx = ask->private;
+	unsigned bs = crypto_ablkcipher_blocksize(crypto_ablkcipher_reqtfm(
+		&ctx->req));
+	struct page *pages[ALG_MAX_PAGES];
+	struct skcipher_sg_list *sgl;
+	struct scatterlist *sg;
+	unsigned long used;
+	int nr, nr_pages;
+	int err;
+	int i;
+
+again:
+	/* Not with the pipe locked: its writers may be what we wait for */
+	lock_sock(sk);
+	if (!ctx->used) {
+		err = skcipher_wait_for_data(sk, flags & SPLICE_F_NONBLOCK ?
+						 MSG_DONTWAIT : 0);
+		if (err) {
+			release_sock(sk);
+			return err;
+		}
+	}
+	release_sock(sk);
+
+	err = skcipher_wait_for_pipe(pipe, flags);
+	if (err)
+		return err;
+
+	lock_sock(sk);
+	if (!ctx->used) {
+		release_sock(sk);
+		pipe_unlock(pipe);
+		goto again;
+	}
+
+	sgl = list_first_entry(&ctx->tsgl, struct skcipher_sg_list, list);
+	sg = sgl->sg;
+
+	while (!sg->length)
+		sg++;
+
+	nr = min_t(int, pipe->buffers - pipe->nrbufs, ALG_MAX_PAGES);
+	used = min_t(unsigned long, ctx->used, len);
+	used = min_t(unsigned long, used, nr * PAGE_SIZE);
+
+	if (ctx->more || used < ctx->used)
+		used -= used % bs;
+
+	i = 0;
+	err = -EINVAL;
+	if (!used)
+		goto free;
+
+	nr_pages = DIV_ROUND_UP(used, PAGE_SIZE);
+	sg_init_table(ctx->rsgl.sg, nr_pages);
+
+	for (i = 0; i < nr_pages; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		err = -ENOMEM;
+		if (!pages[i])
+			goto free;
+
+		sg_set_page(ctx->rsgl.sg + i, pages[i],
+			    min_t(unsigned long, used - i * PAGE_SIZE,
+				  PAGE_SIZE), 0);
+	}
+
+	ablkcipher_request_set_crypt(&ctx->req, sg, ctx->rsgl.sg, used,
+				     ctx->iv);
+
+	err = af_alg_wait_for_completion(
+		ctx->enc ?
+			crypto_ablkcipher_encrypt(&ctx->req) :
+			crypto_ablkcipher_decrypt(&ctx->req),
+		&ctx->completion);
+	if (err)
+		goto free;
+
+	for (i = 0; i < nr_pages; i++) {
+		int newbuf = (pipe->curbuf + pipe->nrbufs) &
+			     (pipe->buffers - 1);
+		struct pipe_buffer *buf = pipe->bufs + newbuf;
+
+		buf->page = pages[i];
+		buf->offset = 0;
+		buf->len = ctx->rsgl.sg[i].length;
+		buf->private = 0;
+		buf->ops = &skcipher_pipe_buf_ops;
+		buf->flags = flags & SPLICE_F_GIFT ? PIPE_BUF_FLAG_GIFT : 0;
+		pipe->nrbufs++;
+	}
+
+	skcipher_pull_sgl(sk, used);
+	skcipher_wmem_wakeup(sk);
+	release_sock(sk);
+	pipe_unlock(pipe);
+
+	/* As wakeup_pipe_readers() in fs/splice.c */
+	smp_mb();
+	if (waitqueue_active(&pipe->wait))
+		wake_up_interruptible(&pipe->wait);
+	kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
+
+	return used;
+
+free:
+	while (i--)
+		__free_page(pages[i]);
+	skcipher_wmem_wakeup(sk);
+	release_sock(sk);
+	pipe_unlock(pipe);
+
+	return err;
+}
+
+
 static unsigned int skcipher_poll(struct file *file, struct socket *sock,
 				  poll_table *wait)
 {
@@ -538,6 +723,7 @@ static struct proto_ops algif_skcipher_ops = {
 	.sendmsg	=	skcipher_sendmsg,
 	.sendpage	=	skcipher_sendpage,
 	.recvmsg	=	skcipher_recvmsg,
+	.splice_read	=	skcipher_splice_read,
 	.poll		=	skcipher_poll,
 };
 
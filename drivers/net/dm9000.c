@@ -132,6 +132,8 @@ typedef struct board_info {
 	u32		wake_state;
 
 	int		ip_summed;
+
+	struct skb_pool	*rx_pool;	/* recycled receive buffers */
 } board_info_t;
 
 /* debug code */
@@ -462,6 +464,49 @@ static int dm9000_set_settings(struct net_device *dev, struct ethtool_cmd *cmd)
 	return mii_ethtool_sset(&dm->mii, cmd);
 }
 
+static const char dm9000_gstrings_stats[][ETH_GSTRING_LEN] = {
+	"rx_pool_hits",
+	"rx_pool_misses",
+	"rx_pool_recycled",
+	"rx_pool_full",
+	"rx_pool_rejected",
+};
+
+#define DM9000_STATS_LEN ARRAY_SIZE(dm9000_gstrings_stats)
+
+static int dm9000_get_sset_count(struct net_device *dev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return DM9000_STATS_LEN;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void dm9000_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+	if (sset == ETH_SS_STATS)
+		memcpy(data, dm9000_gstrings_stats,
+		       sizeof(dm9000_gstrings_stats));
+}
+
+static void dm9000_get_ethtool_stats(struct net_device *dev,
+				     struct ethtool_stats *stats, u64 *data)
+{
+	board_info_t *dm = to_dm9000_board(dev);
+	struct skb_pool_stats ps = { 0 };
+
+	if (dm->rx_pool)
+		skb_pool_get_stats(dm->rx_pool, &ps);
+
+	data[0] = ps.alloc_hit;
+	data[1] = ps.alloc_miss;
+	data[2] = ps.recycled;
+	data[3] = ps.recycle_full;
+	data[4] = ps.recycle_reject;
+}
+
 static int dm9000_nway_reset(struct net_device *dev)
 {
 	board_info_t *dm = to_dm9000_board(dev);
@@ -614,6 +659,9 @@ static const struct ethtool_ops dm9000_ethtool_ops = {
  	.get_eeprom_len		= dm9000_get_eeprom_len,
  	.get_eeprom		= dm9000_get_eeprom,
  	.set_eeprom		= dm9000_set_eeprom,
+	.get_sset_count		= dm9000_get_sset_count,
+	.get_strings		= dm9000_get_strings,
+	.get_ethtool_stats	= dm9000_get_ethtool_stats,
 };
 
 static void dm9000_show_carrier(board_info_t *db,
@@ -681,6 +729,9 @@ dm9000_release_board(struct platform_device *pdev, struct board_info *db)
 
 	release_resource(db->addr_req);
 	kfree(db->addr_req);
+
+	if (db->rx_pool)
+		skb_pool_destroy(db->rx_pool);
 }
 
 static unsigned char dm9000_type_to_char(enum dm9000_type type)
@@ -1006,8 +1057,16 @@ dm9000_rx(struct net_device *dev)
 		}
 
 		/* Move data from DM9000 */
-		if (GoodPacket &&
-		    ((skb = dev_alloc_skb(RxLen + 4)) != NULL)) {
+		skb = NULL;
+		if (GoodPacket) {
+			if (db->rx_pool && RxLen <= DM9000_PKT_MAX)
+				skb = skb_pool_alloc(db->rx_pool, dev,
+						     GFP_ATOMIC);
+			else
+				skb = dev_alloc_skb(RxLen + 4);
+		}
+
+		if (skb) {
 			skb_reserve(skb, 2);
 			rdptr = (u8 *) skb_put(skb, RxLen - 4);
 
@@ -1530,6 +1589,10 @@ dm9000_probe(struct platform_device *pdev)
 	/* driver system function */
 	ether_setup(ndev);
 
+	/* GRO merges TCP segments only once their checksum has been checked */
+	if (ndev->hw_features & NETIF_F_RXCSUM)
+		ndev->priv_flags |= IFF_RX_BACKLOG_GRO;
+
 	ndev->netdev_ops	= &dm9000_netdev_ops;
 	ndev->watchdog_timeo	= msecs_to_jiffies(watchdog);
 	ndev->ethtool_ops	= &dm9000_ethtool_ops;
@@ -1571,6 +1634,9 @@ dm9000_probe(struct platform_device *pdev)
 	}
 
 
+	/* Not fatal: without it, receive buffers come from dev_alloc_skb() */
+	db->rx_pool = skb_pool_create(DM9000_PKT_MAX + 4, DM9000_RX_POOL_DEPTH);
+
 	platform_set_drvdata(pdev, ndev);
 	ret = register_netdev(ndev);
 
@@ -158,6 +158,7 @@
 #define DM9000_PKT_RDY		0x01	/* Packet ready to receive */
 #define DM9000_PKT_ERR		0x02
 #define DM9000_PKT_MAX		1536	/* Received packet max size */
+#define DM9000_RX_POOL_DEPTH	64	/* Free receive buffers kept per CPU */
 
 /* DM9000A / DM9000B definitions */
 
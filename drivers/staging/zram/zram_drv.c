@@ -23,15 +23,18 @@
 #include <linux/kernel.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
+#include <linux/jhash.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 
 #include "zram_drv.h"
 
@@ -42,14 +45,14 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -71,6 +74,20 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 	zram_stat64_add(zram, v, 1);
 }
 
+/*
+ * Flags of a slot are only modified with its ZRAM_ACCESS bit held, so
+ * the non-atomic updates below cannot race with each other.
+ */
+static void zram_lock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].flags);
+}
+
+static void zram_unlock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].flags);
+}
+
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
@@ -89,6 +106,173 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
+static struct zram_workspace *zram_get_workspace(struct zram *zram)
+{
+	struct zram_workspace *ws;
+
+	ws = per_cpu_ptr(zram->workspace, raw_smp_processor_id());
+	mutex_lock(&ws->lock);
+
+	return ws;
+}
+
+static void zram_put_workspace(struct zram_workspace *ws)
+{
+	mutex_unlock(&ws->lock);
+}
+
+static void zram_free_workspaces(struct zram *zram)
+{
+	int cpu;
+
+	if (!zram->workspace)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_workspace *ws = per_cpu_ptr(zram->workspace, cpu);
+
+		if (ws->tfm)
+			crypto_free_comp(ws->tfm);
+		free_pages((unsigned long)ws->buffer, 1);
+	}
+
+	free_percpu(zram->workspace);
+	zram->workspace = NULL;
+}
+
+static int zram_alloc_workspaces(struct zram *zram)
+{
+	int cpu;
+
+	zram->workspace = alloc_percpu(struct zram_workspace);
+	if (!zram->workspace)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_workspace *ws = per_cpu_ptr(zram->workspace, cpu);
+
+		mutex_init(&ws->lock);
+		ws->tfm = crypto_alloc_comp(zram->compressor, 0, 0);
+		if (IS_ERR(ws->tfm)) {
+			int ret = PTR_ERR(ws->tfm);
+
+			ws->tfm = NULL;
+			zram_free_workspaces(zram);
+			return ret;
+		}
+
+		ws->buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
+		if (!ws->buffer) {
+			zram_free_workspaces(zram);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Look for a stored object identical to the given compressed data and
+ * take a reference on it. Returns NULL if there is none.
+ */
+static struct zram_dedup_entry *zram_dedup_get(struct zram *zram,
+			void *src, size_t clen, u32 checksum)
+{
+	struct hlist_node *pos;
+	struct zram_dedup_entry *entry, *found = NULL;
+	struct hlist_head *head;
+
+	head = &zram->dedup_hash[checksum & (zram->dedup_buckets - 1)];
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(entry, pos, head, node) {
+		void *cmem;
+		int match;
+
+		if (entry->checksum != checksum || entry->size != clen)
+			continue;
+
+		cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+		match = !memcmp(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, entry->handle);
+
+		if (match) {
+			entry->refcount++;
+			found = entry;
+			break;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return found;
+}
+
+static struct zram_dedup_entry *zram_dedup_add(struct zram *zram,
+			unsigned long handle, size_t clen, u32 checksum)
+{
+	struct zram_dedup_entry *entry;
+	struct hlist_head *head;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->checksum = checksum;
+	entry->size = clen;
+	entry->refcount = 1;
+
+	head = &zram->dedup_hash[checksum & (zram->dedup_buckets - 1)];
+
+	spin_lock(&zram->dedup_lock);
+	hlist_add_head(&entry->node, head);
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/* Drop a reference; returns 1 if the object itself was freed */
+static int zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry)
+{
+	int last;
+
+	spin_lock(&zram->dedup_lock);
+	last = !--entry->refcount;
+	if (last)
+		hlist_del(&entry->node);
+	spin_unlock(&zram->dedup_lock);
+
+	if (last) {
+		zs_free(zram->mem_pool, entry->handle);
+		kfree(entry);
+	}
+
+	return last;
+}
+
+/* zsmalloc handle of the object stored in a compressed slot */
+static unsigned long zram_obj_handle(struct zram *zram, u32 index)
+{
+	struct zram_dedup_entry *entry;
+
+	if (!zram_test_flag(zram, index, ZRAM_DEDUP))
+		return zram->table[index].handle;
+
+	entry = (struct zram_dedup_entry *)zram->table[index].handle;
+	return entry->handle;
+}
+
+static void zram_lat_account(unsigned long *hist, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(int, ilog2(us) + 1, ZRAM_LAT_BUCKETS - 1);
+
+	hist[bucket]++;
+}
+
 static int page_zero_filled(void *ptr)
 {
 	unsigned int pos;
@@ -133,15 +317,13 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+/* Caller must hold the slot lock, or otherwise own the whole table */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
-
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	unsigned long handle = zram->table[index].handle;
 
-	if (unlikely(!page)) {
+	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
@@ -155,26 +337,30 @@ static void zram_free_page(struct zram *zram, size_t index)
 
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page((struct page *)handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
+	clen = zram->table[index].size;
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		/* Shared data is only accounted once, with its last user */
+		if (!zram_dedup_put(zram, (struct zram_dedup_entry *)handle))
+			clen = 0;
+	} else {
+		zs_free(zram->mem_pool, handle);
+	}
+	if (zram->table[index].size <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
 out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
 static void handle_zero_page(struct page *page)
@@ -194,12 +380,11 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic((struct page *)zram->table[index].handle, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
@@ -210,27 +395,36 @@ static void zram_read(struct zram *zram, struct bio *bio)
 	int i;
 	u32 index;
 	struct bio_vec *bvec;
+	struct zram_workspace *ws;
 
 	zram_stat64_inc(zram, &zram->stats.num_reads);
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
+	/* Decompression needs a transform, taken before any slot lock */
+	ws = zram_get_workspace(zram);
+
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		size_t clen;
+		unsigned int clen;
+		ktime_t start;
+		unsigned long handle;
 		struct page *page;
-		struct zobj_header *zheader;
 		unsigned char *user_mem, *cmem;
 
 		page = bvec->bv_page;
 
+		zram_lock_slot(zram, index);
+
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+			zram_unlock_slot(zram, index);
 			handle_zero_page(page);
 			index++;
 			continue;
 		}
 
 		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
+		if (unlikely(!zram->table[index].handle)) {
+			zram_unlock_slot(zram, index);
 			pr_debug("Read before write: sector=%lu, size=%u",
 				(ulong)(bio->bi_sector), bio->bi_size);
 			handle_zero_page(page);
@@ -241,26 +435,32 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		/* Page is stored uncompressed since it's incompressible */
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			handle_uncompressed_page(zram, page, index);
+			zram_unlock_slot(zram, index);
 			index++;
 			continue;
 		}
 
+		start = ktime_get();
 		user_mem = kmap_atomic(page, KM_USER0);
 		clen = PAGE_SIZE;
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		handle = zram_obj_handle(zram, index);
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+		ret = crypto_comp_decompress(ws->tfm, cmem,
+			zram->table[index].size, user_mem, &clen);
 
+		zs_unmap_object(zram->mem_pool, handle);
 		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+		zram_unlock_slot(zram, index);
+
+		preempt_disable();
+		zram_lat_account(this_cpu_ptr(zram->lat_hist)->decompress,
+				start);
+		preempt_enable();
 
 		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
+		if (unlikely(ret || clen != PAGE_SIZE)) {
 			pr_err("Decompression failed! err=%d, page=%u\n",
 				ret, index);
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
@@ -271,11 +471,13 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		index++;
 	}
 
+	zram_put_workspace(ws);
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
 	return;
 
 out:
+	zram_put_workspace(ws);
 	bio_io_error(bio);
 }
 
@@ -289,43 +491,57 @@ static void zram_write(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
+		int ret, uncompressed = 0;
+		u32 checksum = 0;
+		unsigned int clen;
+		ktime_t start;
+		unsigned long handle;
+		struct zram_workspace *ws;
+		struct zram_dedup_entry *entry = NULL;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
-
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
 
 		user_mem = kmap_atomic(page, KM_USER0);
 		if (page_zero_filled(user_mem)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
+			/*
+			 * System overwrites unused sectors. Free memory
+			 * associated with this sector now.
+			 */
+			zram_lock_slot(zram, index);
+			zram_free_page(zram, index);
 			zram_set_flag(zram, index, ZRAM_ZERO);
+			zram_unlock_slot(zram, index);
+			zram_stat_inc(&zram->stats.pages_zero);
 			index++;
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		/*
+		 * Compression runs without any device-wide lock: each
+		 * writer uses its own CPU's workspace and only takes the
+		 * slot lock once the new object is ready to be published.
+		 */
+		ws = zram_get_workspace(zram);
+		src = ws->buffer;
 
+		start = ktime_get();
+		user_mem = kmap_atomic(page, KM_USER0);
+		clen = 2 * PAGE_SIZE;
+		ret = crypto_comp_compress(ws->tfm, user_mem, PAGE_SIZE,
+					src, &clen);
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		preempt_disable();
+		zram_lat_account(this_cpu_ptr(zram->lat_hist)->compress,
+				start);
+		preempt_enable();
+
+		if (unlikely(ret)) {
+			zram_put_workspace(ws);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -337,10 +553,12 @@ static void zram_write(struct zram *zram, struct bio *bio)
 		 * errors which has side effect of hanging the system.
 		 */
 		if (unlikely(clen > max_zpage_size)) {
+			zram_put_workspace(ws);
+			uncompressed = 1;
+
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -348,52 +566,78 @@ static void zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
 			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
-
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
-		}
+			cmem = kmap_atomic(page_store, KM_USER1);
+			memcpy(cmem, src, PAGE_SIZE);
+			kunmap_atomic(cmem, KM_USER1);
+			kunmap_atomic(src, KM_USER0);
 
-memstore:
-		zram->table[index].offset = offset;
+			handle = (unsigned long)page_store;
+		} else {
+			if (zram->dedup_hash) {
+				checksum = jhash(src, clen, 0);
+				entry = zram_dedup_get(zram, src, clen,
+						checksum);
+				if (entry) {
+					zram_put_workspace(ws);
+					zram_stat64_inc(zram,
+						&zram->stats.dedup_hits);
+					handle = (unsigned long)entry;
+					goto publish;
+				}
+				zram_stat64_inc(zram,
+					&zram->stats.dedup_misses);
+			}
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+			handle = zs_malloc(zram->mem_pool, clen);
+			if (!handle) {
+				zram_put_workspace(ws);
+				pr_info("Error allocating memory for "
+					"compressed page: %u, size=%u\n",
+					index, clen);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_writes);
+				goto out;
+			}
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+			cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+			memcpy(cmem, src, clen);
+			zs_unmap_object(zram->mem_pool, handle);
+			zram_put_workspace(ws);
+
+			/*
+			 * If the index entry cannot be allocated the page is
+			 * simply stored unshared.
+			 */
+			if (zram->dedup_hash) {
+				entry = zram_dedup_add(zram, handle, clen,
+						checksum);
+				if (entry)
+					handle = (unsigned long)entry;
+			}
 		}
-#endif
 
-		memcpy(cmem, src, clen);
+		zram_stat64_add(zram, &zram->stats.compr_size, clen);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+publish:
+		/* Replace whatever the slot held with the new object */
+		zram_lock_slot(zram, index);
+		zram_free_page(zram, index);
+		zram->table[index].handle = handle;
+		zram->table[index].size = clen;
+		if (uncompressed)
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		else if (entry)
+			zram_set_flag(zram, index, ZRAM_DEDUP);
+		zram_unlock_slot(zram, index);
 
 		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
+		if (uncompressed)
+			zram_stat_inc(&zram->stats.pages_expand);
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
 		index++;
 	}
 
@@ -461,33 +705,23 @@ void zram_reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	zram_free_workspaces(zram);
+	free_percpu(zram->lat_hist);
+	zram->lat_hist = NULL;
 
 	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
-			continue;
-
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
-	}
+	for (index = 0; zram->table &&
+			index < zram->disksize >> PAGE_SHIFT; index++)
+		zram_free_page(zram, index);
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	vfree(zram->dedup_hash);
+	zram->dedup_hash = NULL;
+
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -511,16 +745,15 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
+	ret = zram_alloc_workspaces(zram);
+	if (ret) {
+		pr_err("Error allocating compressor workspaces!\n");
 		goto fail;
 	}
 
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	zram->lat_hist = alloc_percpu(struct zram_lat_hist);
+	if (!zram->lat_hist) {
+		pr_err("Error allocating latency histograms\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -535,12 +768,24 @@ int zram_init_device(struct zram *zram)
 		goto fail;
 	}
 
+	if (zram->dedup) {
+		zram->dedup_buckets = roundup_pow_of_two(
+			max_t(size_t, num_pages >> 3, min_dedup_buckets));
+		zram->dedup_hash = vzalloc(zram->dedup_buckets *
+					sizeof(*zram->dedup_hash));
+		if (!zram->dedup_hash) {
+			pr_err("Error allocating dedup index\n");
+			ret = -ENOMEM;
+			goto fail;
+		}
+	}
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool("zram", GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -566,7 +811,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_lock_slot(zram, index);
 	zram_free_page(zram, index);
+	zram_unlock_slot(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +826,11 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->dedup_lock);
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
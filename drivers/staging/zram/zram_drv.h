@@ -17,8 +17,11 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/crypto.h>
+#include <linux/list.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,23 +29,17 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/* Default compressor, any crypto_comp algorithm can be selected */
+static const char default_compressor[] = "lzo";
+
+/* Smallest dedup hash table, in buckets */
+static const unsigned min_dedup_buckets = 256;
+
 /*
  * Pages that compress to size greater than this are stored
  * uncompressed in memory.
@@ -51,8 +48,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -71,19 +68,45 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Handle points to a (possibly shared) struct zram_dedup_entry */
+	ZRAM_DEDUP,
+
+	/* Slot lock: serializes readers, writers and free notifications */
+	ZRAM_ACCESS,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
+/*
+ * Compression latency histogram buckets. Bucket 'n' counts operations
+ * which took [2^(n-1), 2^n) microseconds; the last bucket is open ended.
+ */
+#define ZRAM_LAT_BUCKETS	16
+
 /*-- Data structures */
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	/* zsmalloc handle, or struct page * for ZRAM_UNCOMPRESSED pages */
+	unsigned long handle;
+	unsigned long flags;	/* zram_pageflags, incl. the slot lock bit */
+	u16 size;	/* object size (excluding header) */
 	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
 } __attribute__((aligned(4)));
 
+/*
+ * Dedup index entry: one compressed object shared by all slots that
+ * stored identical data. Lives in zram->dedup_hash, keyed by a hash of
+ * the compressed data and protected by zram->dedup_lock.
+ */
+struct zram_dedup_entry {
+	struct hlist_node node;
+	unsigned long handle;	/* zsmalloc handle */
+	u32 checksum;
+	u16 size;		/* compressed size */
+	unsigned int refcount;	/* no. of slots pointing here */
+};
+
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
 	u64 num_reads;		/* failed + successful */
@@ -92,20 +115,40 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	u64 num_migrated;	/* objects moved by compaction */
+	u64 dedup_hits;		/* writes which found an identical object */
+	u64 dedup_misses;	/* writes which stored a new object */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+};
+
+/*
+ * Per-CPU compression workspace. Writers normally use the workspace of
+ * the CPU they run on; the mutex only matters when a writer is preempted
+ * or migrated while compressing, so it is practically uncontended.
+ */
+struct zram_workspace {
+	struct mutex lock;
+	struct crypto_comp *tfm;
+	void *buffer;		/* compressed output, two pages */
+};
+
+struct zram_lat_hist {
+	unsigned long compress[ZRAM_LAT_BUCKETS];
+	unsigned long decompress[ZRAM_LAT_BUCKETS];
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zram_workspace __percpu *workspace;
+	struct zram_lat_hist __percpu *lat_hist;
 	struct table *table;
+	struct hlist_head *dedup_hash;
+	unsigned long dedup_buckets;	/* power of 2 */
+	spinlock_t dedup_lock;	/* protects dedup_hash and entries */
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -117,6 +160,14 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 
+	/*
+	 * Both can only be changed under init_lock while the device is
+	 * uninitialized. Init reads them under the same lock; I/O goes by
+	 * what init set up (workspaces, dedup_hash), never by these.
+	 */
+	char compressor[CRYPTO_MAX_ALG_NAME];
+	int dedup;
+
 	struct zram_stats stats;
 };
 
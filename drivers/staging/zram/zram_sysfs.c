@@ -14,7 +14,10 @@
 
 #include <linux/device.h>
 #include <linux/genhd.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/stddef.h>
 
 #include "zram_drv.h"
 
@@ -72,6 +75,76 @@ static ssize_t disksize_store(struct device *dev,
 	return len;
 }
 
+static ssize_t compressor_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t ret;
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	ret = sprintf(buf, "%s\n", zram->compressor);
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t compressor_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char name[CRYPTO_MAX_ALG_NAME];
+	struct zram *zram = dev_to_zram(dev);
+
+	strlcpy(name, buf, sizeof(name));
+	strim(name);
+
+	if (!crypto_has_comp(name, 0, 0)) {
+		pr_info("Unknown compressor: %s\n", name);
+		return -EINVAL;
+	}
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		pr_info("Cannot change compressor for initialized device\n");
+		return -EBUSY;
+	}
+	strlcpy(zram->compressor, name, sizeof(zram->compressor));
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%d\n", zram->dedup);
+}
+
+static ssize_t dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long val;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = strict_strtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		pr_info("Cannot change dedup for initialized device\n");
+		return -EBUSY;
+	}
+	zram->dedup = !!val;
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
 static ssize_t initstate_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -148,12 +221,30 @@ static ssize_t notify_free_show(struct device *dev,
 		zram_stat64_read(zram, &zram->stats.notify_free));
 }
 
+static ssize_t dedup_hits_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.dedup_hits));
+}
+
+static ssize_t dedup_misses_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.dedup_misses));
+}
+
 static ssize_t zero_pages_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
 	struct zram *zram = dev_to_zram(dev);
 
-	return sprintf(buf, "%u\n", zram->stats.pages_zero);
+	return sprintf(buf, "%u\n", atomic_read(&zram->stats.pages_zero));
 }
 
 static ssize_t orig_data_size_show(struct device *dev,
@@ -162,7 +253,7 @@ static ssize_t orig_data_size_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 
 	return sprintf(buf, "%llu\n",
-		(u64)(zram->stats.pages_stored) << PAGE_SHIFT);
+		(u64)atomic_read(&zram->stats.pages_stored) << PAGE_SHIFT);
 }
 
 static ssize_t compr_data_size_show(struct device *dev,
@@ -181,38 +272,158 @@ static ssize_t mem_used_total_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 
 	if (zram->init_done) {
-		val = xv_get_total_size_bytes(zram->mem_pool) +
-			((u64)(zram->stats.pages_expand) << PAGE_SHIFT);
+		val = zs_get_total_size_bytes(zram->mem_pool) +
+			((u64)atomic_read(&zram->stats.pages_expand) << PAGE_SHIFT);
 	}
 
 	return sprintf(buf, "%llu\n", val);
 }
 
+/*
+ * Percentage of pool memory which is not in object slots holding live
+ * objects: free slots in partially used zspages plus the tail of each
+ * zspage too short for another slot. Slots in use count in full, so the
+ * space lost to rounding up to a size class is not included. Free slots
+ * can be reclaimed by writing to 'compact'.
+ */
+static ssize_t mem_fragmentation_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	u64 total, val = 0;
+	struct zs_pool_stats stats;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (zram->init_done) {
+		zs_get_pool_stats(zram->mem_pool, &stats);
+		total = stats.pages_allocated << PAGE_SHIFT;
+		if (total)
+			val = div64_u64((total - stats.obj_used) * 100, total);
+	}
+
+	return sprintf(buf, "%llu\n", val);
+}
+
+static ssize_t num_migrated_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.num_migrated));
+}
+
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	unsigned long migrated;
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	migrated = zs_compact(zram->mem_pool);
+	spin_lock(&zram->stat64_lock);
+	zram->stats.num_migrated += migrated;
+	spin_unlock(&zram->stat64_lock);
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+/*
+ * One line per possible CPU, each holding ZRAM_LAT_BUCKETS counters.
+ * Bucket 0 counts operations below 1us, bucket n (n > 0) counts those
+ * in [2^(n-1), 2^n) us and the last bucket collects everything slower.
+ */
+static ssize_t zram_lat_hist_show(struct zram *zram, char *buf,
+		size_t field)
+{
+	int cpu, i;
+	ssize_t len = 0;
+
+	/* Reset frees the histograms under init_lock */
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		return 0;
+	}
+
+	for_each_possible_cpu(cpu) {
+		unsigned long *hist = (void *)per_cpu_ptr(zram->lat_hist, cpu) +
+					field;
+
+		len += scnprintf(buf + len, PAGE_SIZE - len, "cpu%d:", cpu);
+		for (i = 0; i < ZRAM_LAT_BUCKETS; i++)
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %lu",
+					hist[i]);
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t compr_latency_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return zram_lat_hist_show(dev_to_zram(dev), buf,
+			offsetof(struct zram_lat_hist, compress));
+}
+
+static ssize_t decompr_latency_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return zram_lat_hist_show(dev_to_zram(dev), buf,
+			offsetof(struct zram_lat_hist, decompress));
+}
+
 static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR,
 		disksize_show, disksize_store);
+static DEVICE_ATTR(compressor, S_IRUGO | S_IWUSR,
+		compressor_show, compressor_store);
+static DEVICE_ATTR(dedup, S_IRUGO | S_IWUSR, dedup_show, dedup_store);
 static DEVICE_ATTR(initstate, S_IRUGO, initstate_show, NULL);
 static DEVICE_ATTR(reset, S_IWUSR, NULL, reset_store);
 static DEVICE_ATTR(num_reads, S_IRUGO, num_reads_show, NULL);
 static DEVICE_ATTR(num_writes, S_IRUGO, num_writes_show, NULL);
 static DEVICE_ATTR(invalid_io, S_IRUGO, invalid_io_show, NULL);
 static DEVICE_ATTR(notify_free, S_IRUGO, notify_free_show, NULL);
+static DEVICE_ATTR(dedup_hits, S_IRUGO, dedup_hits_show, NULL);
+static DEVICE_ATTR(dedup_misses, S_IRUGO, dedup_misses_show, NULL);
 static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
 static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
 static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
 static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+static DEVICE_ATTR(mem_fragmentation, S_IRUGO, mem_fragmentation_show, NULL);
+static DEVICE_ATTR(num_migrated, S_IRUGO, num_migrated_show, NULL);
+static DEVICE_ATTR(compact, S_IWUSR, NULL, compact_store);
+static DEVICE_ATTR(compr_latency, S_IRUGO, compr_latency_show, NULL);
+static DEVICE_ATTR(decompr_latency, S_IRUGO, decompr_latency_show, NULL);
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
+	&dev_attr_compressor.attr,
+	&dev_attr_dedup.attr,
 	&dev_attr_initstate.attr,
 	&dev_attr_reset.attr,
 	&dev_attr_num_reads.attr,
 	&dev_attr_num_writes.attr,
 	&dev_attr_invalid_io.attr,
 	&dev_attr_notify_free.attr,
+	&dev_attr_dedup_hits.attr,
+	&dev_attr_dedup_misses.attr,
 	&dev_attr_zero_pages.attr,
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
+	&dev_attr_mem_fragmentation.attr,
+	&dev_attr_num_migrated.attr,
+	&dev_attr_compact.attr,
+	&dev_attr_compr_latency.attr,
+	&dev_attr_decompr_latency.attr,
 	NULL,
 };
 
@@ -0,0 +1,716 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * zsmalloc is a size-class allocator for compressed objects:
+ *
+ *  - Objects of similar size share a size class. A class allocates
+ *    "zspages" of one to four (possibly highmem) pages, chosen so that
+ *    the slots pack the pages with the least wasted space, and objects
+ *    are allowed to span page boundaries inside a zspage.
+ *  - Users get an opaque handle and must zs_map_object() it to access
+ *    the data. Objects spanning two pages are copied through a per-CPU
+ *    buffer, all others are simply kmap'ed.
+ *  - Since handles are indirect, zs_compact() can migrate objects out of
+ *    sparsely used zspages and release them.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *zs_handle_cachep;
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Pick the number of pages per zspage that leaves the least space
+ * unused at the end of the zspage for the given slot size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size, waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max_objects = zspage->class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max_objects)
+		return ZS_FULL;
+	if (inuse * ZS_ALMOST_FULL_DIV >= max_objects * ZS_ALMOST_FULL_FRAC)
+		return ZS_ALMOST_FULL;
+
+	return ZS_ALMOST_EMPTY;
+}
+
+/*
+ * Move the zspage to the list matching its current fullness. Empty
+ * zspages are left alone; the caller frees them.
+ */
+static void fix_fullness_group(struct zspage *zspage)
+{
+	enum fullness_group newfg = get_fullness_group(zspage);
+
+	if (newfg == zspage->fullness || newfg == ZS_EMPTY)
+		return;
+
+	list_move(&zspage->list, &zspage->class->fullness_list[newfg]);
+	zspage->fullness = newfg;
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	struct list_head *head;
+
+	head = &class->fullness_list[ZS_ALMOST_FULL];
+	if (list_empty(head))
+		head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (list_empty(head))
+		return NULL;
+
+	return list_first_entry(head, struct zspage, list);
+}
+
+/* Locate slot 'obj_idx' of a zspage: page index and offset in that page */
+static void obj_location(struct zspage *zspage, unsigned int obj_idx,
+			unsigned int *page_idx, unsigned int *offset)
+{
+	unsigned long off = (unsigned long)obj_idx * zspage->class->size;
+
+	*page_idx = off >> PAGE_SHIFT;
+	*offset = off & ~PAGE_MASK;
+}
+
+static struct zs_handle *obj_get_handle(struct zspage *zspage,
+			unsigned int obj_idx)
+{
+	unsigned int page_idx, offset;
+	unsigned long *head;
+	struct zs_handle *handle;
+
+	obj_location(zspage, obj_idx, &page_idx, &offset);
+	head = kmap_atomic(zspage->pages[page_idx], KM_USER0) + offset;
+	handle = (struct zs_handle *)*head;
+	kunmap_atomic(head, KM_USER0);
+
+	return handle;
+}
+
+static void obj_set_handle(struct zspage *zspage, unsigned int obj_idx,
+			struct zs_handle *handle)
+{
+	unsigned int page_idx, offset;
+	unsigned long *head;
+
+	obj_location(zspage, obj_idx, &page_idx, &offset);
+	head = kmap_atomic(zspage->pages[page_idx], KM_USER0) + offset;
+	*head = (unsigned long)handle;
+	kunmap_atomic(head, KM_USER0);
+}
+
+/* Called with class->lock held */
+static unsigned int obj_alloc(struct zspage *zspage, struct zs_handle *handle)
+{
+	unsigned int obj_idx;
+
+	obj_idx = find_first_zero_bit(zspage->used,
+				zspage->class->objs_per_zspage);
+	BUG_ON(obj_idx >= zspage->class->objs_per_zspage);
+
+	__set_bit(obj_idx, zspage->used);
+	zspage->inuse++;
+	obj_set_handle(zspage, obj_idx, handle);
+
+	return obj_idx;
+}
+
+/* Called with class->lock held */
+static void obj_free(struct zspage *zspage, unsigned int obj_idx)
+{
+	BUG_ON(!test_bit(obj_idx, zspage->used));
+
+	__clear_bit(obj_idx, zspage->used);
+	zspage->inuse--;
+}
+
+/*
+ * Copy a whole slot between two zspages of the same class. Either slot
+ * may span a page boundary, so copy in chunks that stay within a single
+ * page on both sides.
+ */
+static void obj_copy(struct zspage *dst, unsigned int dst_idx,
+			struct zspage *src, unsigned int src_idx)
+{
+	unsigned int size = src->class->size;
+	unsigned int s_page, s_off, d_page, d_off;
+
+	obj_location(src, src_idx, &s_page, &s_off);
+	obj_location(dst, dst_idx, &d_page, &d_off);
+
+	while (size) {
+		unsigned int len;
+		char *s_addr, *d_addr;
+
+		len = min3(size, (unsigned int)PAGE_SIZE - s_off,
+				(unsigned int)PAGE_SIZE - d_off);
+
+		s_addr = kmap_atomic(src->pages[s_page], KM_USER0);
+		d_addr = kmap_atomic(dst->pages[d_page], KM_USER1);
+		memcpy(d_addr + d_off, s_addr + s_off, len);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		size -= len;
+		s_off += len;
+		d_off += len;
+		if (s_off == PAGE_SIZE) {
+			s_page++;
+			s_off = 0;
+		}
+		if (d_off == PAGE_SIZE) {
+			d_page++;
+			d_off = 0;
+		}
+	}
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	unsigned int i, nr_pages = zspage->class->pages_per_zspage;
+
+	for (i = 0; i < nr_pages; i++)
+		__free_page(zspage->pages[i]);
+
+	atomic_long_sub(nr_pages, &pool->pages_allocated);
+	kfree(zspage);
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+			struct size_class *class)
+{
+	unsigned int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), pool->flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	zspage->class = class;
+	zspage->fullness = ZS_ALMOST_EMPTY;
+	INIT_LIST_HEAD(&zspage->list);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(pool->flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+static void zs_pin_handle(struct zs_handle *handle)
+{
+	bit_spin_lock(ZS_HANDLE_PIN, &handle->flags);
+}
+
+static int zs_trypin_handle(struct zs_handle *handle)
+{
+	return bit_spin_trylock(ZS_HANDLE_PIN, &handle->flags);
+}
+
+static void zs_unpin_handle(struct zs_handle *handle)
+{
+	bit_spin_unlock(ZS_HANDLE_PIN, &handle->flags);
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool to be created
+ * @flags: allocation flags used when growing pool
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	int i, fg;
+	struct zs_pool *pool;
+
+	BUILD_BUG_ON(ZS_HANDLE_SIZE > ZS_ALIGN);
+	BUILD_BUG_ON(ZS_MIN_ALLOC_SIZE % ZS_ALIGN);
+	BUILD_BUG_ON(ZS_SIZE_CLASS_DELTA % ZS_ALIGN);
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / class->size;
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->flags = flags;
+	pool->name = name;
+	atomic_long_set(&pool->pages_allocated, 0);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, fg;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			struct zspage *zspage, *tmp;
+
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				pr_info("Freeing non-empty class: %u\n",
+					class->size);
+				list_del(&zspage->list);
+				free_zspage(pool, zspage);
+			}
+		}
+	}
+
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	handle = kmem_cache_alloc(zs_handle_cachep,
+				pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(zs_handle_cachep, handle);
+			return 0;
+		}
+
+		spin_lock(&class->lock);
+		list_add(&zspage->list,
+			&class->fullness_list[zspage->fullness]);
+		class->zspages++;
+	}
+
+	handle->flags = 0;
+	handle->zspage = zspage;
+	handle->obj_idx = obj_alloc(zspage, handle);
+	class->objs_inuse++;
+	fix_fullness_group(zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class;
+	struct zspage *zspage;
+	int empty = 0;
+
+	if (unlikely(!handle))
+		return;
+
+	/* Keep compaction from moving the object under us */
+	zs_pin_handle(handle);
+	zspage = handle->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(zspage, handle->obj_idx);
+	class->objs_inuse--;
+	if (!zspage->inuse) {
+		list_del(&zspage->list);
+		class->zspages--;
+		empty = 1;
+	} else {
+		fix_fullness_group(zspage);
+	}
+	spin_unlock(&class->lock);
+	zs_unpin_handle(handle);
+
+	kmem_cache_free(zs_handle_cachep, handle);
+	if (empty)
+		free_zspage(pool, zspage);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: mapping mode to use
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped
+ * using this function. When done with the object, it must be unmapped
+ * using zs_unmap_object.
+ *
+ * Only one object can be mapped per cpu at a time. The mapping runs in
+ * atomic context, so the caller must not sleep until it is unmapped.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long obj,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct mapping_area *area;
+	struct zspage *zspage;
+	unsigned int page_idx, offset, size;
+	char *addr;
+
+	BUG_ON(!handle);
+
+	/* Disables preemption, so the per-cpu area is ours until unmap */
+	zs_pin_handle(handle);
+	zspage = handle->zspage;
+	size = zspage->class->size;
+	obj_location(zspage, handle->obj_idx, &page_idx, &offset);
+
+	area = &__get_cpu_var(zs_map_area);
+	area->mode = mm;
+	area->offset = offset;
+	area->pages[0] = zspage->pages[page_idx];
+
+	if (offset + size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vaddr = kmap_atomic(area->pages[0], KM_USER1);
+		return area->vaddr + offset + ZS_HANDLE_SIZE;
+	}
+
+	/* this object spans two pages */
+	area->vaddr = NULL;
+	area->pages[1] = zspage->pages[page_idx + 1];
+	if (mm != ZS_MM_WO) {
+		unsigned int first = PAGE_SIZE - offset;
+
+		addr = kmap_atomic(area->pages[0], KM_USER1);
+		memcpy(area->buf, addr + offset, first);
+		kunmap_atomic(addr, KM_USER1);
+
+		addr = kmap_atomic(area->pages[1], KM_USER1);
+		memcpy(area->buf + first, addr, size - first);
+		kunmap_atomic(addr, KM_USER1);
+	}
+
+	return area->buf + ZS_HANDLE_SIZE;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct mapping_area *area;
+	unsigned int size;
+	char *addr;
+
+	BUG_ON(!handle);
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vaddr) {
+		kunmap_atomic(area->vaddr, KM_USER1);
+		goto out;
+	}
+
+	if (area->mode != ZS_MM_RO) {
+		unsigned int first = PAGE_SIZE - area->offset;
+
+		size = handle->zspage->class->size;
+
+		/* The slot header (handle back-pointer) is never changed */
+		addr = kmap_atomic(area->pages[0], KM_USER1);
+		memcpy(addr + area->offset + ZS_HANDLE_SIZE,
+			area->buf + ZS_HANDLE_SIZE, first - ZS_HANDLE_SIZE);
+		kunmap_atomic(addr, KM_USER1);
+
+		addr = kmap_atomic(area->pages[1], KM_USER1);
+		memcpy(addr, area->buf + first, size - first);
+		kunmap_atomic(addr, KM_USER1);
+	}
+
+out:
+	zs_unpin_handle(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Pick the zspage to fill while draining 'src': the fullest zspage
+ * that still has free slots.
+ */
+static struct zspage *find_dst_zspage(struct size_class *class)
+{
+	return find_get_zspage(class);
+}
+
+/*
+ * Empty as many sparsely used zspages of a class as possible by moving
+ * their objects into other zspages of the same class. Objects that are
+ * currently mapped (pinned) are skipped.
+ */
+static unsigned long zs_compact_class(struct zs_pool *pool,
+			struct size_class *class)
+{
+	unsigned long migrated = 0;
+	struct zspage *src, *dst;
+
+	spin_lock(&class->lock);
+	for (;;) {
+		struct list_head *head = &class->fullness_list[ZS_ALMOST_EMPTY];
+		unsigned int obj_idx;
+		int skipped = 0;
+
+		/* Only bother if at least one zspage could be released */
+		if (class->zspages * class->objs_per_zspage -
+				class->objs_inuse < class->objs_per_zspage)
+			break;
+		if (list_empty(head))
+			break;
+
+		/*
+		 * Zspages are added at the head, so this is the one that has
+		 * been almost empty the longest, not necessarily the emptiest.
+		 * Searching for the emptiest would walk the list every round.
+		 */
+		src = list_entry(head->prev, struct zspage, list);
+		list_del_init(&src->list);
+
+		for_each_set_bit(obj_idx, src->used, class->objs_per_zspage) {
+			struct zs_handle *handle;
+
+			dst = find_dst_zspage(class);
+			if (!dst)
+				break;
+
+			handle = obj_get_handle(src, obj_idx);
+			if (!zs_trypin_handle(handle)) {
+				skipped++;
+				continue;
+			}
+
+			handle->obj_idx = obj_alloc(dst, handle);
+			obj_copy(dst, handle->obj_idx, src, obj_idx);
+			handle->zspage = dst;
+			obj_free(src, obj_idx);
+			zs_unpin_handle(handle);
+
+			fix_fullness_group(dst);
+			migrated++;
+		}
+
+		if (!src->inuse) {
+			class->zspages--;
+			spin_unlock(&class->lock);
+			free_zspage(pool, src);
+			cond_resched();
+			spin_lock(&class->lock);
+			continue;
+		}
+
+		/* Could not drain it: put it back and stop here */
+		src->fullness = get_fullness_group(src);
+		list_add(&src->list, &class->fullness_list[src->fullness]);
+		if (skipped || !find_dst_zspage(class))
+			break;
+	}
+	class->objs_migrated += migrated;
+	spin_unlock(&class->lock);
+
+	return migrated;
+}
+
+/**
+ * zs_compact - Migrate objects to release sparsely used zspages.
+ * @pool: pool to compact
+ *
+ * Returns the number of objects moved. May sleep.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long migrated = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		migrated += zs_compact_class(pool, &pool->size_class[i]);
+		cond_resched();
+	}
+
+	return migrated;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+void zs_get_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->pages_allocated = atomic_long_read(&pool->pages_allocated);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		stats->obj_capacity += (u64)class->zspages *
+				class->objs_per_zspage * class->size;
+		stats->obj_used += (u64)class->objs_inuse * class->size;
+		stats->objs_migrated += class->objs_migrated;
+		spin_unlock(&class->lock);
+	}
+}
+EXPORT_SYMBOL_GPL(zs_get_pool_stats);
+
+static void zs_free_map_areas(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		free_page((unsigned long)area->buf);
+		area->buf = NULL;
+	}
+}
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	zs_handle_cachep = kmem_cache_create("zs_handle",
+				sizeof(struct zs_handle), 0, 0, NULL);
+	if (!zs_handle_cachep)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->buf = (char *)__get_free_page(GFP_KERNEL);
+		if (!area->buf) {
+			zs_free_map_areas();
+			kmem_cache_destroy(zs_handle_cachep);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void __exit zs_exit(void)
+{
+	zs_free_map_areas();
+	kmem_cache_destroy(zs_handle_cachep);
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("Nitin Gupta <ngupta@vflare.org>");
+MODULE_DESCRIPTION("Size-class allocator for compressed objects");
@@ -0,0 +1,126 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/*
+ * A zspage is a group of up to ZS_MAX_PAGES_PER_ZSPAGE (possibly highmem)
+ * pages treated as one contiguous range of equally sized object slots.
+ * Slots are not bounded by page boundaries: an object may start in one
+ * page and end in the next, which is what keeps internal fragmentation
+ * low for sizes that do not divide PAGE_SIZE.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/*
+ * Every slot starts with a back-pointer to the handle that owns it so
+ * that compaction can find and update the handle when it moves an object.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
+/* Both must be multiples of ZS_ALIGN so headers never span pages */
+#define ZS_ALIGN		8
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are separated by ZS_SIZE_CLASS_DELTA bytes: 16 for 4k
+ * pages. Every request is rounded up to the nearest class size.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+#define ZS_MAX_OBJS_PER_ZSPAGE	(ZS_MAX_PAGES_PER_ZSPAGE * PAGE_SIZE / \
+					ZS_MIN_ALLOC_SIZE)
+
+/*
+ * A zspage is "almost full" once at least 3/4 of its slots are used.
+ * Allocation prefers almost full zspages; compaction empties almost
+ * empty ones into them.
+ */
+#define ZS_ALMOST_FULL_FRAC	3
+#define ZS_ALMOST_FULL_DIV	4
+
+enum fullness_group {
+	ZS_FULL,
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY
+};
+
+/* Bit in zs_handle->flags held while an object is mapped or migrated */
+enum zs_handle_flags {
+	ZS_HANDLE_PIN,
+};
+
+struct size_class;
+
+struct zspage {
+	struct list_head list;		/* in class->fullness_list[] */
+	struct size_class *class;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	unsigned int inuse;		/* no. of used slots */
+	enum fullness_group fullness;
+	unsigned long used[BITS_TO_LONGS(ZS_MAX_OBJS_PER_ZSPAGE)];
+};
+
+/*
+ * Handles returned by zs_malloc() point to one of these. The indirection
+ * is what allows objects to be relocated without telling the user.
+ */
+struct zs_handle {
+	struct zspage *zspage;
+	unsigned long flags;
+	unsigned int obj_idx;
+};
+
+struct size_class {
+	spinlock_t lock;
+	unsigned int size;		/* slot size, incl. ZS_HANDLE_SIZE */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+
+	/* stats, protected by lock */
+	unsigned long zspages;
+	unsigned long objs_inuse;
+	u64 objs_migrated;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+	gfp_t flags;		/* allocation flags for backing pages */
+	const char *name;
+	atomic_long_t pages_allocated;
+};
+
+/*
+ * Per-CPU state for zs_map_object(). Objects spanning two pages are
+ * copied into buf; everything else is returned via kmap_atomic().
+ */
+struct mapping_area {
+	char *buf;
+	char *vaddr;		/* kmap'ed page, NULL when buf is used */
+	struct page *pages[2];
+	unsigned int offset;	/* slot offset in pages[0] */
+	enum zs_mapmode mode;
+};
+
+#endif
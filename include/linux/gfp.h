@@ -300,6 +300,39 @@ __alloc_pages(gfp_t gfp_mask, unsigned int order,
 	return __alloc_pages_nodemask(gfp_mask, order, zonelist, NULL);
 }
 
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+			nodemask_t *nodemask, unsigned long nr_pages,
+			struct list_head *page_list, struct page **page_array);
+
+/* Up to nr_pages order-0 pages onto list: see __alloc_pages_bulk() */
+static inline unsigned long
+alloc_pages_bulk_list(gfp_t gfp_mask, unsigned long nr_pages,
+		struct list_head *list)
+{
+	return __alloc_pages_bulk(gfp_mask,
+			node_zonelist(numa_node_id(), gfp_mask), NULL,
+			nr_pages, list, NULL);
+}
+
+/* Fill the NULL entries of page_array[nr_pages], on node nid if >= 0 */
+static inline unsigned long
+alloc_pages_bulk_array_node(gfp_t gfp_mask, int nid, unsigned long nr_pages,
+		struct page **page_array)
+{
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_pages_bulk(gfp_mask, node_zonelist(nid, gfp_mask), NULL,
+			nr_pages, NULL, page_array);
+}
+
+static inline unsigned long
+alloc_pages_bulk_array(gfp_t gfp_mask, unsigned long nr_pages,
+		struct page **page_array)
+{
+	return alloc_pages_bulk_array_node(gfp_mask, -1, nr_pages, page_array);
+}
+
 static inline struct page *alloc_pages_node(int nid, gfp_t gfp_mask,
 						unsigned int order)
 {
@@ -372,4 +405,16 @@ extern gfp_t gfp_allowed_mask;
 extern void pm_restrict_gfp_mask(void);
 extern void pm_restore_gfp_mask(void);
 
+#ifdef CONFIG_CMA
+
+/* The below functions must be run on a range from a single zone. */
+extern int alloc_contig_range(unsigned long start, unsigned long end,
+			      unsigned migratetype);
+extern void free_contig_range(unsigned long pfn, unsigned nr_pages);
+
+/* CMA stuff */
+extern void init_cma_reserved_pageblock(struct page *page);
+
+#endif
+
 #endif /* __LINUX_GFP_H */
@@ -101,4 +101,44 @@ static inline enum lru_list page_lru(struct page *page)
 	return lru;
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * In the lru_gen reclaim mode the age of a page on the LRU lists is kept
+ * in page->flags: 0 once a page table walk has found it accessed, then
+ * one more for every pass of reclaim that finds it idle, up to
+ * LRU_GEN_OLDEST.  Pages enter the LRU lists as generation 1.
+ */
+#define LRU_GEN_OLDEST		((int)LRU_GEN_MASK)
+
+static inline int page_lru_gen(struct page *page)
+{
+	return (page->flags >> LRU_GEN_PGSHIFT) & LRU_GEN_MASK;
+}
+
+/* The other flags of a page on the LRU change under us: update atomically */
+static inline void set_page_lru_gen(struct page *page, int gen)
+{
+	unsigned long old, new;
+
+	do {
+		old = ACCESS_ONCE(page->flags);
+		new = (old & ~(LRU_GEN_MASK << LRU_GEN_PGSHIFT)) |
+		      ((unsigned long)gen << LRU_GEN_PGSHIFT);
+		if (new == old)
+			break;
+	} while (cmpxchg(&page->flags, old, new) != old);
+}
+#else
+#define LRU_GEN_OLDEST		0
+
+static inline int page_lru_gen(struct page *page)
+{
+	return 0;
+}
+
+static inline void set_page_lru_gen(struct page *page, int gen)
+{
+}
+#endif
+
 #endif
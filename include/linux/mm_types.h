@@ -184,6 +184,10 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SWAP
+	/* Last swap fault address, readahead window and hits, packed */
+	atomic_long_t swap_readahead_info;
+#endif
 };
 
 struct core_thread {
@@ -243,6 +247,12 @@ struct mm_struct {
 						 * together off init_mm.mmlist, and are protected
 						 * by mmlist_lock
 						 */
+#ifdef CONFIG_LRU_GEN
+	struct list_head lru_gen_list;		/* mms whose page tables reclaim
+						 * walks to age pages, see
+						 * lru_gen_age() in mm/vmscan.c
+						 */
+#endif
 
 
 	unsigned long hiwater_rss;	/* High-watermark of RSS usage */
@@ -1753,6 +1753,8 @@ struct softnet_data {
 
 #ifdef CONFIG_RPS
 	struct softnet_data	*rps_ipi_list;
+	/* Backlog GRO output, already steered, must not be steered again */
+	bool			in_backlog_gro;
 
 	/* Elements below can be accessed between CPUs for RPS */
 	struct call_single_data	csd ____cacheline_aligned_in_smp;
@@ -301,6 +301,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@tail: Tail pointer
  *	@end: End pointer
  *	@destructor: Destruct function
+ *	@pool: Receive buffer pool the skb returns to when freed, if any
  *	@mark: Generic packet mark
  *	@nfct: Associated connection, if any
  *	@ipvs_property: skbuff is owned by ipvs
@@ -371,6 +372,7 @@ struct sk_buff {
 	__be16			protocol;
 
 	void			(*destructor)(struct sk_buff *skb);
+	struct skb_pool		*pool;
 #if defined(CONFIG_NF_CONNTRACK) || defined(CONFIG_NF_CONNTRACK_MODULE)
 	struct nf_conntrack	*nfct;
 #endif
@@ -506,6 +508,31 @@ static inline struct sk_buff *alloc_skb_fclone(unsigned int size,
 
 extern bool skb_recycle_check(struct sk_buff *skb, int skb_size);
 
+/**
+ *	struct skb_pool_stats - receive buffer pool counters
+ *	@alloc_hit: allocations served from the pool
+ *	@alloc_miss: allocations that fell back to the slab allocator
+ *	@recycled: freed buffers taken back into the pool
+ *	@recycle_full: freed buffers released because the pool was full
+ *	@recycle_reject: freed buffers released because their data was
+ *		shared or no longer linear
+ */
+struct skb_pool_stats {
+	unsigned long	alloc_hit;
+	unsigned long	alloc_miss;
+	unsigned long	recycled;
+	unsigned long	recycle_full;
+	unsigned long	recycle_reject;
+};
+
+extern struct skb_pool *skb_pool_create(unsigned int size,
+					unsigned int depth);
+extern void skb_pool_destroy(struct skb_pool *pool);
+extern struct sk_buff *skb_pool_alloc(struct skb_pool *pool,
+				      struct net_device *dev, gfp_t gfp_mask);
+extern void skb_pool_get_stats(struct skb_pool *pool,
+			       struct skb_pool_stats *stats);
+
 extern struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src);
 extern struct sk_buff *skb_clone(struct sk_buff *skb,
 				 gfp_t priority);
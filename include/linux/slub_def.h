@@ -35,6 +35,33 @@ enum stat_item {
 	CMPXCHG_DOUBLE_CPU_FAIL,/* Failure of this_cpu_cmpxchg_double */
 	NR_SLUB_STAT_ITEMS };
 
+#ifdef CONFIG_SLUB_MAGAZINE
+enum mag_stat_item {
+	MAG_ALLOC_HIT,		/* Allocation from the magazine */
+	MAG_ALLOC_MISS,		/* Magazine empty: allocated from the slab */
+	MAG_FREE_HIT,		/* Free into the magazine */
+	MAG_FREE_MISS,		/* Magazine full: half of it freed to slabs */
+	NR_MAG_STAT_ITEMS };
+
+#define SLUB_MAG_MIN	4
+#define SLUB_MAG_MAX	32
+
+/*
+ * A stack of free objects kept per cpu in front of the cpu slab, so that
+ * objects freed by this cpu are handed straight back out, whichever slab
+ * they came from.  Its depth adapts to the rate of use.
+ */
+struct kmem_cache_mag {
+	unsigned int count;	/* Objects held */
+	unsigned int depth;	/* Objects it may hold */
+	unsigned int ops;	/* Operations in this tuning window */
+	unsigned int misses;	/* ... of which missed */
+	unsigned long stamp;	/* jiffies at the start of the window */
+	unsigned long stat[NR_MAG_STAT_ITEMS];
+	void *objects[SLUB_MAG_MAX];
+};
+#endif
+
 struct kmem_cache_cpu {
 	void **freelist;	/* Pointer to next available object */
 	unsigned long tid;	/* Globally unique transaction id */
@@ -43,6 +70,9 @@ struct kmem_cache_cpu {
 #ifdef CONFIG_SLUB_STATS
 	unsigned stat[NR_SLUB_STAT_ITEMS];
 #endif
+#ifdef CONFIG_SLUB_MAGAZINE
+	struct kmem_cache_mag mag;
+#endif
 };
 
 struct kmem_cache_node {
@@ -460,6 +460,11 @@ struct tcp_sock {
 	 * contains related tcp_cookie_transactions fields.
 	 */
 	struct tcp_cookie_values  *cookie_values;
+
+	/* Loopback peer that data is queued to directly, holding a
+	 * reference, see tcp_friend_sendmsg().
+	 */
+	struct sock		*friend;
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
@@ -81,6 +81,14 @@ struct udp_sock {
 	 * For encapsulation sockets.
 	 */
 	int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
+	/*
+	 * Route of the last unconnected send in a sendmmsg() batch, with
+	 * the flow it was looked up for and the one it resolved to.
+	 * Protected by sk_dst_lock.
+	 */
+	struct rtable	*batch_rt;
+	struct flowi4	 batch_key;
+	struct flowi4	 batch_fl4;
 };
 
 static inline struct udp_sock *udp_sk(const struct sock *sk)
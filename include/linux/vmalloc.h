@@ -117,6 +117,21 @@ unmap_kernel_range(unsigned long addr, unsigned long size)
 }
 #endif
 
+#ifdef CONFIG_HAVE_VMAP_LARGE
+/*
+ * Runs of 1 << vmap_large_order physically contiguous pages, aligned to
+ * their size in both address spaces, can be mapped with one TLB entry
+ * once vmap_large_pages() is passed their range; 0 when they cannot.
+ */
+extern int vmap_large_order;
+extern void vmap_large_pages(unsigned long start, unsigned long end);
+#else
+#define vmap_large_order 0
+static inline void vmap_large_pages(unsigned long start, unsigned long end)
+{
+}
+#endif
+
 /* Allocate/destroy a 'vmalloc' VM area. */
 extern struct vm_struct *alloc_vm_area(size_t size);
 extern void free_vm_area(struct vm_struct *area);
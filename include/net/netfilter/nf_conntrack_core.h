@@ -74,6 +74,17 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
             const struct nf_conntrack_l3proto *l3proto,
             const struct nf_conntrack_l4proto *proto);
 
-extern spinlock_t nf_conntrack_lock ;
+/*
+ * The hash table is protected by an array of locks, bucket i by
+ * nf_conntrack_locks[i % CONNTRACK_LOCKS]; take them with
+ * nf_conntrack_lock(), BHs disabled. Expectations and helper
+ * assignments are protected by nf_conntrack_expect_lock.
+ */
+#define CONNTRACK_LOCKS 1024
+
+extern spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
+extern void nf_conntrack_lock(spinlock_t *lock);
+
+extern spinlock_t nf_conntrack_expect_lock;
 
 #endif /* _NF_CONNTRACK_CORE_H */
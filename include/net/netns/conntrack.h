@@ -3,21 +3,37 @@
 
 #include <linux/list.h>
 #include <linux/list_nulls.h>
+#include <linux/percpu_counter.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <asm/atomic.h>
 
 struct ctl_table_header;
 struct nf_conntrack_ecache;
 
+/*
+ * Conntracks not in the hash table: new ones until they are confirmed,
+ * and dead ones whose destroy event is still to be delivered. Each CPU
+ * keeps its own, so that creating and destroying conntracks does not
+ * serialise on one lock.
+ */
+struct ct_pcpu {
+	spinlock_t		lock;
+	struct hlist_nulls_head	unconfirmed;
+	struct hlist_nulls_head	dying;
+};
+
 struct netns_ct {
-	atomic_t		count;
+	struct percpu_counter	count;
 	unsigned int		expect_count;
 	unsigned int		htable_size;
 	struct kmem_cache	*nf_conntrack_cachep;
 	struct hlist_nulls_head	*hash;
 	struct hlist_head	*expect_hash;
-	struct hlist_nulls_head	unconfirmed;
-	struct hlist_nulls_head	dying;
+	struct ct_pcpu __percpu	*pcpu_lists;
 	struct ip_conntrack_stat __percpu *stat;
+	struct delayed_work	gc_work;
+	unsigned int		gc_bucket;
 	int			sysctl_events;
 	unsigned int		sysctl_events_retry_timeout;
 	int			sysctl_acct;
@@ -764,6 +764,8 @@ struct proto {
 					int *addr_len);
 	int			(*sendpage)(struct sock *sk, struct page *page,
 					int offset, size_t size, int flags);
+	/* sendmmsg() stopped before the message without MSG_BATCH */
+	void			(*batch_end)(struct sock *sk);
 	int			(*bind)(struct sock *sk, 
 					struct sockaddr *uaddr, int addr_len);
 
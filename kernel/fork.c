@@ -525,7 +525,10 @@ struct mm_struct * mm_alloc(void)
 
 	memset(mm, 0, sizeof(*mm));
 	mm_init_cpumask(mm);
-	return mm_init(mm, current);
+	mm = mm_init(mm, current);
+	if (mm)
+		lru_gen_add_mm(mm);
+	return mm;
 }
 
 /*
@@ -536,6 +539,7 @@ struct mm_struct * mm_alloc(void)
 void __mmdrop(struct mm_struct *mm)
 {
 	BUG_ON(mm == &init_mm);
+	lru_gen_del_mm(mm);
 	mm_free_pgd(mm);
 	destroy_context(mm);
 	mmu_notifier_mm_destroy(mm);
@@ -745,6 +749,7 @@ struct mm_struct *dup_mm(struct task_struct *tsk)
 	if (init_new_context(tsk, mm))
 		goto fail_nocontext;
 
+	lru_gen_add_mm(mm);
 	dup_mm_exe_file(oldmm, mm);
 
 	err = dup_mmap(mm, oldmm);
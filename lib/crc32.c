@@ -28,13 +28,13 @@
 #include <linux/init.h>
 #include <asm/atomic.h>
 #include "crc32defs.h"
-#if CRC_LE_BITS == 8
+#if CRC_LE_BITS >= 8
 # define tole(x) __constant_cpu_to_le32(x)
 #else
 # define tole(x) (x)
 #endif
 
-#if CRC_BE_BITS == 8
+#if CRC_BE_BITS >= 8
 # define tobe(x) __constant_cpu_to_be32(x)
 #else
 # define tobe(x) (x)
@@ -45,26 +45,44 @@ MODULE_AUTHOR("Matt Domsch <Matt_Domsch@dell.com>");
 MODULE_DESCRIPTION("Ethernet CRC32 calculations");
 MODULE_LICENSE("GPL");
 
-#if CRC_LE_BITS == 8 || CRC_BE_BITS == 8
+#if CRC_LE_BITS >= 8 || CRC_BE_BITS >= 8
 
+/*
+ * With @slice8 set, eight bytes are folded per step using tables 0-7:
+ * the first word is looked up in tables 7-4 and the second in 3-0, so the
+ * two words can be processed independently and the loads overlap with
+ * the lookups. Otherwise one word is folded per step using tables 0-3.
+ * @slice8 is always a constant, so only one loop is compiled in.
+ */
 static inline u32
-crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
+crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256],
+	   const int slice8)
 {
 # ifdef __LITTLE_ENDIAN
-#  define DO_CRC(x) crc = tab[0][(crc ^ (x)) & 255] ^ (crc >> 8)
-#  define DO_CRC4 crc = tab[3][(crc) & 255] ^ \
-		tab[2][(crc >> 8) & 255] ^ \
-		tab[1][(crc >> 16) & 255] ^ \
-		tab[0][(crc >> 24) & 255]
+#  define DO_CRC(x) crc = t0[(crc ^ (x)) & 255] ^ (crc >> 8)
+#  define DO_CRC4 (t3[(q) & 255] ^ t2[(q >> 8) & 255] ^ \
+		   t1[(q >> 16) & 255] ^ t0[(q >> 24) & 255])
+#  define DO_CRC8 (t7[(q) & 255] ^ t6[(q >> 8) & 255] ^ \
+		   t5[(q >> 16) & 255] ^ t4[(q >> 24) & 255])
 # else
-#  define DO_CRC(x) crc = tab[0][((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
-#  define DO_CRC4 crc = tab[0][(crc) & 255] ^ \
-		tab[1][(crc >> 8) & 255] ^ \
-		tab[2][(crc >> 16) & 255] ^ \
-		tab[3][(crc >> 24) & 255]
+#  define DO_CRC(x) crc = t0[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
+#  define DO_CRC4 (t0[(q) & 255] ^ t1[(q >> 8) & 255] ^ \
+		   t2[(q >> 16) & 255] ^ t3[(q >> 24) & 255])
+#  define DO_CRC8 (t4[(q) & 255] ^ t5[(q >> 8) & 255] ^ \
+		   t6[(q >> 16) & 255] ^ t7[(q >> 24) & 255])
 # endif
+	const u32 *t0 = tab[0], *t1 = tab[1], *t2 = tab[2], *t3 = tab[3];
+	const u32 *t4 = NULL, *t5 = NULL, *t6 = NULL, *t7 = NULL;
 	const u32 *b;
 	size_t    rem_len;
+	u32 q;
+
+	if (slice8) {
+		t4 = tab[4];
+		t5 = tab[5];
+		t6 = tab[6];
+		t7 = tab[7];
+	}
 
 	/* Align it */
 	if (unlikely((long)buf & 3 && len)) {
@@ -72,13 +90,26 @@ crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
 			DO_CRC(*buf++);
 		} while ((--len) && ((long)buf)&3);
 	}
-	rem_len = len & 3;
-	/* load data 32 bits wide, xor data 32 bits wide. */
-	len = len >> 2;
+
 	b = (const u32 *)buf;
-	for (--b; len; --len) {
-		crc ^= *++b; /* use pre increment for speed */
-		DO_CRC4;
+	if (slice8) {
+		rem_len = len & 7;
+		/* load data 64 bits wide as two words, xor the first. */
+		len = len >> 3;
+		for (--b; len; --len) {
+			q = crc ^ *++b; /* use pre increment for speed */
+			crc = DO_CRC8;
+			q = *++b;
+			crc ^= DO_CRC4;
+		}
+	} else {
+		rem_len = len & 3;
+		/* load data 32 bits wide, xor data 32 bits wide. */
+		len = len >> 2;
+		for (--b; len; --len) {
+			q = crc ^ *++b; /* use pre increment for speed */
+			crc = DO_CRC4;
+		}
 	}
 	len = rem_len;
 	/* And the last few bytes */
@@ -91,6 +122,7 @@ crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
 	return crc;
 #undef DO_CRC
 #undef DO_CRC4
+#undef DO_CRC8
 }
 #endif
 /**
@@ -102,6 +134,18 @@ crc32_body(u32 crc, unsigned char const *buf, size_t len, const u32 (*tab)[256])
  */
 u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len);
 
+/**
+ * __crc32c_le() - Calculate bitwise little-endian CRC32c (Castagnoli)
+ * @crc: seed value for computation, or the previous crc32c value if
+ *	computing incrementally.  The result is not inverted.
+ * @p: pointer to buffer over which CRC is run
+ * @len: length of buffer @p
+ *
+ * This is the raw update step behind the "crc32c" crypto algorithm; most
+ * users want crypto/crc32c.c or libcrc32c rather than calling it directly.
+ */
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len);
+
 #if CRC_LE_BITS == 1
 /*
  * In fact, the table-based code will work in this case, but it can be
@@ -122,11 +166,11 @@ u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
 
 u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
 {
-# if CRC_LE_BITS == 8
-	const u32      (*tab)[] = crc32table_le;
+# if CRC_LE_BITS >= 8
+	const u32      (*tab)[256] = crc32table_le;
 
 	crc = __cpu_to_le32(crc);
-	crc = crc32_body(crc, p, len, tab);
+	crc = crc32_body(crc, p, len, tab, CRC_LE_BITS == 64);
 	return __le32_to_cpu(crc);
 # elif CRC_LE_BITS == 4
 	while (len--) {
@@ -148,6 +192,29 @@ u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
 }
 #endif
 
+#if CRC_LE_BITS >= 8
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	const u32      (*tab)[256] = crc32ctable_le;
+
+	crc = __cpu_to_le32(crc);
+	crc = crc32_body(crc, p, len, tab, CRC_LE_BITS == 64);
+	return __le32_to_cpu(crc);
+}
+#else
+/* Small configurations only ship the crc32 table, so go bit by bit */
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	int i;
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY_LE : 0);
+	}
+	return crc;
+}
+#endif
+
 /**
  * crc32_be() - Calculate bitwise big-endian Ethernet AUTODIN II CRC32
  * @crc: seed value for computation.  ~0 for Ethernet, sometimes 0 for
@@ -179,11 +246,11 @@ u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 #else				/* Table-based approach */
 u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 {
-# if CRC_BE_BITS == 8
-	const u32      (*tab)[] = crc32table_be;
+# if CRC_BE_BITS >= 8
+	const u32      (*tab)[256] = crc32table_be;
 
 	crc = __cpu_to_be32(crc);
-	crc = crc32_body(crc, p, len, tab);
+	crc = crc32_body(crc, p, len, tab, CRC_BE_BITS == 64);
 	return __be32_to_cpu(crc);
 # elif CRC_BE_BITS == 4
 	while (len--) {
@@ -207,6 +274,7 @@ u32 __pure crc32_be(u32 crc, unsigned char const *p, size_t len)
 
 EXPORT_SYMBOL(crc32_le);
 EXPORT_SYMBOL(crc32_be);
+EXPORT_SYMBOL(__crc32c_le);
 
 /*
  * A brief CRC tutorial.
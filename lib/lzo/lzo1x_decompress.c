@@ -24,8 +24,133 @@
 #define HAVE_OP(x, op_end, op) ((size_t)(op_end - op) < (x))
 #define HAVE_LB(m_pos, out, op) (m_pos < out || m_pos >= op)
 
+/*
+ * Where unaligned loads and stores are cheap (x86, ARMv6 and later) the
+ * copy loops below move a word or two at a time and are allowed to run
+ * up to LZO_OVERRUN bytes past the end of a run, as long as that stays
+ * inside both the input and the output buffer. The surplus bytes written
+ * are overwritten by the next instruction or lie beyond the decompressed
+ * data, so the output is unchanged.
+ *
+ * The pre-boot decompressor may run with the MMU off, where unaligned
+ * accesses fault, so it keeps to the byte-safe variants.
+ */
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) && !defined(STATIC)
+#include <linux/unaligned/packed_struct.h>
+
+#define LZO_FAST_COPY
+
+#define COPY4(dst, src)	\
+		__put_unaligned_cpu32(__get_unaligned_cpu32(src), dst)
+#if BITS_PER_LONG == 64
+#define COPY8(dst, src)	\
+		__put_unaligned_cpu64(__get_unaligned_cpu64(src), dst)
+#else
+#define COPY8(dst, src)	\
+		do { COPY4(dst, src); COPY4((dst) + 4, (src) + 4); } while (0)
+#endif
+#define LZO_OVERRUN	7
+
+#else
 #define COPY4(dst, src)	\
 		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+#endif
+
+/*
+ * Copy a literal run of t bytes. The caller has checked that t bytes
+ * fit in the output, and that t bytes plus the following instruction
+ * byte are available in the input.
+ */
+static inline void lzo_copy_literal(unsigned char **opp,
+		const unsigned char **ipp, size_t t,
+		unsigned char *op_end, const unsigned char *ip_end)
+{
+	unsigned char *op = *opp;
+	const unsigned char *ip = *ipp;
+
+#ifdef LZO_FAST_COPY
+	if (likely(!HAVE_OP(t + LZO_OVERRUN, op_end, op) &&
+		   !HAVE_IP(t + LZO_OVERRUN, ip_end, ip))) {
+		unsigned char * const oe = op + t;
+
+		do {
+			COPY8(op, ip);
+			op += 8;
+			ip += 8;
+		} while (op < oe);
+
+		*opp = oe;
+		*ipp += t;
+		return;
+	}
+#endif
+
+	if (t >= 4) {
+		do {
+			COPY4(op, ip);
+			op += 4;
+			ip += 4;
+			t -= 4;
+		} while (t >= 4);
+	}
+	while (t > 0) {
+		*op++ = *ip++;
+		t--;
+	}
+
+	*opp = op;
+	*ipp = ip;
+}
+
+/*
+ * Copy a match of t bytes from m_pos, which lies behind op and may
+ * overlap the destination. The caller has checked both the look-behind
+ * distance and that t bytes fit in the output.
+ */
+static inline unsigned char *lzo_copy_match(unsigned char *op,
+		const unsigned char *m_pos, size_t t, unsigned char *op_end)
+{
+	size_t dist = op - m_pos;
+
+#ifdef LZO_FAST_COPY
+	/*
+	 * With a distance of at least eight every word read was written
+	 * by an earlier iteration, so overlapping matches copy correctly.
+	 */
+	if (dist >= 8 && likely(!HAVE_OP(t + LZO_OVERRUN, op_end, op))) {
+		unsigned char * const oe = op + t;
+
+		do {
+			COPY8(op, m_pos);
+			op += 8;
+			m_pos += 8;
+		} while (op < oe);
+
+		return oe;
+	}
+#endif
+
+	/* Run of a single repeated byte */
+	if (dist == 1) {
+		memset(op, *m_pos, t);
+		return op + t;
+	}
+
+	if (t >= 4 && dist >= 4) {
+		do {
+			COPY4(op, m_pos);
+			op += 4;
+			m_pos += 4;
+			t -= 4;
+		} while (t >= 4);
+	}
+	while (t > 0) {
+		*op++ = *m_pos++;
+		t--;
+	}
+
+	return op;
+}
 
 int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 			unsigned char *out, size_t *out_len)
@@ -46,9 +171,7 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 			goto output_overrun;
 		if (HAVE_IP(t + 1, ip_end, ip))
 			goto input_overrun;
-		do {
-			*op++ = *ip++;
-		} while (--t > 0);
+		lzo_copy_literal(&op, &ip, t, op_end, ip_end);
 		goto first_literal_run;
 	}
 
@@ -72,28 +195,7 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 		if (HAVE_IP(t + 4, ip_end, ip))
 			goto input_overrun;
 
-		COPY4(op, ip);
-		op += 4;
-		ip += 4;
-		if (--t > 0) {
-			if (t >= 4) {
-				do {
-					COPY4(op, ip);
-					op += 4;
-					ip += 4;
-					t -= 4;
-				} while (t >= 4);
-				if (t > 0) {
-					do {
-						*op++ = *ip++;
-					} while (--t > 0);
-				}
-			} else {
-				do {
-					*op++ = *ip++;
-				} while (--t > 0);
-			}
-		}
+		lzo_copy_literal(&op, &ip, t + 3, op_end, ip_end);
 
 first_literal_run:
 		t = *ip++;
@@ -182,30 +284,8 @@ match:
 				goto lookbehind_overrun;
 			if (HAVE_OP(t + 3 - 1, op_end, op))
 				goto output_overrun;
-
-			if (t >= 2 * 4 - (3 - 1) && (op - m_pos) >= 4) {
-				COPY4(op, m_pos);
-				op += 4;
-				m_pos += 4;
-				t -= 4 - (3 - 1);
-				do {
-					COPY4(op, m_pos);
-					op += 4;
-					m_pos += 4;
-					t -= 4;
-				} while (t >= 4);
-				if (t > 0)
-					do {
-						*op++ = *m_pos++;
-					} while (--t > 0);
-			} else {
 copy_match:
-				*op++ = *m_pos++;
-				*op++ = *m_pos++;
-				do {
-					*op++ = *m_pos++;
-				} while (--t > 0);
-			}
+			op = lzo_copy_match(op, m_pos, t + 2, op_end);
 match_done:
 			t = ip[-2] & 3;
 			if (t == 0)
@@ -216,11 +296,21 @@ match_next:
 			if (HAVE_IP(t + 1, ip_end, ip))
 				goto input_overrun;
 
-			*op++ = *ip++;
-			if (t > 1) {
+#ifdef LZO_FAST_COPY
+			if (likely(!HAVE_OP(4, op_end, op) &&
+				   !HAVE_IP(4, ip_end, ip))) {
+				COPY4(op, ip);
+				op += t;
+				ip += t;
+			} else
+#endif
+			{
 				*op++ = *ip++;
-				if (t > 2)
+				if (t > 1) {
 					*op++ = *ip++;
+					if (t > 2)
+						*op++ = *ip++;
+				}
 			}
 
 			t = *ip++;
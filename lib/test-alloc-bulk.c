@@ -0,0 +1,216 @@
+/*
+ * Self test and page rates of alloc_pages_bulk
+ *
+ * alloc_pages_bulk_array() and alloc_pages_bulk_list() are checked to
+ * hand back distinct, referenced pages, zeroed with __GFP_ZERO, to fill
+ * only the empty entries of a partly populated array, and to count them.
+ * Unless bench_rounds is 0, the rate at which each allocates and frees
+ * pages is then reported for a few batch sizes, next to the same number
+ * of alloc_page() calls.
+ */
+
+#include <linux/gfp.h>
+#include <linux/highmem.h>
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#define TEST_BULK_MAX		512
+
+static unsigned int bench_rounds = 200;
+module_param(bench_rounds, uint, 0);
+MODULE_PARM_DESC(bench_rounds, "Timed batches per method and size, 0: none");
+
+static void __init free_array(struct page **pages, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (pages[i])
+			__free_page(pages[i]);
+		pages[i] = NULL;
+	}
+}
+
+static void __init free_list(struct list_head *list)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, list, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+}
+
+static int __init check_page(struct page *page, struct page **seen, int nr,
+			     bool zeroed)
+{
+	int i;
+
+	if (page_count(page) != 1) {
+		pr_err("test_alloc_bulk: page %p has count %d\n",
+		       page, page_count(page));
+		return -EINVAL;
+	}
+	for (i = 0; i < nr; i++) {
+		if (seen[i] == page) {
+			pr_err("test_alloc_bulk: page %p handed out twice\n",
+			       page);
+			return -EINVAL;
+		}
+	}
+	if (zeroed) {
+		unsigned long *addr = kmap_atomic(page, KM_USER0);
+		unsigned long dirty = 0;
+
+		for (i = 0; i < PAGE_SIZE / sizeof(*addr); i++)
+			dirty |= addr[i];
+		kunmap_atomic(addr, KM_USER0);
+		if (dirty) {
+			pr_err("test_alloc_bulk: page %p not zeroed\n", page);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static int __init check_array(struct page **pages, struct page **seen)
+{
+	unsigned long nr;
+	int i, ret = 0;
+
+	/* Every other entry already taken: only the rest may be filled */
+	for (i = 0; i < TEST_BULK_MAX; i += 2) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			free_array(pages, TEST_BULK_MAX);
+			return -ENOMEM;
+		}
+		seen[i] = pages[i];
+	}
+
+	nr = alloc_pages_bulk_array(GFP_KERNEL | __GFP_ZERO, TEST_BULK_MAX,
+				    pages);
+	if (nr < TEST_BULK_MAX / 2 + 1) {
+		pr_err("test_alloc_bulk: array: %lu of %d entries populated\n",
+		       nr, TEST_BULK_MAX);
+		ret = -EINVAL;
+	}
+	for (i = 0; i < TEST_BULK_MAX && !ret; i++) {
+		if (!(i & 1)) {
+			if (pages[i] != seen[i]) {
+				pr_err("test_alloc_bulk: array: entry %d "
+				       "was replaced\n", i);
+				ret = -EINVAL;
+			}
+			continue;
+		}
+		if (!pages[i])
+			continue;
+		ret = check_page(pages[i], seen, i, true);
+		seen[i] = pages[i];
+	}
+	free_array(pages, TEST_BULK_MAX);
+	return ret;
+}
+
+static int __init check_list(struct page **seen)
+{
+	unsigned long nr;
+	struct page *page;
+	LIST_HEAD(list);
+	int n = 0, ret = 0;
+
+	nr = alloc_pages_bulk_list(GFP_KERNEL | __GFP_ZERO, TEST_BULK_MAX,
+				   &list);
+	list_for_each_entry(page, &list, lru) {
+		if (!ret)
+			ret = check_page(page, seen, n, true);
+		seen[n++] = page;
+	}
+	if (!ret && (!nr || nr != n)) {
+		pr_err("test_alloc_bulk: list: returned %lu, %d on list\n",
+		       nr, n);
+		ret = -EINVAL;
+	}
+	free_list(&list);
+	return ret;
+}
+
+static void __init bench(struct page **pages, int batch)
+{
+	u64 single_ns, array_ns, list_ns;
+	unsigned long total = 0;
+	LIST_HEAD(list);
+	ktime_t t0;
+	int i, j;
+
+	t0 = ktime_get();
+	for (i = 0; i < bench_rounds; i++) {
+		for (j = 0; j < batch; j++)
+			pages[j] = alloc_page(GFP_KERNEL);
+		free_array(pages, batch);
+	}
+	single_ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	t0 = ktime_get();
+	for (i = 0; i < bench_rounds; i++) {
+		total += alloc_pages_bulk_array(GFP_KERNEL, batch, pages);
+		free_array(pages, batch);
+	}
+	array_ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	t0 = ktime_get();
+	for (i = 0; i < bench_rounds; i++) {
+		alloc_pages_bulk_list(GFP_KERNEL, batch, &list);
+		free_list(&list);
+	}
+	list_ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	pr_info("test_alloc_bulk: batch %3d: alloc_page %llu pages/s, "
+		"bulk array %llu pages/s (%lu%% filled), bulk list %llu pages/s\n",
+		batch,
+		div64_u64((u64)batch * bench_rounds * NSEC_PER_SEC, single_ns ?: 1),
+		div64_u64((u64)batch * bench_rounds * NSEC_PER_SEC, array_ns ?: 1),
+		total * 100 / ((unsigned long)batch * bench_rounds),
+		div64_u64((u64)batch * bench_rounds * NSEC_PER_SEC, list_ns ?: 1));
+}
+
+static int __init test_alloc_bulk_init(void)
+{
+	static const int batches[] __initconst = { 8, 32, 128, 512 };
+	struct page **pages, **seen;
+	int i, ret = -ENOMEM;
+
+	pages = kcalloc(TEST_BULK_MAX, sizeof(*pages), GFP_KERNEL);
+	seen = kcalloc(TEST_BULK_MAX, sizeof(*seen), GFP_KERNEL);
+	if (!pages || !seen)
+		goto out;
+
+	ret = check_array(pages, seen);
+	if (ret)
+		goto out;
+	ret = check_list(seen);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(batches) && bench_rounds; i++)
+		bench(pages, batches[i]);
+out:
+	kfree(seen);
+	kfree(pages);
+	return ret;
+}
+
+static void __exit test_alloc_bulk_exit(void)
+{
+}
+
+module_init(test_alloc_bulk_init);
+module_exit(test_alloc_bulk_exit);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,494 @@
+/*
+ * Self test and per-packet cost of the BPF JIT
+ *
+ * A set of tcpdump-style and synthetic socket filters, plus randomly
+ * generated ones, is run through both sk_run_filter() and the code
+ * emitted by bpf_jit_compile(). The return values must agree for every
+ * packet, on linear as well as on paged skbs. Unless bench_runs is 0, the
+ * time and cpu cycles per packet of the interpreter and, with
+ * CONFIG_BPF_JIT, of the JIT are then reported for the fixed filters.
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/perf_event.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+#include <linux/filter.h>
+
+#define TEST_BPF_PKT_LEN	128
+#define TEST_BPF_HEAD_LEN	34	/* ethernet + IPv4 header */
+#define TEST_BPF_MAX_INSNS	40
+
+static unsigned int bench_runs = 100000;
+module_param(bench_runs, uint, 0);
+MODULE_PARM_DESC(bench_runs, "Timed runs per fixed filter, 0: none");
+
+static unsigned int random_progs = 5000;
+module_param(random_progs, uint, 0);
+MODULE_PARM_DESC(random_progs, "Number of random programs to check");
+
+#define S(c, k)		BPF_STMT(c, k)
+#define J(c, k, t, f)	BPF_JUMP(c, k, t, f)
+
+/* tcpdump -dd "ip" */
+static struct sock_filter f_ip[] __initdata = {
+	S(BPF_LD|BPF_H|BPF_ABS, 12), J(BPF_JMP|BPF_JEQ|BPF_K, 0x800, 0, 1),
+	S(BPF_RET|BPF_K, 65535), S(BPF_RET|BPF_K, 0),
+};
+
+/* tcpdump -dd "tcp dst port 80", IPv4 part */
+static struct sock_filter f_tcp80[] __initdata = {
+	S(BPF_LD|BPF_H|BPF_ABS, 12), J(BPF_JMP|BPF_JEQ|BPF_K, 0x800, 0, 8),
+	S(BPF_LD|BPF_B|BPF_ABS, 23), J(BPF_JMP|BPF_JEQ|BPF_K, 6, 0, 6),
+	S(BPF_LD|BPF_H|BPF_ABS, 20), J(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 4, 0),
+	S(BPF_LDX|BPF_B|BPF_MSH, 14), S(BPF_LD|BPF_H|BPF_IND, 16),
+	J(BPF_JMP|BPF_JEQ|BPF_K, 80, 0, 1), S(BPF_RET|BPF_K, 65535),
+	S(BPF_RET|BPF_K, 0),
+};
+
+/* tcpdump -dd "host 10.0.0.1", IPv4 part */
+static struct sock_filter f_host[] __initdata = {
+	S(BPF_LD|BPF_H|BPF_ABS, 12), J(BPF_JMP|BPF_JEQ|BPF_K, 0x800, 0, 4),
+	S(BPF_LD|BPF_W|BPF_ABS, 26), J(BPF_JMP|BPF_JEQ|BPF_K, 0x0a000001, 2, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, 30), J(BPF_JMP|BPF_JEQ|BPF_K, 0x0a000001, 0, 1),
+	S(BPF_RET|BPF_K, 65535), S(BPF_RET|BPF_K, 0),
+};
+
+/* Every ALU operation, scratch memory and shifts by more than 31 */
+static struct sock_filter f_alu[] __initdata = {
+	S(BPF_LD|BPF_W|BPF_ABS, 14), S(BPF_ALU|BPF_ADD|BPF_K, 0x12345),
+	S(BPF_LDX|BPF_W|BPF_LEN, 0), S(BPF_ALU|BPF_SUB|BPF_X, 0),
+	S(BPF_ALU|BPF_MUL|BPF_K, 7), S(BPF_ALU|BPF_DIV|BPF_K, 3),
+	S(BPF_ALU|BPF_AND|BPF_K, 0xff00ffff),
+	S(BPF_ALU|BPF_OR|BPF_K, 0x80000001),
+	S(BPF_ALU|BPF_LSH|BPF_K, 3), S(BPF_ST, 3),
+	S(BPF_ALU|BPF_RSH|BPF_K, 35), S(BPF_ALU|BPF_NEG, 0),
+	S(BPF_LDX|BPF_MEM, 3), S(BPF_ALU|BPF_ADD|BPF_X, 0),
+	S(BPF_ALU|BPF_ADD|BPF_K, -8), S(BPF_ALU|BPF_SUB|BPF_K, -256),
+	S(BPF_ALU|BPF_AND|BPF_K, 0xfffffff0), S(BPF_RET|BPF_A, 0),
+};
+
+/* Division by a packet byte, which may be zero */
+static struct sock_filter f_divx[] __initdata = {
+	S(BPF_LD|BPF_B|BPF_ABS, 30), S(BPF_MISC|BPF_TAX, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, 0), S(BPF_ALU|BPF_DIV|BPF_X, 0),
+	S(BPF_RET|BPF_A, 0),
+};
+
+/* Ancillary data loads */
+static struct sock_filter f_anc[] __initdata = {
+	S(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL), S(BPF_ST, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_MARK),
+	S(BPF_LDX|BPF_MEM, 0), S(BPF_ALU|BPF_ADD|BPF_X, 0), S(BPF_ST, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_QUEUE),
+	S(BPF_LDX|BPF_MEM, 0), S(BPF_ALU|BPF_ADD|BPF_X, 0), S(BPF_ST, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_RXHASH),
+	S(BPF_LDX|BPF_MEM, 0), S(BPF_ALU|BPF_ADD|BPF_X, 0), S(BPF_ST, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+	S(BPF_LDX|BPF_MEM, 0), S(BPF_ALU|BPF_ADD|BPF_X, 0), S(BPF_ST, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+	S(BPF_LDX|BPF_MEM, 0), S(BPF_ALU|BPF_ADD|BPF_X, 0), S(BPF_ST, 0),
+	S(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_HATYPE),
+	S(BPF_LDX|BPF_MEM, 0), S(BPF_ALU|BPF_ADD|BPF_X, 0),
+	S(BPF_LDX|BPF_W|BPF_LEN, 0), S(BPF_ALU|BPF_ADD|BPF_X, 0),
+	S(BPF_RET|BPF_A, 0),
+};
+
+/* Every conditional jump, in both K and X forms */
+static struct sock_filter f_jumps[] __initdata = {
+	S(BPF_LD|BPF_B|BPF_ABS, 40), S(BPF_LDX|BPF_IMM, 0x80),
+	J(BPF_JMP|BPF_JGT|BPF_X, 0, 1, 0), S(BPF_RET|BPF_K, 1),
+	J(BPF_JMP|BPF_JGE|BPF_K, 0xc0, 0, 1), S(BPF_RET|BPF_K, 2),
+	J(BPF_JMP|BPF_JSET|BPF_X, 0, 0, 3),
+	J(BPF_JMP|BPF_JSET|BPF_K, 0x40, 1, 1),
+	S(BPF_RET|BPF_K, 3), S(BPF_RET|BPF_K, 0x12345678),
+	J(BPF_JMP|BPF_JEQ|BPF_X, 0, 1, 0), S(BPF_JMP|BPF_JA, 1),
+	S(BPF_RET|BPF_K, 5), S(BPF_RET|BPF_A, 0),
+};
+
+#undef S
+#undef J
+
+static struct {
+	const char *name;
+	struct sock_filter *insns;
+	unsigned int len;
+} test_bpf_progs[] __initdata = {
+#define PROG(p)	{ #p, p, ARRAY_SIZE(p) }
+	PROG(f_ip), PROG(f_tcp80), PROG(f_host), PROG(f_alu),
+	PROG(f_divx), PROG(f_anc), PROG(f_jumps),
+#undef PROG
+};
+
+/* Opcodes the random program generator picks from */
+static const u16 load_codes[] __initconst = {
+	BPF_LD|BPF_W|BPF_ABS, BPF_LD|BPF_H|BPF_ABS, BPF_LD|BPF_B|BPF_ABS,
+	BPF_LD|BPF_W|BPF_IND, BPF_LD|BPF_H|BPF_IND, BPF_LD|BPF_B|BPF_IND,
+	BPF_LDX|BPF_B|BPF_MSH,
+};
+
+static const u16 other_codes[] __initconst = {
+	BPF_ALU|BPF_ADD|BPF_K, BPF_ALU|BPF_ADD|BPF_X, BPF_ALU|BPF_SUB|BPF_K,
+	BPF_ALU|BPF_SUB|BPF_X, BPF_ALU|BPF_MUL|BPF_K, BPF_ALU|BPF_MUL|BPF_X,
+	BPF_ALU|BPF_DIV|BPF_X, BPF_ALU|BPF_DIV|BPF_K, BPF_ALU|BPF_AND|BPF_K,
+	BPF_ALU|BPF_AND|BPF_X, BPF_ALU|BPF_OR|BPF_K, BPF_ALU|BPF_OR|BPF_X,
+	BPF_ALU|BPF_LSH|BPF_K, BPF_ALU|BPF_LSH|BPF_X, BPF_ALU|BPF_RSH|BPF_K,
+	BPF_ALU|BPF_RSH|BPF_X, BPF_ALU|BPF_NEG, BPF_LD|BPF_W|BPF_LEN,
+	BPF_LD|BPF_IMM, BPF_LDX|BPF_W|BPF_LEN, BPF_LDX|BPF_IMM,
+	BPF_MISC|BPF_TAX, BPF_MISC|BPF_TXA, BPF_LD|BPF_MEM, BPF_LDX|BPF_MEM,
+	BPF_ST, BPF_STX, BPF_JMP|BPF_JA, BPF_JMP|BPF_JEQ|BPF_K,
+	BPF_JMP|BPF_JEQ|BPF_X, BPF_JMP|BPF_JGE|BPF_K, BPF_JMP|BPF_JGE|BPF_X,
+	BPF_JMP|BPF_JGT|BPF_K, BPF_JMP|BPF_JGT|BPF_X, BPF_JMP|BPF_JSET|BPF_K,
+	BPF_JMP|BPF_JSET|BPF_X, BPF_RET|BPF_K, BPF_RET|BPF_A,
+};
+
+static u32 __init random_k(struct rnd_state *rnd)
+{
+	u32 r = prandom32(rnd);
+
+	switch (r & 7) {
+	case 0:
+		return (r >> 3) % 8;
+	case 1:
+		return (r >> 3) % (TEST_BPF_PKT_LEN - 16);
+	case 2:
+		return (r >> 3) % TEST_BPF_HEAD_LEN;
+	case 3:
+		return 0xffU << (2 * ((r >> 3) % 12));
+	case 4:
+		return -((r >> 3) % 300);
+	case 5:
+		return prandom32(rnd);
+	case 6:
+		return (r >> 3) & 0xffff;
+	default:
+		return ((r >> 3) % 64) | (((r >> 9) % 3) << 16);
+	}
+}
+
+/*
+ * Build a program that passes sk_chk_filter(): jumps stay in bounds,
+ * scratch memory is only read after it has been written and division
+ * by a constant zero is avoided.
+ */
+static void __init random_prog(struct sock_filter *f, unsigned int len,
+			struct rnd_state *rnd)
+{
+	unsigned int i, stored = 0;
+
+	for (i = 0; i < len - 1; i++) {
+		u32 r = prandom32(rnd);
+		u16 code = (r % 3 == 0) ?
+			load_codes[(r >> 2) % ARRAY_SIZE(load_codes)] :
+			other_codes[(r >> 2) % ARRAY_SIZE(other_codes)];
+		unsigned int room = len - i - 2;
+
+		f[i].code = code;
+		f[i].k = random_k(rnd);
+		f[i].jt = f[i].jf = 0;
+
+		if (BPF_CLASS(code) == BPF_JMP) {
+			f[i].jt = prandom32(rnd) % (room + 1);
+			f[i].jf = prandom32(rnd) % (room + 1);
+			if (BPF_OP(code) == BPF_JA)
+				f[i].k = prandom32(rnd) % (room + 1);
+		}
+		if (code == BPF_ST || code == BPF_STX) {
+			f[i].k = prandom32(rnd) % BPF_MEMWORDS;
+			stored |= 1 << f[i].k;
+		}
+		if (code == (BPF_LD|BPF_MEM) || code == (BPF_LDX|BPF_MEM))
+			f[i].k = stored ? __ffs(stored) : BPF_MEMWORDS;
+		if (code == (BPF_ALU|BPF_DIV|BPF_K) && !f[i].k)
+			f[i].k = 1;
+		if (code == (BPF_ALU|BPF_LSH|BPF_K) ||
+		    code == (BPF_ALU|BPF_RSH|BPF_K))
+			f[i].k %= 40;
+		if (code == (BPF_LD|BPF_W|BPF_ABS) && (r >> 16) % 6 == 0)
+			f[i].k = SKF_AD_OFF + 4 * ((r >> 20) % 10);
+	}
+	f[len - 1].code = BPF_RET | ((prandom32(rnd) & 1) ? BPF_A : BPF_K);
+	f[len - 1].k = random_k(rnd);
+	f[len - 1].jt = f[len - 1].jf = 0;
+}
+
+/*
+ * An IPv4/TCP frame to port 80 from 10.0.0.1. With @paged, everything
+ * past the IP header lives in a page fragment so that loads beyond the
+ * linear area take the skb_copy_bits() path.
+ */
+static struct sk_buff * __init build_skb(const u8 *pkt, bool paged)
+{
+	unsigned int head = paged ? TEST_BPF_HEAD_LEN : TEST_BPF_PKT_LEN;
+	struct sk_buff *skb;
+	struct page *page;
+
+	skb = alloc_skb(TEST_BPF_PKT_LEN, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+	memcpy(skb_put(skb, head), pkt, head);
+
+	if (paged) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		memcpy(page_address(page), pkt + head, TEST_BPF_PKT_LEN - head);
+		skb_fill_page_desc(skb, 0, page, 0, TEST_BPF_PKT_LEN - head);
+		skb->len += TEST_BPF_PKT_LEN - head;
+		skb->data_len += TEST_BPF_PKT_LEN - head;
+		skb->truesize += PAGE_SIZE;
+	}
+
+	skb->protocol = htons(ETH_P_IP);
+	skb->mark = 0x1234;
+	skb->rxhash = 0xdeadbeef;
+	skb->queue_mapping = 3;
+	return skb;
+}
+
+static struct sk_filter * __init prepare_filter(const struct sock_filter *insns,
+			unsigned int len)
+{
+	struct sk_filter *fp;
+
+	fp = kmalloc(sizeof(*fp) + len * sizeof(*insns), GFP_KERNEL);
+	if (!fp)
+		return NULL;
+	atomic_set(&fp->refcnt, 1);
+	fp->len = len;
+	fp->bpf_func = sk_run_filter;
+	memcpy(fp->insns, insns, len * sizeof(*insns));
+
+	if (sk_chk_filter(fp->insns, fp->len)) {
+		kfree(fp);
+		return NULL;
+	}
+	bpf_jit_compile(fp);
+	return fp;
+}
+
+static void __init release_filter(struct sk_filter *fp)
+{
+	bpf_jit_free(fp);
+	kfree(fp);
+}
+
+/* Returns 0 if the JIT and the interpreter agree on every skb */
+static int __init check_filter(const char *name, struct sk_filter *fp,
+			struct sk_buff **skbs, int nr_skbs)
+{
+	unsigned int want, got;
+	int i;
+
+	for (i = 0; i < nr_skbs; i++) {
+		preempt_disable();
+		want = sk_run_filter(skbs[i], fp->insns);
+		got = SK_RUN_FILTER(fp, skbs[i]);
+		preempt_enable();
+
+		if (want != got) {
+			pr_err("test_bpf: %s: skb %d: jit returned %u, interpreter %u\n",
+				name, i, got, want);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+#ifdef CONFIG_PERF_EVENTS
+static struct perf_event * __init cycle_counter(void)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.size		= sizeof(attr),
+		.config		= PERF_COUNT_HW_CPU_CYCLES,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL);
+	return IS_ERR(event) ? NULL : event;
+}
+
+static void __init cycle_release(struct perf_event *event)
+{
+	if (event)
+		perf_event_release_kernel(event);
+}
+
+static u64 __init read_cycles(struct perf_event *event)
+{
+	u64 enabled, running;
+
+	if (event)
+		return perf_event_read_value(event, &enabled, &running);
+	return get_cycles();
+}
+#else
+static inline struct perf_event *cycle_counter(void)
+{
+	return NULL;
+}
+
+static inline void cycle_release(struct perf_event *event)
+{
+}
+
+static inline u64 read_cycles(struct perf_event *event)
+{
+	return get_cycles();
+}
+#endif
+
+/* Tenths of a nanosecond and cycles per run go to @ns and @cycles */
+static void __init bench_filter(struct sk_filter *fp, struct sk_buff *skb,
+			bool jit, struct perf_event *event, u32 *ns, u32 *cycles)
+{
+	unsigned int i;
+	ktime_t start;
+	u64 c0, c;
+	s64 t;
+
+	/* The counter must not be read with preemption disabled */
+	c0 = read_cycles(event);
+	preempt_disable();
+	start = ktime_get();
+	if (jit) {
+		for (i = 0; i < bench_runs; i++)
+			SK_RUN_FILTER(fp, skb);
+	} else {
+		for (i = 0; i < bench_runs; i++)
+			sk_run_filter(skb, fp->insns);
+	}
+	t = ktime_to_ns(ktime_sub(ktime_get(), start));
+	preempt_enable();
+	c = read_cycles(event) - c0;
+
+	*ns = div64_u64(max_t(s64, t, 0) * 10, bench_runs);
+	*cycles = div64_u64(c, bench_runs);
+}
+
+static void __init bench(const char *name, struct sk_filter *fp,
+			struct sk_buff *skb, struct perf_event *event)
+{
+	u32 ns, cycles;
+
+	bench_filter(fp, skb, false, event, &ns, &cycles);
+	pr_info("test_bpf: %-6s interpreter %u.%u ns, %u cycles per packet\n",
+		name, ns / 10, ns % 10, cycles);
+#ifdef CONFIG_BPF_JIT
+	if (fp->bpf_func == sk_run_filter)
+		return;
+	bench_filter(fp, skb, true, event, &ns, &cycles);
+	pr_info("test_bpf: %-6s jit         %u.%u ns, %u cycles per packet\n",
+		name, ns / 10, ns % 10, cycles);
+#endif
+}
+
+static int __init test_bpf_init(void)
+{
+	struct sock_filter insns[TEST_BPF_MAX_INSNS];
+	struct sk_buff *skbs[4] = { NULL };
+	struct rnd_state rnd;
+	struct perf_event *event = NULL;
+	struct sk_filter *fp;
+	u8 pkt[TEST_BPF_PKT_LEN];
+	unsigned int i;
+	int ret = -ENOMEM;
+#ifdef CONFIG_BPF_JIT
+	int saved_enable = bpf_jit_enable;
+#endif
+
+	prandom32_seed(&rnd, 42);
+
+	/* Ethernet, IPv4 10.0.0.1 -> 10.0.0.2, TCP to port 80 */
+	for (i = 0; i < TEST_BPF_PKT_LEN; i++)
+		pkt[i] = prandom32(&rnd);
+	pkt[12] = 0x08;
+	pkt[13] = 0x00;
+	pkt[14] = 0x45;
+	pkt[20] = pkt[21] = 0;
+	pkt[23] = IPPROTO_TCP;
+	memcpy(&pkt[26], "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+	pkt[36] = 0;
+	pkt[37] = 80;
+	skbs[0] = build_skb(pkt, false);
+	skbs[1] = build_skb(pkt, true);
+
+	/* The same frame with a zero divisor byte and a non-IP ethertype */
+	pkt[30] = 0;
+	pkt[12] = 0x86;
+	pkt[13] = 0xdd;
+	skbs[2] = build_skb(pkt, false);
+	skbs[3] = build_skb(pkt, true);
+	for (i = 0; i < ARRAY_SIZE(skbs); i++)
+		if (!skbs[i])
+			goto out;
+
+#ifdef CONFIG_BPF_JIT
+	bpf_jit_enable = 1;
+#endif
+	if (bench_runs)
+		event = cycle_counter();
+
+	for (i = 0; i < ARRAY_SIZE(test_bpf_progs); i++) {
+		fp = prepare_filter(test_bpf_progs[i].insns,
+				    test_bpf_progs[i].len);
+		if (!fp)
+			goto out;
+#ifdef CONFIG_BPF_JIT
+		if (fp->bpf_func == sk_run_filter)
+			pr_warn("test_bpf: %s: not JIT compiled\n",
+				test_bpf_progs[i].name);
+#endif
+
+		ret = check_filter(test_bpf_progs[i].name, fp, skbs,
+				   ARRAY_SIZE(skbs));
+		if (!ret && bench_runs)
+			bench(test_bpf_progs[i].name + 2, fp, skbs[0], event);
+		release_filter(fp);
+		if (ret)
+			goto out;
+	}
+
+	for (i = 0; i < random_progs; i++) {
+		unsigned int len = 1 + prandom32(&rnd) % TEST_BPF_MAX_INSNS;
+
+		random_prog(insns, len, &rnd);
+		fp = prepare_filter(insns, len);
+		if (!fp)
+			continue;
+
+		ret = check_filter("random", fp, skbs, ARRAY_SIZE(skbs));
+		release_filter(fp);
+		if (ret)
+			goto out;
+	}
+
+	ret = 0;
+out:
+	cycle_release(event);
+#ifdef CONFIG_BPF_JIT
+	bpf_jit_enable = saved_enable;
+#endif
+	for (i = 0; i < ARRAY_SIZE(skbs); i++)
+		kfree_skb(skbs[i]);
+	return ret;
+}
+
+static void __exit test_bpf_exit(void)
+{
+}
+
+module_init(test_bpf_init);
+module_exit(test_bpf_exit);
+MODULE_LICENSE("GPL");
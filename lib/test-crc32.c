@@ -0,0 +1,219 @@
+/*
+ * Self test and throughput of crc32_le(), crc32_be() and __crc32c_le()
+ *
+ * Every function is compared with a bit-at-a-time reference over all
+ * eight buffer alignments and lengths around the word and slice sizes,
+ * and must give the same result when the buffer is fed in two pieces.
+ * Unless bench_passes is 0, the throughput of each is then reported next
+ * to a single-table byte-at-a-time loop, which is what crc32c used before.
+ */
+
+#include <linux/crc32.h>
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+
+#include "crc32defs.h"
+
+#define TEST_CRC32_SIZE		PAGE_SIZE
+#define TEST_CRC32_MAX_SHORT	80
+
+static unsigned int bench_passes = 2000;
+module_param(bench_passes, uint, 0);
+MODULE_PARM_DESC(bench_passes, "Timed passes over a page, 0: none");
+
+static u32 crc32_byte_table[256] __initdata;
+static u32 crc32c_byte_table[256] __initdata;
+
+static u32 __init ref_crc_le(u32 poly, u32 crc, const u8 *p, size_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? poly : 0);
+	}
+	return crc;
+}
+
+static u32 __init ref_crc32_be(u32 crc, const u8 *p, size_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++ << 24;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^ ((crc & 0x80000000) ? CRCPOLY_BE : 0);
+	}
+	return crc;
+}
+
+static u32 __init ref_crc32_le(u32 crc, const u8 *p, size_t len)
+{
+	return ref_crc_le(CRCPOLY_LE, crc, p, len);
+}
+
+static u32 __init ref_crc32c_le(u32 crc, const u8 *p, size_t len)
+{
+	return ref_crc_le(CRC32C_POLY_LE, crc, p, len);
+}
+
+static u32 __init byte_crc32_le(u32 crc, const u8 *p, size_t len)
+{
+	while (len--)
+		crc = crc32_byte_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static u32 __init byte_crc32c_le(u32 crc, const u8 *p, size_t len)
+{
+	while (len--)
+		crc = crc32c_byte_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void __init init_byte_tables(void)
+{
+	u8 b;
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		b = i;
+		crc32_byte_table[i] = ref_crc32_le(0, &b, 1);
+		crc32c_byte_table[i] = ref_crc32c_le(0, &b, 1);
+	}
+}
+
+struct crc_test_fn {
+	const char *name;
+	u32 (*fn)(u32 crc, const unsigned char *p, size_t len);
+	u32 (*ref)(u32 crc, const u8 *p, size_t len);
+};
+
+static const struct crc_test_fn crc_test_fns[] __initconst = {
+	{ "crc32_le",	crc32_le,	ref_crc32_le },
+	{ "crc32_be",	crc32_be,	ref_crc32_be },
+	{ "crc32c",	__crc32c_le,	ref_crc32c_le },
+};
+
+static int __init check_one(const struct crc_test_fn *t, const u8 *buf,
+			size_t len, u32 seed)
+{
+	u32 want, got;
+	size_t split;
+
+	want = t->ref(seed, buf, len);
+	got = t->fn(seed, buf, len);
+	if (got != want)
+		goto fail;
+
+	/* Incremental use must match, whatever the split alignment */
+	for (split = 1; split < len; split += 7) {
+		got = t->fn(seed, buf, split);
+		got = t->fn(got, buf + split, len - split);
+		if (got != want)
+			goto fail;
+	}
+	return 0;
+
+fail:
+	pr_err("test_crc32: %s mismatch at offset %lu len %zu: %08x != %08x\n",
+		t->name, (unsigned long)buf & 7, len, got, want);
+	return -EINVAL;
+}
+
+static int __init check_all(const u8 *buf)
+{
+	static const size_t long_lens[] __initconst = {
+		127, 128, 129, 255, 256, 1000, 1500, 2048,
+		TEST_CRC32_SIZE - 8,
+	};
+	const struct crc_test_fn *t;
+	unsigned int off, i;
+	size_t len;
+	int ret;
+
+	for (t = crc_test_fns; t < crc_test_fns + ARRAY_SIZE(crc_test_fns);
+	     t++) {
+		for (off = 0; off < 8; off++) {
+			for (len = 0; len <= TEST_CRC32_MAX_SHORT; len++) {
+				ret = check_one(t, buf + off, len, ~0);
+				if (ret)
+					return ret;
+			}
+			for (i = 0; i < ARRAY_SIZE(long_lens); i++) {
+				ret = check_one(t, buf + off, long_lens[i],
+						off * 0x01010101);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+static void __init bench_one(const char *name,
+			u32 (*fn)(u32, const unsigned char *, size_t),
+			const u8 *buf, size_t len)
+{
+	unsigned int i;
+	u32 crc = ~0;
+	ktime_t start;
+	s64 ns;
+
+	start = ktime_get();
+	for (i = 0; i < bench_passes; i++)
+		crc = fn(crc, buf, len);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (ns <= 0)
+		ns = 1;
+	pr_info("test_crc32: %-14s %4zu bytes: %llu MB/s (%08x)\n", name,
+		len, div64_u64((u64)len * bench_passes * 1000, ns), crc);
+}
+
+static int __init test_crc32_init(void)
+{
+	struct rnd_state rnd;
+	u8 *buf;
+	int i, ret;
+
+	/* Room to start the page at any of the eight alignments */
+	buf = kmalloc(TEST_CRC32_SIZE + 8, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	prandom32_seed(&rnd, 42);
+	for (i = 0; i < TEST_CRC32_SIZE + 8; i++)
+		buf[i] = prandom32(&rnd);
+	init_byte_tables();
+
+	ret = check_all(buf);
+	if (ret || !bench_passes)
+		goto out;
+
+	bench_one("crc32_le/byte", byte_crc32_le, buf, TEST_CRC32_SIZE);
+	bench_one("crc32_le", crc32_le, buf, TEST_CRC32_SIZE);
+	bench_one("crc32_be", crc32_be, buf, TEST_CRC32_SIZE);
+	bench_one("crc32c/byte", byte_crc32c_le, buf, TEST_CRC32_SIZE);
+	bench_one("crc32c", __crc32c_le, buf, TEST_CRC32_SIZE);
+	/* Short, unaligned buffers as found in node and packet headers */
+	bench_one("crc32_le", crc32_le, buf + 1, 61);
+	bench_one("crc32c", __crc32c_le, buf + 1, 61);
+out:
+	kfree(buf);
+	return ret;
+}
+
+static void __exit test_crc32_exit(void)
+{
+}
+
+module_init(test_crc32_init);
+module_exit(test_crc32_exit);
+MODULE_LICENSE("GPL");
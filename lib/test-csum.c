@@ -0,0 +1,270 @@
+/*
+ * Self test and throughput of csum_partial() and the copy-and-checksum
+ * functions
+ *
+ * csum_partial(), csum_partial_copy_nocheck() and
+ * csum_partial_copy_from_user() are compared with a 16 bit at a time
+ * reference over random lengths, source and destination alignments and
+ * initial sums, covering both sides of any size threshold an
+ * architecture switches implementations at. Only the folded checksum is
+ * compared: implementations may return different 32-bit partial sums
+ * that are equal modulo 0xffff. Unless bench_runs is 0, the throughput of
+ * each is then reported for a few packet sizes, in bytes per cycle where
+ * the cpu cycle counter can be read through perf events or get_cycles().
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/perf_event.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+#include <linux/uaccess.h>
+#include <net/checksum.h>
+
+#define TEST_CSUM_SIZE		(2 * PAGE_SIZE)
+
+static unsigned int bench_runs = 2000;
+module_param(bench_runs, uint, 0);
+MODULE_PARM_DESC(bench_runs, "Timed runs per function and size, 0: none");
+
+static unsigned int random_tests = 20000;
+module_param(random_tests, uint, 0);
+MODULE_PARM_DESC(random_tests, "Random lengths and alignments to check");
+
+/* Ones' complement sum of the host order 16-bit words, folded */
+static u16 __init ref_csum(const u8 *p, int len, __wsum sum)
+{
+	u64 acc = (__force u32)sum;
+	u16 w;
+
+	for (; len > 1; len -= 2, p += 2) {
+		memcpy(&w, p, 2);
+		acc += w;
+	}
+	if (len) {
+#ifdef __BIG_ENDIAN
+		acc += *p << 8;
+#else
+		acc += *p;
+#endif
+	}
+	while (acc >> 16)
+		acc = (acc & 0xffff) + (acc >> 16);
+	return acc;
+}
+
+static __wsum __init csum_from_user(const void *src, void *dst, int len,
+				    __wsum sum, int *err)
+{
+	mm_segment_t old_fs = get_fs();
+	__wsum ret;
+
+	set_fs(KERNEL_DS);
+	ret = csum_partial_copy_from_user((__force const void __user *)src,
+					  dst, len, sum, err);
+	set_fs(old_fs);
+	return ret;
+}
+
+static int __init check_one(const u8 *src, u8 *dst, int len, __wsum sum)
+{
+	u16 want = ref_csum(src, len, sum);
+	const char *what;
+	int err = 0;
+
+	what = "csum_partial";
+	if ((__force u16)csum_fold(csum_partial(src, len, sum)) != (u16)~want)
+		goto fail;
+
+	what = "csum_partial_copy_nocheck";
+	memset(dst, 0, len);
+	if ((__force u16)csum_fold(csum_partial_copy_nocheck(src, dst, len,
+							     sum)) !=
+	    (u16)~want || memcmp(src, dst, len))
+		goto fail;
+
+	what = "csum_partial_copy_from_user";
+	memset(dst, 0, len);
+	if ((__force u16)csum_fold(csum_from_user(src, dst, len, sum,
+						  &err)) !=
+	    (u16)~want || err || memcmp(src, dst, len))
+		goto fail;
+
+	return 0;
+
+fail:
+	pr_err("test_csum: %s mismatch, src offset %lu dst offset %lu len %d sum %08x\n",
+		what, (unsigned long)src & 7, (unsigned long)dst & 7, len,
+		(__force u32)sum);
+	return -EINVAL;
+}
+
+static int __init check_all(u8 *src, u8 *dst, struct rnd_state *rnd)
+{
+	unsigned int i, off;
+	int len, ret;
+
+	/* Every short length at every source alignment */
+	for (off = 0; off < 8; off++)
+		for (len = 0; len <= 80; len++) {
+			ret = check_one(src + off, dst + (len & 7), len, 0);
+			if (ret)
+				return ret;
+		}
+
+	for (i = 0; i < random_tests; i++) {
+		u32 r = prandom32(rnd);
+		__wsum sum = (__force __wsum)((i & 3) ? prandom32(rnd) :
+					      ((i & 4) ? ~0 : 0));
+
+		len = r % (i & 1 ? 2048 : 512);
+		ret = check_one(src + ((r >> 16) & 7), dst + ((r >> 20) & 7),
+				len, sum);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+#ifdef CONFIG_PERF_EVENTS
+static struct perf_event * __init cycle_counter(void)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.size		= sizeof(attr),
+		.config		= PERF_COUNT_HW_CPU_CYCLES,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL);
+	return IS_ERR(event) ? NULL : event;
+}
+
+static void __init cycle_release(struct perf_event *event)
+{
+	if (event)
+		perf_event_release_kernel(event);
+}
+
+/* get_cycles() is 0 on ARM, the PMU cycle counter is what counts there */
+static u64 __init read_cycles(struct perf_event *event)
+{
+	u64 enabled, running;
+
+	if (event)
+		return perf_event_read_value(event, &enabled, &running);
+	return get_cycles();
+}
+#else
+static inline struct perf_event *cycle_counter(void)
+{
+	return NULL;
+}
+
+static inline void cycle_release(struct perf_event *event)
+{
+}
+
+static inline u64 read_cycles(struct perf_event *event)
+{
+	return get_cycles();
+}
+#endif
+
+static void __init bench_one(const char *name, int which, const u8 *src,
+			     u8 *dst, int len, struct perf_event *event)
+{
+	unsigned int i;
+	__wsum sum = 0;
+	u64 c0, cycles;
+	ktime_t start;
+	int err = 0;
+	s64 ns;
+
+	start = ktime_get();
+	c0 = read_cycles(event);
+	for (i = 0; i < bench_runs; i++) {
+		if (which == 0)
+			sum = csum_partial(src, len, sum);
+		else if (which == 1)
+			sum = csum_partial_copy_nocheck(src, dst, len, sum);
+		else
+			sum = csum_from_user(src, dst, len, sum, &err);
+	}
+	cycles = read_cycles(event) - c0;
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (ns <= 0)
+		ns = 1;
+	if (cycles)
+		pr_info("test_csum: %-28s %4d bytes: %llu MB/s, %llu.%02llu bytes/cycle\n",
+			name, len,
+			div64_u64((u64)len * bench_runs * 1000, ns),
+			div64_u64((u64)len * bench_runs, cycles),
+			div64_u64((u64)len * bench_runs * 100, cycles) % 100);
+	else
+		pr_info("test_csum: %-28s %4d bytes: %llu MB/s\n", name, len,
+			div64_u64((u64)len * bench_runs * 1000, ns));
+}
+
+static int __init test_csum_init(void)
+{
+	static const int bench_lens[] __initconst = { 40, 256, 1500, 4096 };
+	struct perf_event *event;
+	struct rnd_state rnd;
+	u8 *src, *dst;
+	int i, ret;
+
+	/* Room to start a buffer at any of the eight alignments */
+	src = kmalloc(TEST_CSUM_SIZE + 8, GFP_KERNEL);
+	dst = kmalloc(TEST_CSUM_SIZE + 8, GFP_KERNEL);
+	ret = -ENOMEM;
+	if (!src || !dst)
+		goto out;
+
+	prandom32_seed(&rnd, 42);
+
+	/* All ones and all zeroes first, for the +0/-0 corner cases */
+	memset(src, 0xff, TEST_CSUM_SIZE + 8);
+	ret = check_one(src + 1, dst, 1500, 0);
+	if (ret)
+		goto out;
+	memset(src, 0, TEST_CSUM_SIZE + 8);
+	ret = check_one(src + 1, dst, 1500, 0);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < TEST_CSUM_SIZE + 8; i++)
+		src[i] = prandom32(&rnd);
+
+	ret = check_all(src, dst, &rnd);
+	if (ret || !bench_runs)
+		goto out;
+
+	event = cycle_counter();
+	for (i = 0; i < ARRAY_SIZE(bench_lens); i++) {
+		bench_one("csum_partial", 0, src, dst, bench_lens[i], event);
+		bench_one("csum_partial_copy_nocheck", 1, src, dst,
+			  bench_lens[i], event);
+		bench_one("csum_partial_copy_from_user", 2, src, dst,
+			  bench_lens[i], event);
+	}
+	cycle_release(event);
+out:
+	kfree(dst);
+	kfree(src);
+	return ret;
+}
+
+static void __exit test_csum_exit(void)
+{
+}
+
+module_init(test_csum_init);
+module_exit(test_csum_exit);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,183 @@
+/*
+ * Self test and timings for kmalloc and kfree
+ *
+ * For a few kmalloc sizes the objects handed out in a batch are checked
+ * to be distinct and, with __GFP_ZERO, zeroed.  Unless bench_rounds is 0
+ * the time per call is then reported for
+ *
+ *   pair     kmalloc() immediately followed by kfree() of the same object
+ *   batch    TEST_KMALLOC_BATCH allocations, then freeing all of them
+ *   remote   a batch allocated here and freed by another cpu, followed by
+ *            allocating a batch here again
+ *
+ * which are the cases the cpu slab fastpaths, the slab lock and per cpu
+ * magazines (CONFIG_SLUB_MAGAZINE) are about.  Compare with the magazine
+ * counters in /sys/kernel/slab/kmalloc-<size>/ or 'slabinfo -r'.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+
+#define TEST_KMALLOC_BATCH	256
+
+static unsigned int bench_rounds = 100;
+module_param(bench_rounds, uint, 0);
+MODULE_PARM_DESC(bench_rounds, "Timed batches per pattern and size, 0: none");
+
+static void **objs;
+
+static void __init free_batch(void *arg)
+{
+	u64 *ns = arg;
+	ktime_t t0;
+	int i;
+
+	t0 = ktime_get();
+	for (i = 0; i < TEST_KMALLOC_BATCH; i++)
+		kfree(objs[i]);
+	*ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+}
+
+static int __init alloc_batch(size_t size, gfp_t gfp, u64 *ns)
+{
+	ktime_t t0;
+	int i;
+
+	t0 = ktime_get();
+	for (i = 0; i < TEST_KMALLOC_BATCH; i++)
+		objs[i] = kmalloc(size, gfp);
+	*ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	for (i = 0; i < TEST_KMALLOC_BATCH; i++) {
+		if (!objs[i]) {
+			while (i--)
+				kfree(objs[i]);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static int __init check(size_t size)
+{
+	u64 ns = 0;
+	int i, j, ret;
+
+	/* Dirty a batch and free it, so that kzalloc gets used objects */
+	ret = alloc_batch(size, GFP_KERNEL, &ns);
+	if (ret)
+		return ret;
+	for (i = 0; i < TEST_KMALLOC_BATCH; i++)
+		memset(objs[i], 0xa5, size);
+	free_batch(&ns);
+
+	ret = alloc_batch(size, GFP_KERNEL | __GFP_ZERO, &ns);
+	if (ret)
+		return ret;
+	for (i = 0; i < TEST_KMALLOC_BATCH && !ret; i++) {
+		unsigned char *p = objs[i], dirty = 0;
+
+		for (j = 0; j < size; j++)
+			dirty |= p[j];
+		if (dirty) {
+			pr_err("test_kmalloc: size %zu: object %p not zeroed\n",
+			       size, p);
+			ret = -EINVAL;
+		}
+		for (j = 0; j < i && !ret; j++) {
+			if (objs[j] == p) {
+				pr_err("test_kmalloc: size %zu: object %p "
+				       "handed out twice\n", size, p);
+				ret = -EINVAL;
+			}
+		}
+	}
+	free_batch(&ns);
+	return ret;
+}
+
+static u64 __init per_call(u64 ns, unsigned long calls)
+{
+	return div64_u64(ns, calls ?: 1);
+}
+
+static int __init bench(size_t size)
+{
+	u64 pair_ns = 0, alloc_ns = 0, free_ns = 0;
+	u64 remote_ns = 0, realloc_ns = 0;
+	unsigned long calls = (unsigned long)bench_rounds * TEST_KMALLOC_BATCH;
+	int i, j, cpu, ret;
+	ktime_t t0;
+
+	t0 = ktime_get();
+	for (i = 0; i < bench_rounds; i++) {
+		for (j = 0; j < TEST_KMALLOC_BATCH; j++)
+			kfree(kmalloc(size, GFP_KERNEL));
+	}
+	pair_ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	for (i = 0; i < bench_rounds; i++) {
+		ret = alloc_batch(size, GFP_KERNEL, &alloc_ns);
+		if (ret)
+			return ret;
+		free_batch(&free_ns);
+	}
+
+	cpu = get_cpu();
+	cpu = cpumask_any_but(cpu_online_mask, cpu);
+	put_cpu();
+	if (cpu < nr_cpu_ids) {
+		for (i = 0; i < bench_rounds; i++) {
+			ret = alloc_batch(size, GFP_KERNEL, &realloc_ns);
+			if (ret)
+				return ret;
+			smp_call_function_single(cpu, free_batch, &remote_ns, 1);
+		}
+	}
+
+	pr_info("test_kmalloc: size %4zu: pair %llu ns, batch alloc %llu ns "
+		"free %llu ns, remote free %llu ns realloc %llu ns\n",
+		size, per_call(pair_ns, calls), per_call(alloc_ns, calls),
+		per_call(free_ns, calls),
+		cpu < nr_cpu_ids ? per_call(remote_ns, calls) : 0ULL,
+		cpu < nr_cpu_ids ? per_call(realloc_ns, calls) : 0ULL);
+	return 0;
+}
+
+static int __init test_kmalloc_init(void)
+{
+	static const size_t sizes[] __initconst = { 16, 64, 256, 1024, 4096 };
+	int i, ret = -ENOMEM;
+
+	objs = kcalloc(TEST_KMALLOC_BATCH, sizeof(*objs), GFP_KERNEL);
+	if (!objs)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		ret = check(sizes[i]);
+		if (ret)
+			goto out;
+	}
+	for (i = 0; i < ARRAY_SIZE(sizes) && bench_rounds; i++) {
+		ret = bench(sizes[i]);
+		if (ret)
+			goto out;
+	}
+out:
+	kfree(objs);
+	return ret;
+}
+
+static void __exit test_kmalloc_exit(void)
+{
+}
+
+module_init(test_kmalloc_init);
+module_exit(test_kmalloc_exit);
+MODULE_LICENSE("GPL");
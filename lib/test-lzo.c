@@ -0,0 +1,206 @@
+/*
+ * Self test and throughput of the LZO1X decompressor
+ *
+ * Every corpus buffer is compressed with lzo1x_1_compress() and must
+ * decompress back to the original. Truncated and undersized inputs must
+ * fail with an error without writing past the output buffer. Unless
+ * bench_runs is 0, the decompression throughput of each corpus entry is
+ * then reported.
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/lzo.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#define TEST_LZO_SIZE		PAGE_SIZE
+#define TEST_LZO_GUARD		64
+#define TEST_LZO_GUARD_BYTE	0x5a
+
+static unsigned int bench_runs = 2000;
+module_param(bench_runs, uint, 0);
+MODULE_PARM_DESC(bench_runs, "Timed decompressions per corpus entry, 0: none");
+
+enum test_lzo_corpus {
+	CORPUS_ZERO,		/* all zeroes: one long run */
+	CORPUS_TEXT,		/* repeated english text */
+	CORPUS_RANDOM,		/* incompressible */
+	CORPUS_SPARSE,		/* mostly zero with scattered words */
+	CORPUS_SHORT_DIST,	/* matches at distances of 2..7 bytes */
+	CORPUS_MIXED,		/* literal runs and matches of all lengths */
+	NR_CORPUS
+};
+
+static const char * const corpus_name[NR_CORPUS] = {
+	"zero", "text", "random", "sparse", "short-dist", "mixed",
+};
+
+static void __init fill_corpus(unsigned char *buf, size_t len,
+			enum test_lzo_corpus type, struct rnd_state *rnd)
+{
+	static const char text[] =
+		"The quick brown fox jumps over the lazy dog. ";
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		u32 r = prandom32(rnd);
+
+		switch (type) {
+		case CORPUS_ZERO:
+			buf[i] = 0;
+			break;
+		case CORPUS_TEXT:
+			buf[i] = text[i % (sizeof(text) - 1)];
+			break;
+		case CORPUS_RANDOM:
+			buf[i] = r;
+			break;
+		case CORPUS_SPARSE:
+			buf[i] = (r & 0x3f) ? 0 : r >> 8;
+			break;
+		case CORPUS_SHORT_DIST:
+			buf[i] = i < 8 ? r : buf[i - 2 - (i / 64) % 6];
+			break;
+		default:
+			if (i > 256 && (r & 3))
+				buf[i] = buf[i - 1 - ((r >> 8) & 0xff)];
+			else
+				buf[i] = r >> 16;
+			break;
+		}
+	}
+}
+
+static int __init check_roundtrip(const unsigned char *src, size_t len,
+			const unsigned char *comp, size_t clen,
+			unsigned char *out)
+{
+	size_t out_len, cut;
+	int ret, i;
+
+	/* Exact decompression */
+	memset(out, 0, len + TEST_LZO_GUARD);
+	out_len = len;
+	ret = lzo1x_decompress_safe(comp, clen, out, &out_len);
+	if (ret != LZO_E_OK || out_len != len || memcmp(out, src, len)) {
+		pr_err("test_lzo: roundtrip failed: ret=%d len=%zu/%zu\n",
+			ret, out_len, len);
+		return -EINVAL;
+	}
+
+	/* Truncated input must be rejected */
+	for (cut = 0; cut < clen; cut += max_t(size_t, 1, clen / 17)) {
+		out_len = len;
+		ret = lzo1x_decompress_safe(comp, cut, out, &out_len);
+		if (ret == LZO_E_OK) {
+			pr_err("test_lzo: accepted input truncated to %zu/%zu\n",
+				cut, clen);
+			return -EINVAL;
+		}
+	}
+
+	/* Undersized output must fail without touching the guard area */
+	for (cut = 0; cut < len; cut += max_t(size_t, 1, len / 13)) {
+		memset(out + cut, TEST_LZO_GUARD_BYTE, TEST_LZO_GUARD);
+		out_len = cut;
+		ret = lzo1x_decompress_safe(comp, clen, out, &out_len);
+		if (ret == LZO_E_OK || out_len > cut) {
+			pr_err("test_lzo: output overrun not detected at %zu\n",
+				cut);
+			return -EINVAL;
+		}
+		for (i = 0; i < TEST_LZO_GUARD; i++) {
+			if (out[cut + i] != TEST_LZO_GUARD_BYTE) {
+				pr_err("test_lzo: wrote past output end %zu\n",
+					cut);
+				return -EINVAL;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void __init bench_decompress(const char *name,
+			const unsigned char *comp, size_t clen,
+			unsigned char *out, size_t len)
+{
+	unsigned int i;
+	size_t out_len;
+	ktime_t start;
+	s64 ns;
+
+	start = ktime_get();
+	for (i = 0; i < bench_runs; i++) {
+		out_len = len;
+		lzo1x_decompress_safe(comp, clen, out, &out_len);
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (ns <= 0)
+		ns = 1;
+	pr_info("test_lzo: %-10s %4zu -> %4zu bytes: %llu MB/s\n", name,
+		len, clen, div64_u64((u64)len * bench_runs * 1000, ns));
+}
+
+static int __init test_lzo_init(void)
+{
+	unsigned char *src, *comp, *out;
+	void *wrkmem;
+	struct rnd_state rnd;
+	size_t len, clen;
+	int type, ret = -ENOMEM;
+
+	src = kmalloc(TEST_LZO_SIZE, GFP_KERNEL);
+	comp = kmalloc(lzo1x_worst_compress(TEST_LZO_SIZE), GFP_KERNEL);
+	out = kmalloc(TEST_LZO_SIZE + TEST_LZO_GUARD, GFP_KERNEL);
+	wrkmem = vmalloc(LZO1X_MEM_COMPRESS);
+	if (!src || !comp || !out || !wrkmem)
+		goto out;
+
+	prandom32_seed(&rnd, 42);
+
+	for (type = 0; type < NR_CORPUS; type++) {
+		fill_corpus(src, TEST_LZO_SIZE, type, &rnd);
+
+		/* Odd lengths exercise the tail handling of the copy loops */
+		for (len = 1; len <= TEST_LZO_SIZE; len = len * 2 + 3) {
+			ret = lzo1x_1_compress(src, len, comp, &clen, wrkmem);
+			if (ret != LZO_E_OK)
+				goto out;
+			ret = check_roundtrip(src, len, comp, clen, out);
+			if (ret)
+				goto out;
+		}
+
+		len = TEST_LZO_SIZE;
+		lzo1x_1_compress(src, len, comp, &clen, wrkmem);
+		ret = check_roundtrip(src, len, comp, clen, out);
+		if (ret)
+			goto out;
+
+		if (bench_runs)
+			bench_decompress(corpus_name[type], comp, clen, out,
+					 len);
+	}
+out:
+	vfree(wrkmem);
+	kfree(out);
+	kfree(comp);
+	kfree(src);
+	return ret;
+}
+
+static void __exit test_lzo_exit(void)
+{
+}
+
+module_init(test_lzo_init);
+module_exit(test_lzo_exit);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,228 @@
+/*
+ * Self test and TLB cost of vmalloc mappings
+ *
+ * vmalloc() and vzalloc() buffers of a few sizes are checked to read back
+ * what was written, to be zeroed where asked, and to agree with
+ * vmalloc_to_page().  Where large page mappings are in use
+ * (HAVE_VMAP_LARGE) areas of a large page or more must also be aligned
+ * for them, and every page must still be reachable at its own address.
+ *
+ * Unless accesses is 0, the time and data TLB refills (from the cpu's PMU,
+ * when perf events are enabled) per random read are then reported for
+ *
+ *   vmalloc  a vmalloc() buffer, mapped with large pages where possible
+ *   vmap     a vmap() of pages allocated one by one, mapped with small
+ *            pages only
+ *
+ * Load the module once with vmap_large=off on the command line, or 0 in
+ * /sys/kernel/mm/vmap/large_pages, to compare.
+ */
+
+#include <linux/gfp.h>
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/perf_event.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+
+static unsigned int size_mb = 8;
+module_param(size_mb, uint, 0);
+MODULE_PARM_DESC(size_mb, "Size of the timed buffers in MB");
+
+static unsigned int accesses = 1 << 20;
+module_param(accesses, uint, 0);
+MODULE_PARM_DESC(accesses, "Timed random reads per buffer, 0: none");
+
+/* Keeps the timed reads from being optimized away */
+static unsigned int bench_sum;
+
+static int __init check(unsigned long size)
+{
+	unsigned long i, words = size / sizeof(unsigned int);
+	unsigned int *buf;
+	int ret = 0;
+
+	buf = vmalloc(size);
+	if (!buf)
+		return -ENOMEM;
+
+	if (vmap_large_order && size >= PAGE_SIZE << vmap_large_order &&
+	    !IS_ALIGNED((unsigned long)buf, PAGE_SIZE << vmap_large_order)) {
+		pr_err("test_vmalloc: %lu byte area at %p not aligned for "
+		       "large pages\n", size, buf);
+		ret = -EINVAL;
+	}
+
+	for (i = 0; i < words; i++)
+		buf[i] = i;
+	for (i = 0; i < words && !ret; i++) {
+		if (buf[i] != i) {
+			pr_err("test_vmalloc: word %lu reads %u\n", i, buf[i]);
+			ret = -EINVAL;
+		}
+	}
+	for (i = 0; i < size / PAGE_SIZE && !ret; i++) {
+		struct page *page = vmalloc_to_page((char *)buf + i * PAGE_SIZE);
+		unsigned int *addr = page_address(page);
+		unsigned long word = i * PAGE_SIZE / sizeof(*buf);
+
+		if (!PageHighMem(page) && addr[1] != word + 1) {
+			pr_err("test_vmalloc: vmalloc_to_page() of page %lu "
+			       "disagrees with the mapping\n", i);
+			ret = -EINVAL;
+		}
+	}
+	vfree(buf);
+	if (ret)
+		return ret;
+
+	buf = vzalloc(size);
+	if (!buf)
+		return -ENOMEM;
+	for (i = 0; i < words && !ret; i++) {
+		if (buf[i]) {
+			pr_err("test_vmalloc: vzalloc word %lu not zeroed\n", i);
+			ret = -EINVAL;
+		}
+	}
+	vfree(buf);
+	return ret;
+}
+
+#ifdef CONFIG_PERF_EVENTS
+static struct perf_event * __init tlb_counter(void)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HW_CACHE,
+		.size		= sizeof(attr),
+		.config		= PERF_COUNT_HW_CACHE_DTLB |
+				  PERF_COUNT_HW_CACHE_OP_READ << 8 |
+				  PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL);
+	return IS_ERR(event) ? NULL : event;
+}
+
+static u64 __init tlb_count(struct perf_event *event)
+{
+	u64 enabled, running;
+
+	return event ? perf_event_read_value(event, &enabled, &running) : 0;
+}
+
+static void __init tlb_release(struct perf_event *event)
+{
+	if (event)
+		perf_event_release_kernel(event);
+}
+#else
+static inline struct perf_event *tlb_counter(void)
+{
+	return NULL;
+}
+
+static inline u64 tlb_count(struct perf_event *event)
+{
+	return 0;
+}
+
+static inline void tlb_release(struct perf_event *event)
+{
+}
+#endif
+
+static void __init bench(const char *name, unsigned int *buf,
+			 unsigned long size, struct perf_event *event)
+{
+	unsigned long words = size / sizeof(*buf), x = 1;
+	unsigned int i, sum = 0;
+	u64 ns, misses;
+	ktime_t t0;
+
+	/* Fault nothing in the timed loop: touch every page first */
+	for (i = 0; i < size / PAGE_SIZE; i++)
+		sum += buf[i * PAGE_SIZE / sizeof(*buf)];
+
+	misses = tlb_count(event);
+	t0 = ktime_get();
+	for (i = 0; i < accesses; i++) {
+		x = x * 1103515245 + 12345;
+		sum += buf[(x >> 8) % words];
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+	misses = tlb_count(event) - misses;
+
+	pr_info("test_vmalloc: %-7s %lu MB: %llu ns per read, "
+		"%llu dTLB refills per 1000 reads%s\n", name, size >> 20,
+		div64_u64(ns, accesses), div64_u64(misses * 1000, accesses),
+		event ? "" : " (no counter)");
+	bench_sum += sum;
+}
+
+static int __init bench_all(void)
+{
+	unsigned long size = (unsigned long)size_mb << 20;
+	unsigned long i, nr_pages = size >> PAGE_SHIFT;
+	struct perf_event *event;
+	struct page **pages;
+	void *buf, *vbuf;
+	int ret = -ENOMEM;
+
+	if (!size)
+		return -EINVAL;
+	buf = vmalloc(size);
+	pages = vzalloc(nr_pages * sizeof(*pages));
+	if (!buf || !pages)
+		goto out;
+	for (i = 0; i < nr_pages; i++) {
+		pages[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
+		if (!pages[i])
+			goto out;
+	}
+	vbuf = vmap(pages, nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!vbuf)
+		goto out;
+
+	event = tlb_counter();
+	bench("vmalloc", buf, size, event);
+	bench("vmap", vbuf, size, event);
+	tlb_release(event);
+	vunmap(vbuf);
+	ret = 0;
+out:
+	if (pages) {
+		for (i = 0; i < nr_pages && pages[i]; i++)
+			__free_page(pages[i]);
+		vfree(pages);
+	}
+	vfree(buf);
+	return ret;
+}
+
+static int __init test_vmalloc_init(void)
+{
+	static const unsigned long sizes[] __initconst = {
+		PAGE_SIZE, 60 << 10, 64 << 10, 200 << 10, 4 << 20,
+	};
+	int i, ret = 0;
+
+	for (i = 0; i < ARRAY_SIZE(sizes) && !ret; i++)
+		ret = check(sizes[i]);
+	if (!ret && accesses)
+		ret = bench_all();
+	return ret;
+}
+
+static void __exit test_vmalloc_exit(void)
+{
+}
+
+module_init(test_vmalloc_init);
+module_exit(test_vmalloc_exit);
+MODULE_LICENSE("GPL");
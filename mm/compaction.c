@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/hrtimer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -42,6 +45,11 @@ struct compact_control {
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
+
+	/* kcompactd works on a zone a little at a time */
+	bool resume;			/* Start where the last run stopped */
+	unsigned int budget;		/* Passes allowed, 0 for no limit */
+	unsigned int nr_passes;		/* Passes done */
 };
 
 static unsigned long release_freepages(struct list_head *freelist)
@@ -442,6 +450,10 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	/* kcompactd has used up its share for this run */
+	if (cc->budget && cc->nr_passes >= cc->budget)
+		return COMPACT_PARTIAL;
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -540,12 +552,23 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
 	cc->free_pfn &= ~(pageblock_nr_pages-1);
 
+	/* Carry on from where kcompactd stopped, if the zone still fits */
+	if (cc->resume &&
+	    zone->compact_cached_migrate_pfn >= cc->migrate_pfn &&
+	    zone->compact_cached_free_pfn <= cc->free_pfn &&
+	    zone->compact_cached_migrate_pfn < zone->compact_cached_free_pfn) {
+		cc->migrate_pfn = zone->compact_cached_migrate_pfn;
+		cc->free_pfn = zone->compact_cached_free_pfn;
+	}
+
 	migrate_prep_local();
 
 	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
 		unsigned long nr_migrate, nr_remaining;
 		int err;
 
+		cc->nr_passes++;
+
 		switch (isolate_migratepages(zone, cc)) {
 		case ISOLATE_ABORT:
 			ret = COMPACT_PARTIAL;
@@ -583,6 +606,16 @@ out:
 	cc->nr_freepages -= release_freepages(&cc->freepages);
 	VM_BUG_ON(cc->nr_freepages != 0);
 
+	if (cc->resume) {
+		if (ret == COMPACT_COMPLETE) {
+			zone->compact_cached_migrate_pfn = 0;
+			zone->compact_cached_free_pfn = 0;
+		} else {
+			zone->compact_cached_migrate_pfn = cc->migrate_pfn;
+			zone->compact_cached_free_pfn = cc->free_pfn;
+		}
+	}
+
 	return ret;
 }
 
@@ -606,6 +639,9 @@ unsigned long compact_zone_order(struct zone *zone,
 
 int sysctl_extfrag_threshold = 500;
 
+/* Running mean of direct compaction stalls, for compact_daemon_saved_us */
+static unsigned long compact_stall_avg_us;
+
 /**
  * try_to_compact_pages - Direct compact to satisfy a high-order allocation
  * @zonelist: The zonelist used for the current allocation
@@ -626,6 +662,8 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 	int rc = COMPACT_SKIPPED;
+	ktime_t start;
+	unsigned long us;
 
 	/*
 	 * Check whether it is worth even starting compaction. The order check is
@@ -636,6 +674,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 		return rc;
 
 	count_vm_event(COMPACTSTALL);
+	start = ktime_get();
 
 	/* Compact each zone in the list */
 	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
@@ -650,6 +689,11 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			break;
 	}
 
+	us = ktime_us_delta(ktime_get(), start);
+	count_vm_events(COMPACTSTALL_US, us);
+	/* Racy, but it only feeds an estimate */
+	compact_stall_avg_us += us / 8 - compact_stall_avg_us / 8;
+
 	return rc;
 }
 
@@ -724,6 +768,248 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * kcompactd: background compaction, one thread per node.
+ *
+ * Every KCOMPACTD_INTERVAL, and whenever an allocation of one of the
+ * orders in vm.compaction_proactive_orders enters the slow path,
+ * kcompactd looks at the fragmentation index of those orders in each
+ * zone of its node. A zone where one is above
+ * vm.compaction_proactive_threshold, and where compaction_suitable()
+ * agrees, is compacted for the highest such order. This is done with
+ * asynchronous migration, KCOMPACTD_BUDGET passes at a time, resuming
+ * where the last run stopped, until a free page of that order shows up
+ * or the scanners meet. Between runs kcompactd sleeps long enough to
+ * stay within vm.compaction_proactive_cpu percent of a cpu. After a zone
+ * was scanned in full without success, it backs off exponentially.
+ */
+int sysctl_compaction_proactive_orders = (1 << 3) | (1 << 4);
+int sysctl_compaction_proactive_threshold = 500;
+int sysctl_compaction_proactive_cpu = 5;
+
+#define KCOMPACTD_INTERVAL	(HZ / 2)
+#define KCOMPACTD_BUDGET	64	/* Pageblock passes per run */
+#define KCOMPACTD_MAX_DEFER	6	/* Back off up to 64 intervals */
+
+static inline bool kcompactd_order_wanted(int order)
+{
+	return order > 0 && order < MAX_ORDER &&
+		(sysctl_compaction_proactive_orders & (1 << order));
+}
+
+/* Highest wanted order that @zone is too fragmented for, or -1 */
+static int kcompactd_zone_order(struct zone *zone)
+{
+	int order;
+
+	for (order = MAX_ORDER - 1; order > 0; order--) {
+		if (!kcompactd_order_wanted(order))
+			continue;
+		if (fragmentation_index(zone, order) <=
+		    sysctl_compaction_proactive_threshold)
+			continue;
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return order;
+	}
+	return -1;
+}
+
+/*
+ * One run over the zones of a node. Returns true if a zone needs more
+ * work, and sets *failed if a zone was compacted in full to no avail.
+ */
+static bool kcompactd_do_work(pg_data_t *pgdat, bool *failed)
+{
+	bool more = false;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			/*
+			 * Compaction frees whole blocks on the movable lists,
+			 * which other migratetypes fall back to.
+			 */
+			.migratetype = MIGRATE_MOVABLE,
+			.sync = false,
+			.resume = true,
+			.budget = KCOMPACTD_BUDGET,
+		};
+		int order, ret;
+
+		if (!populated_zone(zone))
+			continue;
+
+		order = kcompactd_zone_order(zone);
+		if (order < 0)
+			continue;
+
+		count_vm_event(KCOMPACTD_WAKE);
+		cc.order = order;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		ret = compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		/* Page migration frees to the PCP lists but we want merging */
+		drain_local_pages(NULL);
+
+		if (fragmentation_index(zone, order) <=
+		    sysctl_compaction_proactive_threshold) {
+			count_vm_event(KCOMPACTD_SUCCESS);
+			/* The stall the next allocation of this order avoids */
+			count_vm_events(KCOMPACTD_SAVED_US,
+					compact_stall_avg_us);
+		} else if (ret == COMPACT_COMPLETE) {
+			count_vm_event(KCOMPACTD_FAIL);
+			*failed = true;
+		} else {
+			more = true;
+		}
+	}
+
+	return more;
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	long timeout = KCOMPACTD_INTERVAL;
+	bool idle = true;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+	set_user_nice(current, 5);
+
+	while (!kthread_should_stop()) {
+		bool more, failed = false;
+		int cpu;
+		u64 runtime;
+
+		/* Allocations can only cut short an idle sleep */
+		wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kthread_should_stop() ||
+				(idle && pgdat->kcompactd_wake), timeout);
+		if (kthread_should_stop())
+			break;
+		pgdat->kcompactd_wake = false;
+
+		if (!sysctl_compaction_proactive_orders) {
+			timeout = MAX_SCHEDULE_TIMEOUT;
+			idle = true;
+			continue;
+		}
+
+		runtime = task_sched_runtime(current);
+		lru_add_drain();
+		more = kcompactd_do_work(pgdat, &failed);
+		runtime = task_sched_runtime(current) - runtime;
+		count_vm_events(KCOMPACTD_US, div_u64(runtime, NSEC_PER_USEC));
+
+		if (failed) {
+			if (pgdat->kcompactd_defer_shift < KCOMPACTD_MAX_DEFER)
+				pgdat->kcompactd_defer_shift++;
+		} else if (!more) {
+			pgdat->kcompactd_defer_shift = 0;
+		}
+
+		/* Sleep (100 - cpu) / cpu times as long as we ran */
+		cpu = sysctl_compaction_proactive_cpu;
+		timeout = nsecs_to_jiffies(div_u64(runtime * (100 - cpu), cpu));
+		idle = !more && !pgdat->kcompactd_defer_shift;
+		if (!more)
+			timeout = max_t(long, timeout, KCOMPACTD_INTERVAL <<
+					pgdat->kcompactd_defer_shift);
+		timeout = max_t(long, timeout, 1);
+	}
+
+	return 0;
+}
+
+/*
+ * Called in the allocator slow path: have kcompactd of the preferred
+ * zone's node look at fragmentation now rather than at its next check.
+ */
+void wakeup_kcompactd(struct zone *zone, int order)
+{
+	pg_data_t *pgdat = zone->zone_pgdat;
+
+	if (!kcompactd_order_wanted(order) || pgdat->kcompactd_wake)
+		return;
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+	pgdat->kcompactd_wake = true;
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+int sysctl_compaction_proactive_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	/* Have every kcompactd look again with the new settings */
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		pgdat->kcompactd_defer_shift = 0;
+		pgdat->kcompactd_wake = true;
+		wake_up_interruptible(&pgdat->kcompactd_wait);
+	}
+	return 0;
+}
+
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
@@ -484,6 +484,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 			if (PageSwapBacked(page))
 				__inc_zone_page_state(page, NR_SHMEM);
 			spin_unlock_irq(&mapping->tree_lock);
+			workingset_refault(mapping, offset);
 		} else {
 			page->mapping = NULL;
 			spin_unlock_irq(&mapping->tree_lock);
@@ -523,6 +524,108 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * add_to_page_cache_lru_batch - add a run of new pages to the pagecache
+ * @mapping:	the address_space to add them to
+ * @pages:	the pages, each with its page->index set
+ * @nr_pages:	how many, no more than PAGEVEC_SIZE
+ * @gfp_mask:	page allocation mode
+ *
+ * Does what add_to_page_cache_lru() does for each page, but inserts them
+ * all into the radix tree under one hold of tree_lock, and puts them on
+ * the LRU with one pagevec.  Meant for readahead, where the pages are new
+ * and usually contiguous, so that one preload covers the whole run.
+ *
+ * Pages added are left locked with the caller's reference.  Those that
+ * cannot be added, because another task got in first for example, are
+ * released and their entry in @pages cleared.  Returns the number added.
+ */
+unsigned add_to_page_cache_lru_batch(struct address_space *mapping,
+		struct page **pages, unsigned nr_pages, gfp_t gfp_mask)
+{
+	int error[PAGEVEC_SIZE];
+	unsigned long charged = 0;
+	struct pagevec lru_pvec;
+	unsigned i, nr_added = 0;
+	int preloaded;
+
+	VM_BUG_ON(nr_pages > PAGEVEC_SIZE);
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+
+		if (mapping_cap_swap_backed(mapping))
+			SetPageSwapBacked(page);
+		__set_page_locked(page);
+		error[i] = mem_cgroup_cache_charge(page, current->mm,
+					gfp_mask & GFP_RECLAIM_MASK);
+		if (!error[i])
+			__set_bit(i, &charged);
+	}
+
+	preloaded = !radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
+	spin_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+
+		if (error[i])
+			continue;
+
+		page->mapping = mapping;
+		error[i] = radix_tree_insert(&mapping->page_tree,
+					     page->index, page);
+		if (unlikely(error[i] == -ENOMEM)) {
+			/* A scattered run can use up the preload: top it up */
+			spin_unlock_irq(&mapping->tree_lock);
+			if (preloaded)
+				radix_tree_preload_end();
+			preloaded = !radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
+			spin_lock_irq(&mapping->tree_lock);
+			if (preloaded)
+				error[i] = radix_tree_insert(&mapping->page_tree,
+							     page->index, page);
+		}
+		if (likely(!error[i])) {
+			page_cache_get(page);
+			mapping->nrpages++;
+			__inc_zone_page_state(page, NR_FILE_PAGES);
+			if (PageSwapBacked(page))
+				__inc_zone_page_state(page, NR_SHMEM);
+		} else {
+			page->mapping = NULL;
+		}
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+	if (preloaded)
+		radix_tree_preload_end();
+
+	pagevec_init(&lru_pvec, 0);
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+
+		if (error[i]) {
+			if (test_bit(i, &charged))
+				mem_cgroup_uncharge_cache_page(page);
+			__clear_page_locked(page);
+			page_cache_release(page);
+			pages[i] = NULL;
+			continue;
+		}
+		workingset_refault(mapping, page->index);
+		page_cache_get(page);
+		pagevec_add(&lru_pvec, page);
+		nr_added++;
+	}
+	if (pagevec_count(&lru_pvec)) {
+		if (page_is_file_cache(lru_pvec.pages[0]))
+			__pagevec_lru_add_file(&lru_pvec);
+		else
+			__pagevec_lru_add_anon(&lru_pvec);
+	}
+	return nr_added;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_batch);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
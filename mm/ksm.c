@@ -36,6 +36,7 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/math64.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -86,12 +87,18 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @pass_merged: pages merged so far in the current pass over this mm
+ * @idle_scans: number of consecutive passes over this mm that merged nothing
+ * @skip_scans: number of full scans still to pass this mm by
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	unsigned int pass_merged;
+	unsigned int idle_scans;
+	unsigned int skip_scans;
 };
 
 /**
@@ -189,6 +196,40 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* The number of pages freed by ksmd merging them into a ksm page */
+static unsigned long ksm_pages_merged;
+
+/* The number of passes over an mm skipped because it merged nothing */
+static unsigned long ksm_mm_scans_skipped;
+
+/* Most full scans an unproductive mm may be skipped for: 0 never skips */
+static unsigned int ksm_max_skip_scans = 8;
+
+/* Don't count an mm as unproductive until this many passes merged nothing */
+#define KSM_IDLE_SCANS_BEFORE_SKIP	2
+#define KSM_IDLE_SCANS_MAX		16
+
+/*
+ * With ksm_auto_tune set, ksmd retunes pages_to_scan each time it has
+ * spent KSM_TUNE_PERIOD_NS of CPU: up by a quarter while each CPU-second
+ * is merging at least ksm_tune_target pages, down by a quarter otherwise,
+ * staying between KSM_TUNE_MIN_PAGES and ksm_tune_max_pages.
+ */
+static unsigned int ksm_auto_tune;
+static unsigned int ksm_tune_target = 1000;
+static unsigned int ksm_tune_max_pages = 1000;
+
+#define KSM_TUNE_MIN_PAGES	16
+#define KSM_TUNE_PERIOD_NS	(100 * NSEC_PER_MSEC)
+
+/* CPU time ksmd has spent scanning, in total and in this tuning period */
+static u64 ksm_scan_cpu_ns;
+static u64 ksm_tune_cpu_ns;
+static unsigned long ksm_tune_merged;
+
+/* Pages merged per CPU-second of scanning over the last tuning period */
+static unsigned long ksm_merge_yield;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -638,6 +679,9 @@ static int unmerge_and_remove_all_rmap_items(void)
 		}
 
 		remove_trailing_rmap_items(mm_slot, &mm_slot->rmap_list);
+		mm_slot->pass_merged = 0;
+		mm_slot->idle_scans = 0;
+		mm_slot->skip_scans = 0;
 
 		spin_lock(&ksm_mmlist_lock);
 		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
@@ -1159,6 +1203,17 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_shared++;
 }
 
+/*
+ * Credit a page merged to the mm being scanned, for deciding whether
+ * it is worth scanning again soon, and to the scan rate tuning.
+ */
+static void ksm_count_merge(void)
+{
+	ksm_pages_merged++;
+	ksm_tune_merged++;
+	ksm_scan.mm_slot->pass_merged++;
+}
+
 /*
  * cmp_and_merge_page - first see if page can be merged into the stable tree;
  * if not, compare checksum to previous and if it's the same, see if page can
@@ -1191,6 +1246,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			ksm_count_merge();
 		}
 		put_page(kpage);
 		return;
@@ -1229,6 +1285,8 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 				stable_tree_append(rmap_item, stable_node);
 			}
 			unlock_page(kpage);
+			if (stable_node)
+				ksm_count_merge();
 
 			/*
 			 * If we fail to insert the page into the stable tree,
@@ -1272,6 +1330,55 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Called at the end of each pass over an mm: one that has merged nothing
+ * for a few passes in a row is skipped by the following full scans, for
+ * twice as many each time it is found still unproductive, up to
+ * ksm_max_skip_scans.  Any merge puts it back into every scan.
+ */
+static void ksm_slot_pass_done(struct mm_slot *slot)
+{
+	if (slot->pass_merged) {
+		slot->pass_merged = 0;
+		slot->idle_scans = 0;
+		return;
+	}
+	if (slot->idle_scans < KSM_IDLE_SCANS_MAX)
+		slot->idle_scans++;
+	if (slot->idle_scans >= KSM_IDLE_SCANS_BEFORE_SKIP)
+		slot->skip_scans = min(1U << (slot->idle_scans -
+					      KSM_IDLE_SCANS_BEFORE_SKIP),
+				       ksm_max_skip_scans);
+}
+
+/*
+ * Should this full scan pass the mm by?  Its unstable rmap_items are
+ * dropped if so: the unstable tree they were in has since been discarded,
+ * and remove_rmap_item_from_tree() relies on no rmap_item being left more
+ * than one scan behind.  An exiting mm is never skipped, so that its
+ * rmap_items are freed without delay.  The slot is ksm_scan.mm_slot,
+ * so __ksm_exit() will not free it from under us.
+ */
+static bool ksm_slot_skip(struct mm_slot *slot)
+{
+	struct rmap_item *rmap_item;
+
+	if (!slot->skip_scans)
+		return false;
+	if (ksm_test_exit(slot->mm)) {
+		slot->skip_scans = 0;
+		return false;
+	}
+
+	slot->skip_scans--;
+	ksm_mm_scans_skipped++;
+	for (rmap_item = slot->rmap_list; rmap_item;
+	     rmap_item = rmap_item->rmap_list)
+		if (rmap_item->address & UNSTABLE_FLAG)
+			remove_rmap_item_from_tree(rmap_item);
+	return true;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1309,6 +1416,17 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		if (slot == &ksm_mm_head)
 			return NULL;
 next_mm:
+		if (ksm_slot_skip(slot)) {
+			spin_lock(&ksm_mmlist_lock);
+			slot = list_entry(slot->mm_list.next,
+					  struct mm_slot, mm_list);
+			ksm_scan.mm_slot = slot;
+			spin_unlock(&ksm_mmlist_lock);
+			if (slot != &ksm_mm_head)
+				goto next_mm;
+			ksm_scan.seqnr++;
+			return NULL;
+		}
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
 	}
@@ -1367,6 +1485,7 @@ next_mm:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
 	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	ksm_slot_pass_done(slot);
 
 	spin_lock(&ksm_mmlist_lock);
 	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
@@ -1423,6 +1542,39 @@ static void ksm_do_scan(unsigned int scan_npages)
 	}
 }
 
+/*
+ * Account the CPU time of a batch, and at the end of each tuning period
+ * work out how many pages it merged per CPU-second, retuning the batch
+ * size from that if asked to.
+ */
+static void ksm_tune_scan_rate(u64 cpu_ns)
+{
+	unsigned int pages;
+
+	ksm_scan_cpu_ns += cpu_ns;
+	ksm_tune_cpu_ns += cpu_ns;
+	if (ksm_tune_cpu_ns < KSM_TUNE_PERIOD_NS)
+		return;
+
+	ksm_merge_yield = div64_u64((u64)ksm_tune_merged * NSEC_PER_SEC,
+				    ksm_tune_cpu_ns);
+	ksm_tune_cpu_ns = 0;
+	ksm_tune_merged = 0;
+
+	if (!ksm_auto_tune)
+		return;
+
+	pages = ksm_thread_pages_to_scan;
+	if (ksm_merge_yield >= ksm_tune_target)
+		pages += pages / 4 + 1;
+	else
+		pages -= pages / 4;
+	ksm_thread_pages_to_scan = clamp_t(unsigned int, pages,
+			KSM_TUNE_MIN_PAGES,
+			max_t(unsigned int, ksm_tune_max_pages,
+			      KSM_TUNE_MIN_PAGES));
+}
+
 static int ksmd_should_run(void)
 {
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
@@ -1430,13 +1582,18 @@ static int ksmd_should_run(void)
 
 static int ksm_scan_thread(void *nothing)
 {
+	u64 cpu_ns;
+
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
+			cpu_ns = task_sched_runtime(current);
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_tune_scan_rate(task_sched_runtime(current) - cpu_ns);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1966,6 +2123,128 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t max_skip_scans_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_skip_scans);
+}
+
+static ssize_t max_skip_scans_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	unsigned long scans;
+	int err;
+
+	err = strict_strtoul(buf, 10, &scans);
+	if (err || scans > UINT_MAX)
+		return -EINVAL;
+
+	ksm_max_skip_scans = scans;
+
+	return count;
+}
+KSM_ATTR(max_skip_scans);
+
+static ssize_t auto_tune_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_tune);
+}
+
+static ssize_t auto_tune_store(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	unsigned long flag;
+	int err;
+
+	err = strict_strtoul(buf, 10, &flag);
+	if (err || flag > 1)
+		return -EINVAL;
+
+	ksm_auto_tune = flag;
+
+	return count;
+}
+KSM_ATTR(auto_tune);
+
+static ssize_t auto_tune_target_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_tune_target);
+}
+
+static ssize_t auto_tune_target_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	unsigned long target;
+	int err;
+
+	err = strict_strtoul(buf, 10, &target);
+	if (err || target > UINT_MAX)
+		return -EINVAL;
+
+	ksm_tune_target = target;
+
+	return count;
+}
+KSM_ATTR(auto_tune_target);
+
+static ssize_t auto_tune_max_pages_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_tune_max_pages);
+}
+
+static ssize_t auto_tune_max_pages_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	unsigned long nr_pages;
+	int err;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages < KSM_TUNE_MIN_PAGES || nr_pages > UINT_MAX)
+		return -EINVAL;
+
+	ksm_tune_max_pages = nr_pages;
+
+	return count;
+}
+KSM_ATTR(auto_tune_max_pages);
+
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t mm_scans_skipped_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_mm_scans_skipped);
+}
+KSM_ATTR_RO(mm_scans_skipped);
+
+static ssize_t scan_cpu_msecs_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)div_u64(ksm_scan_cpu_ns,
+						   NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(scan_cpu_msecs);
+
+static ssize_t merge_yield_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_merge_yield);
+}
+KSM_ATTR_RO(merge_yield);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1975,6 +2254,14 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&max_skip_scans_attr.attr,
+	&auto_tune_attr.attr,
+	&auto_tune_target_attr.attr,
+	&auto_tune_max_pages_attr.attr,
+	&pages_merged_attr.attr,
+	&mm_scans_skipped_attr.attr,
+	&scan_cpu_msecs_attr.attr,
+	&merge_yield_attr.attr,
 	NULL,
 };
 
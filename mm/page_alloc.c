@@ -57,6 +57,8 @@
 #include <linux/ftrace_event.h>
 #include <linux/memcontrol.h>
 #include <linux/prefetch.h>
+#include <linux/migrate.h>
+#include <linux/mm_inline.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -827,11 +829,16 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
  * This array describes the order lists are fallen back to when
  * the free lists for the desirable migrate type are depleted
  */
-static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
-	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
-	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
-	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
+static int fallbacks[MIGRATE_TYPES][4] = {
+	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,     MIGRATE_RESERVE },
+#ifdef CONFIG_CMA
+	[MIGRATE_MOVABLE]     = { MIGRATE_CMA,         MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+	[MIGRATE_CMA]         = { MIGRATE_RESERVE }, /* Never used */
+#else
+	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE,   MIGRATE_RESERVE },
+#endif
+	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE }, /* Never used */
 };
 
 /*
@@ -926,12 +933,12 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 	/* Find the largest possible block of pages in the other list */
 	for (current_order = MAX_ORDER-1; current_order >= order;
 						--current_order) {
-		for (i = 0; i < MIGRATE_TYPES - 1; i++) {
+		for (i = 0;; i++) {
 			migratetype = fallbacks[start_migratetype][i];
 
 			/* MIGRATE_RESERVE handled later if necessary */
 			if (migratetype == MIGRATE_RESERVE)
-				continue;
+				break;
 
 			area = &(zone->free_area[current_order]);
 			if (list_empty(&area->free_list[migratetype]))
@@ -945,11 +952,13 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * aggressive about taking ownership of free pages
+			 * aggressive about taking ownership of free pages.
+			 * CMA pageblocks are only ever borrowed from.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
+			if (!is_migrate_cma(migratetype) &&
+			    (unlikely(current_order >= (pageblock_order >> 1)) ||
 					start_migratetype == MIGRATE_RECLAIMABLE ||
-					page_group_by_mobility_disabled) {
+					page_group_by_mobility_disabled)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -968,7 +977,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			rmv_page_order(page);
 
 			/* Take ownership for orders >= pageblock_order */
-			if (current_order >= pageblock_order)
+			if (current_order >= pageblock_order &&
+			    !is_migrate_cma(migratetype))
 				change_pageblock_range(page, current_order,
 							start_migratetype);
 
@@ -1023,7 +1033,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			unsigned long count, struct list_head *list,
 			int migratetype, int cold)
 {
-	int i;
+	int mt, i;
 	
 	spin_lock(&zone->lock);
 	for (i = 0; i < count; ++i) {
@@ -1044,7 +1054,14 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+		/*
+		 * Pages borrowed from a CMA pageblock must go back to its
+		 * free list when the pcp list is drained.
+		 */
+		mt = get_pageblock_migratetype(page);
+		if (!is_migrate_cma(mt))
+			mt = migratetype;
+		set_page_private(page, mt);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -1275,8 +1292,13 @@ int split_free_page(struct page *page)
 
 	if (order >= pageblock_order - 1) {
 		struct page *endpage = page + (1 << order) - 1;
-		for (; page < endpage; page += pageblock_nr_pages)
-			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+		for (; page < endpage; page += pageblock_nr_pages) {
+			int mt = get_pageblock_migratetype(page);
+
+			if (mt != MIGRATE_ISOLATE && !is_migrate_cma(mt))
+				set_pageblock_migratetype(page,
+							  MIGRATE_MOVABLE);
+		}
 	}
 
 	return 1 << order;
@@ -2122,6 +2144,7 @@ restart:
 	if (!(gfp_mask & __GFP_NO_KSWAPD))
 		wake_all_kswapd(order, zonelist, high_zoneidx,
 						zone_idx(preferred_zone));
+	wakeup_kcompactd(preferred_zone, order);
 
 	/*
 	 * OK, we're below the kswapd watermark and have kicked background
@@ -2313,6 +2336,165 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * Pages __alloc_pages_bulk() takes off the per-cpu list per interrupts
+ * disabled section: they are prepared, and zeroed if asked, only after
+ * interrupts are enabled again.
+ */
+#define ALLOC_BULK_CHUNK	32
+
+/* Hand a page to the caller of __alloc_pages_bulk() */
+static inline void bulk_add_page(struct page *page,
+		struct list_head *page_list, struct page **page_array,
+		unsigned long *slot)
+{
+	if (page_list) {
+		list_add_tail(&page->lru, page_list);
+		return;
+	}
+	while (page_array[*slot])
+		(*slot)++;
+	page_array[(*slot)++] = page;
+}
+
+/**
+ * __alloc_pages_bulk - allocate a number of order-0 pages at once
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: nodes allowed, or NULL for those of the current cpuset
+ * @nr_pages: the number of pages wanted, or the size of @page_array
+ * @page_list: list to add the pages to, or NULL
+ * @page_array: array to fill the NULL entries of, if @page_list is NULL
+ *
+ * Picks a zone that can spare all the pages above its low watermark with
+ * one check, and takes them from this cpu's list for that zone, refilling
+ * it from the buddy lists as often as needed.  When no zone can, or not
+ * a single page can be had that way, one page is allocated by the normal
+ * path, reclaim and all, so that the caller always makes progress.
+ *
+ * With @page_array, only the NULL entries are filled, lowest first, and
+ * the number of entries now populated is returned.  With @page_list, the
+ * number of pages added to it is returned.  Either way callers must cope
+ * with getting fewer pages than they asked for.
+ */
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+			nodemask_t *nodemask, unsigned long nr_pages,
+			struct list_head *page_list, struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	unsigned long nr_populated = 0, nr_before, nr_wanted, slot;
+	struct page *chunk[ALLOC_BULK_CHUNK];
+	struct zone *preferred_zone, *zone = NULL;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	unsigned long flags;
+	struct zoneref *z;
+	struct page *page;
+	int nr, i;
+
+	if (page_array) {
+		for (slot = 0; slot < nr_pages; slot++)
+			if (page_array[slot])
+				nr_populated++;
+	}
+	nr_before = nr_populated;
+	nr_wanted = nr_pages - nr_populated;
+	slot = 0;
+	if (!nr_wanted)
+		return nr_populated;
+
+	/* The fast path below is no better for a single page */
+	if (nr_wanted == 1)
+		goto failed;
+
+	gfp_mask &= gfp_allowed_mask;
+	lockdep_trace_alloc(gfp_mask);
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	if (should_fail_alloc_page(gfp_mask, 0))
+		goto failed;
+	if (unlikely(!zonelist->_zonerefs->zone))
+		return nr_populated;
+
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx,
+			     nodemask ? : &cpuset_current_mems_allowed,
+			     &preferred_zone);
+	if (!preferred_zone) {
+		put_mems_allowed();
+		return nr_populated;
+	}
+
+	for_each_zone_zonelist_nodemask(zone, z, zonelist,
+					high_zoneidx, nodemask) {
+		if (!cpuset_zone_allowed_softwall(zone,
+						  gfp_mask | __GFP_HARDWALL))
+			continue;
+		if (zone_watermark_ok(zone, 0,
+				      low_wmark_pages(zone) + nr_wanted,
+				      zone_idx(preferred_zone),
+				      ALLOC_WMARK_LOW | ALLOC_CPUSET))
+			break;
+	}
+	put_mems_allowed();
+	if (!zone)
+		goto failed;
+
+	while (nr_wanted) {
+		int want = min_t(unsigned long, nr_wanted, ALLOC_BULK_CHUNK);
+
+		local_irq_save(flags);
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		list = &pcp->lists[migratetype];
+		for (nr = 0; nr < want; nr++) {
+			if (list_empty(list)) {
+				pcp->count += rmqueue_bulk(zone, 0, pcp->batch,
+						list, migratetype, cold);
+				if (unlikely(list_empty(list)))
+					break;
+			}
+			if (cold)
+				page = list_entry(list->prev, struct page, lru);
+			else
+				page = list_entry(list->next, struct page, lru);
+			list_del(&page->lru);
+			pcp->count--;
+			zone_statistics(preferred_zone, zone, gfp_mask);
+			chunk[nr] = page;
+		}
+		__count_zone_vm_events(PGALLOC, zone, nr);
+		local_irq_restore(flags);
+
+		for (i = 0; i < nr; i++) {
+			page = chunk[i];
+			VM_BUG_ON(bad_range(zone, page));
+			/* Reported as bad: leave it be, as buffered_rmqueue() does */
+			if (prep_new_page(page, 0, gfp_mask))
+				continue;
+			trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+			bulk_add_page(page, page_list, page_array, &slot);
+			nr_populated++;
+			nr_wanted--;
+		}
+		if (nr < want)
+			break;
+	}
+
+	if (nr_populated != nr_before)
+		return nr_populated;
+
+failed:
+	page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+	if (page) {
+		bulk_add_page(page, page_list, page_array, &slot);
+		nr_populated++;
+	}
+	return nr_populated;
+}
+EXPORT_SYMBOL(__alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -4295,6 +4477,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat_resize_init(pgdat);
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat->kswapd_max_order = 0;
 	pgdat_page_cgroup_init(pgdat);
 	
@@ -5519,7 +5704,8 @@ __count_immobile_pages(struct zone *zone, struct page *page, int count)
 	if (zone_idx(zone) == ZONE_MOVABLE)
 		return true;
 
-	if (get_pageblock_migratetype(page) == MIGRATE_MOVABLE)
+	if (get_pageblock_migratetype(page) == MIGRATE_MOVABLE ||
+	    is_migrate_cma(get_pageblock_migratetype(page)))
 		return true;
 
 	pfn = page_to_pfn(page);
@@ -5618,7 +5804,7 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, unsigned migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
@@ -5626,12 +5812,267 @@ void unset_migratetype_isolate(struct page *page)
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	move_freepages_block(zone, page, migratetype);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
+#ifdef CONFIG_CMA
+
+/*
+ * Hand a pageblock reserved at boot for a contiguous memory area over
+ * to the buddy allocator as MIGRATE_CMA.
+ */
+void __init init_cma_reserved_pageblock(struct page *page)
+{
+	unsigned i = pageblock_nr_pages;
+	struct page *p = page;
+
+	do {
+		__ClearPageReserved(p);
+		set_page_count(p, 0);
+	} while (++p, --i);
+
+	set_page_refcounted(page);
+	set_pageblock_migratetype(page, MIGRATE_CMA);
+
+	if (pageblock_order >= MAX_ORDER) {
+		i = pageblock_nr_pages;
+		p = page;
+		do {
+			set_page_refcounted(p);
+			__free_pages(p, MAX_ORDER - 1);
+			p += MAX_ORDER_NR_PAGES;
+		} while (i -= MAX_ORDER_NR_PAGES);
+	} else {
+		__free_pages(page, pageblock_order);
+	}
+
+	totalram_pages += pageblock_nr_pages;
+}
+
+/*
+ * Isolation works on whole pageblocks, and the free pages found at the
+ * end may be buddies up to MAX_ORDER, so the range is widened to both.
+ */
+static unsigned long pfn_max_align_down(unsigned long pfn)
+{
+	return pfn & ~(max_t(unsigned long, MAX_ORDER_NR_PAGES,
+			     pageblock_nr_pages) - 1);
+}
+
+static unsigned long pfn_max_align_up(unsigned long pfn)
+{
+	return ALIGN(pfn, max_t(unsigned long, MAX_ORDER_NR_PAGES,
+				pageblock_nr_pages));
+}
+
+static struct page *
+__alloc_contig_migrate_alloc(struct page *page, unsigned long private,
+			     int **resultp)
+{
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+/*
+ * Take up to SWAP_CLUSTER_MAX pages in [pfn, end) off the LRU onto
+ * @pages. Returns the pfn to continue from.
+ */
+static unsigned long
+__alloc_contig_isolate(unsigned long pfn, unsigned long end,
+		       struct list_head *pages)
+{
+	int nr = 0;
+
+	for (; pfn < end && nr < SWAP_CLUSTER_MAX; pfn++) {
+		struct page *page;
+
+		if (!pfn_valid_within(pfn))
+			continue;
+		page = pfn_to_page(pfn);
+		if (!PageLRU(page) || isolate_lru_page(page))
+			continue;
+
+		list_add(&page->lru, pages);
+		inc_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+		nr++;
+	}
+	return pfn;
+}
+
+/* Migrate every page in use in [start, end) somewhere else */
+static int __alloc_contig_migrate_range(unsigned long start,
+					unsigned long end)
+{
+	unsigned long pfn = start;
+	unsigned int tries = 0;
+	LIST_HEAD(pages);
+	int ret = 0;
+
+	lru_add_drain_all();
+	drain_all_pages();
+
+	while (pfn < end || !list_empty(&pages)) {
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		if (list_empty(&pages)) {
+			pfn = __alloc_contig_isolate(pfn, end, &pages);
+			tries = 0;
+			if (list_empty(&pages))
+				continue;
+		} else if (++tries == 5) {
+			ret = ret < 0 ? ret : -EBUSY;
+			break;
+		}
+
+		ret = migrate_pages(&pages, __alloc_contig_migrate_alloc, 0,
+				    false, true);
+		cond_resched();
+	}
+
+	putback_lru_pages(&pages);
+	return ret > 0 ? 0 : ret;
+}
+
+/*
+ * Take the free pages in [start, end) off the free lists, as order-0
+ * pages with a reference each. Returns the pfn after the last page
+ * taken, which may be past @end if a buddy straddles it, or 0 if some
+ * page in the range is not free.
+ */
+static unsigned long
+__alloc_contig_take_free(struct zone *zone, unsigned long start,
+			 unsigned long end)
+{
+	unsigned long pfn, flags;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for (pfn = start; pfn < end; ) {
+		struct page *page = pfn_to_page(pfn);
+		unsigned int order;
+
+		if (!PageBuddy(page))
+			break;
+
+		order = page_order(page);
+		list_del(&page->lru);
+		zone->free_area[order].nr_free--;
+		rmv_page_order(page);
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+		set_page_refcounted(page);
+		split_page(page, order);
+		pfn += 1UL << order;
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	if (pfn < end) {
+		free_contig_range(start, pfn - start);
+		return 0;
+	}
+
+	for (; start < pfn; start++) {
+		arch_alloc_page(pfn_to_page(start), 0);
+		kernel_map_pages(pfn_to_page(start), 1, 1);
+	}
+	return pfn;
+}
+
+/**
+ * alloc_contig_range() -- tries to allocate given range of pages
+ * @start:	start PFN to allocate
+ * @end:	one-past-the-last PFN to allocate
+ * @migratetype:	migratetype of the underlaying pageblocks (either
+ *			#MIGRATE_MOVABLE or #MIGRATE_CMA).  All pageblocks
+ *			in range must have the same migratetype and it must
+ *			be either of the two.
+ *
+ * The PFN range does not have to be pageblock or MAX_ORDER_NR_PAGES
+ * aligned, however it's the caller's responsibility to guarantee that
+ * we are the only thread that changes migrate type of pageblocks the
+ * pages fall in.
+ *
+ * The PFN range must belong to a single zone.
+ *
+ * Returns zero on success or negative error code.  On success all
+ * pages which PFN is in [start, end) are allocated for the caller and
+ * need to be freed with free_contig_range().
+ */
+int alloc_contig_range(unsigned long start, unsigned long end,
+		       unsigned migratetype)
+{
+	struct zone *zone = page_zone(pfn_to_page(start));
+	unsigned long outer_start, outer_end;
+	int ret, order;
+
+	/*
+	 * Isolating the range first means that nothing freed in it from
+	 * now on can be allocated again, and that the pages migrated out
+	 * get their new homes elsewhere. What is in use is then migrated,
+	 * and once all of it is free the pages are taken off the free
+	 * lists directly.
+	 */
+	ret = start_isolate_page_range(pfn_max_align_down(start),
+				       pfn_max_align_up(end), migratetype);
+	if (ret)
+		return ret;
+
+	ret = __alloc_contig_migrate_range(start, end);
+	if (ret)
+		goto done;
+
+	/*
+	 * Pages freed by the migration may sit on pcp lists, and the free
+	 * page covering @start may be a larger buddy starting before it.
+	 */
+	lru_add_drain_all();
+	drain_all_pages();
+
+	order = 0;
+	outer_start = start;
+	while (!PageBuddy(pfn_to_page(outer_start))) {
+		if (++order >= MAX_ORDER) {
+			ret = -EBUSY;
+			goto done;
+		}
+		outer_start &= ~0UL << order;
+	}
+
+	if (test_pages_isolated(outer_start, end)) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	outer_end = __alloc_contig_take_free(zone, outer_start, end);
+	if (!outer_end) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	/* Give back what was taken beyond the requested range */
+	if (start != outer_start)
+		free_contig_range(outer_start, start - outer_start);
+	if (end != outer_end)
+		free_contig_range(end, outer_end - end);
+
+done:
+	undo_isolate_page_range(pfn_max_align_down(start),
+				pfn_max_align_up(end), migratetype);
+	return ret;
+}
+
+void free_contig_range(unsigned long pfn, unsigned nr_pages)
+{
+	for (; nr_pages--; ++pfn)
+		__free_page(pfn_to_page(pfn));
+}
+#endif
+
 #ifdef CONFIG_MEMORY_HOTREMOVE
 /*
  * All pages in the range must be isolated before calling this.
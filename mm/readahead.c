@@ -109,8 +109,9 @@ EXPORT_SYMBOL(read_cache_pages);
 static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
+	struct page *batch[PAGEVEC_SIZE];
 	struct blk_plug plug;
-	unsigned page_idx;
+	unsigned page_idx, i, nr;
 	int ret;
 
 	blk_start_plug(&plug);
@@ -122,14 +123,19 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
-	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
-		struct page *page = list_to_page(pages);
-		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			mapping->a_ops->readpage(filp, page);
+	for (page_idx = 0; page_idx < nr_pages; page_idx += nr) {
+		nr = min_t(unsigned, nr_pages - page_idx, PAGEVEC_SIZE);
+		for (i = 0; i < nr; i++) {
+			batch[i] = list_to_page(pages);
+			list_del(&batch[i]->lru);
+		}
+		add_to_page_cache_lru_batch(mapping, batch, nr, GFP_KERNEL);
+		for (i = 0; i < nr; i++) {
+			if (!batch[i])
+				continue;
+			mapping->a_ops->readpage(filp, batch[i]);
+			page_cache_release(batch[i]);
 		}
-		page_cache_release(page);
 	}
 	ret = 0;
 
@@ -1626,8 +1626,15 @@ void init_kmem_cache_cpus(struct kmem_cache *s)
 {
 	int cpu;
 
-	for_each_possible_cpu(cpu)
-		per_cpu_ptr(s->cpu_slab, cpu)->tid = init_tid(cpu);
+	for_each_possible_cpu(cpu) {
+		struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+
+		c->tid = init_tid(cpu);
+#ifdef CONFIG_SLUB_MAGAZINE
+		c->mag.depth = SLUB_MAG_MIN;
+		c->mag.stamp = jiffies;
+#endif
+	}
 }
 /*
  * Remove the cpu slab
@@ -1671,6 +1678,266 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	deactivate_slab(s, c);
 }
 
+#ifdef CONFIG_SLUB_MAGAZINE
+/*
+ * Per cpu magazines (struct kmem_cache_mag).
+ *
+ * A magazine is a plain array of free objects, used with interrupts
+ * disabled, that sits in front of the cpu slab. kmem_cache_free() pushes
+ * onto it whichever slab the object belongs to, and kmem_cache_alloc()
+ * pops from it, so an object is usually handed back out while it is still
+ * cache hot and without its slab being touched at all. This matters
+ * where there is no cmpxchg_double and the cpu slab fastpaths fall back
+ * to disabling interrupts anyway, and for objects freed on a cpu other
+ * than the one that allocated them, which otherwise always take the slab
+ * lock in __slab_free().
+ *
+ * When the magazine is empty an allocation goes to the cpu slab and
+ * takes a few more objects off its freelist on the way. When it is full
+ * the older half is given back to the slabs, sorted so that the objects
+ * of each slab go back as one chain under one slab lock.
+ *
+ * Only allocations for no particular node on caches without debugging
+ * use magazines. On NUMA only objects of the local node go into them.
+ */
+#define SLUB_MAG_TUNE_OPS	256	/* Operations in a tuning window */
+#define SLUB_MAG_SLOW_RATE	256	/* Operations/sec below which to shrink */
+
+static __always_inline void *slab_alloc_cpu(struct kmem_cache *s,
+		gfp_t gfpflags, int node, unsigned long addr);
+static __always_inline void slab_free_cpu(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr);
+static void __slab_free(struct kmem_cache *s, struct page *page,
+			void *head, void *tail, int cnt, unsigned long addr);
+
+static inline int mag_usable(struct kmem_cache *s, int node)
+{
+	return !kmem_cache_debug(s) && node == NUMA_NO_NODE;
+}
+
+static inline void mag_stat(struct kmem_cache_mag *m, enum mag_stat_item si)
+{
+	m->stat[si]++;
+	m->ops++;
+}
+
+/*
+ * Called on every miss with interrupts disabled. A magazine that missed
+ * on more than one operation in eight over the last window doubles in
+ * depth. One that saw fewer than SLUB_MAG_SLOW_RATE operations a second
+ * is halved, and gives back what it holds above the new depth the next
+ * time it overflows.
+ */
+static void mag_tune(struct kmem_cache_mag *m)
+{
+	unsigned long elapsed;
+
+	m->misses++;
+	if (m->ops < SLUB_MAG_TUNE_OPS)
+		return;
+
+	elapsed = jiffies - m->stamp;
+	if (elapsed >= HZ && m->ops < SLUB_MAG_SLOW_RATE * (elapsed / HZ)) {
+		if (m->depth > SLUB_MAG_MIN)
+			m->depth /= 2;
+	} else if (m->misses * 8 > m->ops) {
+		if (m->depth < SLUB_MAG_MAX)
+			m->depth *= 2;
+	}
+
+	m->ops = 0;
+	m->misses = 0;
+	m->stamp = jiffies;
+}
+
+/*
+ * Free objects taken out of a magazine back to their slabs. Sorting them
+ * by address brings the objects of each slab together, and every run is
+ * chained up and freed under a single slab lock.
+ *
+ * Debugging switched on through sysfs while objects sat in the magazine
+ * needs them checked one by one, so they are then freed singly.
+ */
+static void mag_release(struct kmem_cache *s, void **objects,
+			unsigned int nr, unsigned long addr)
+{
+	struct page *page;
+	unsigned int i, j, run;
+
+	if (unlikely(kmem_cache_debug(s))) {
+		for (i = 0; i < nr; i++)
+			__slab_free(s, virt_to_head_page(objects[i]),
+				    objects[i], objects[i], 1, addr);
+		return;
+	}
+
+	for (i = 1; i < nr; i++) {
+		void *x = objects[i];
+
+		for (j = i; j > 0 && objects[j - 1] > x; j--)
+			objects[j] = objects[j - 1];
+		objects[j] = x;
+	}
+
+	for (i = 0; i < nr; i += run) {
+		page = virt_to_head_page(objects[i]);
+		for (run = 1; i + run < nr; run++) {
+			if (virt_to_head_page(objects[i + run]) != page)
+				break;
+			set_freepointer(s, objects[i + run - 1], objects[i + run]);
+		}
+		if (run == 1)
+			slab_free_cpu(s, page, objects[i], addr);
+		else
+			__slab_free(s, page, objects[i], objects[i + run - 1],
+				    run, addr);
+	}
+}
+
+/*
+ * The magazine is empty: allocate from the cpu slab, and refill the
+ * magazine to half its depth from the cpu freelist while it is hot.
+ */
+static noinline void *mag_alloc_miss(struct kmem_cache *s, gfp_t gfpflags,
+				     unsigned long addr)
+{
+	struct kmem_cache_cpu *c;
+	struct kmem_cache_mag *m;
+	unsigned long flags;
+	void *object;
+
+	object = slab_alloc_cpu(s, gfpflags, NUMA_NO_NODE, addr);
+	if (unlikely(!object))
+		return NULL;
+
+	local_irq_save(flags);
+	c = __this_cpu_ptr(s->cpu_slab);
+	m = &c->mag;
+	mag_stat(m, MAG_ALLOC_MISS);
+	if (c->freelist) {
+		while (m->count < m->depth / 2 && c->freelist) {
+			m->objects[m->count++] = c->freelist;
+			c->freelist = get_freepointer(s, c->freelist);
+		}
+		/* Fail any lockless fastpath that raced with the refill */
+		c->tid = next_tid(c->tid);
+	}
+	mag_tune(m);
+	local_irq_restore(flags);
+	return object;
+}
+
+static __always_inline void *mag_alloc(struct kmem_cache *s, gfp_t gfpflags,
+				       unsigned long addr)
+{
+	struct kmem_cache_mag *m;
+	unsigned long flags;
+	void *object;
+
+	local_irq_save(flags);
+	m = &__this_cpu_ptr(s->cpu_slab)->mag;
+	if (likely(m->count)) {
+		object = m->objects[--m->count];
+		mag_stat(m, MAG_ALLOC_HIT);
+		local_irq_restore(flags);
+		return object;
+	}
+	local_irq_restore(flags);
+
+	return mag_alloc_miss(s, gfpflags, addr);
+}
+
+/*
+ * The magazine is full: give the older half, and anything above a depth
+ * that has since been reduced, back to the slabs.
+ */
+static noinline void mag_free_miss(struct kmem_cache *s, void *x,
+				   unsigned long addr)
+{
+	void *batch[SLUB_MAG_MAX];
+	struct kmem_cache_mag *m;
+	unsigned long flags;
+	unsigned int nr = 0;
+
+	local_irq_save(flags);
+	m = &__this_cpu_ptr(s->cpu_slab)->mag;
+	mag_stat(m, MAG_FREE_MISS);
+	if (m->count >= m->depth) {
+		nr = m->count - m->depth / 2;
+		memcpy(batch, m->objects, nr * sizeof(void *));
+		m->count -= nr;
+		memmove(m->objects, m->objects + nr, m->count * sizeof(void *));
+	}
+	m->objects[m->count++] = x;
+	mag_tune(m);
+	local_irq_restore(flags);
+
+	if (nr)
+		mag_release(s, batch, nr, addr);
+}
+
+static __always_inline int mag_free(struct kmem_cache *s, struct page *page,
+				    void *x, unsigned long addr)
+{
+	struct kmem_cache_mag *m;
+	unsigned long flags;
+
+	if (NUMA_BUILD && page_to_nid(page) != numa_node_id())
+		return 0;
+
+	local_irq_save(flags);
+	m = &__this_cpu_ptr(s->cpu_slab)->mag;
+	if (likely(m->count < m->depth)) {
+		m->objects[m->count++] = x;
+		mag_stat(m, MAG_FREE_HIT);
+		local_irq_restore(flags);
+		return 1;
+	}
+	local_irq_restore(flags);
+
+	mag_free_miss(s, x, addr);
+	return 1;
+}
+
+/*
+ * Empty the magazine of a cpu. Called with interrupts disabled, on that
+ * cpu or for a cpu that is gone.
+ */
+static void mag_drain(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	void *batch[SLUB_MAG_MAX];
+	unsigned int nr = c->mag.count;
+
+	if (!nr)
+		return;
+
+	memcpy(batch, c->mag.objects, nr * sizeof(void *));
+	c->mag.count = 0;
+	mag_release(s, batch, nr, _RET_IP_);
+}
+#else
+static inline int mag_usable(struct kmem_cache *s, int node)
+{
+	return 0;
+}
+
+static inline void *mag_alloc(struct kmem_cache *s, gfp_t gfpflags,
+			      unsigned long addr)
+{
+	return NULL;
+}
+
+static inline int mag_free(struct kmem_cache *s, struct page *page,
+			   void *x, unsigned long addr)
+{
+	return 0;
+}
+
+static inline void mag_drain(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+}
+#endif
+
 /*
  * Flush cpu slab.
  *
@@ -1680,7 +1947,11 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	if (likely(c && c->page))
+	if (unlikely(!c))
+		return;
+
+	mag_drain(s, c);
+	if (likely(c->page))
 		flush_slab(s, c);
 }
 
@@ -1897,16 +2168,13 @@ debug:
  *
  * Otherwise we can simply pick the next object from the lockless free list.
  */
-static __always_inline void *slab_alloc(struct kmem_cache *s,
+static __always_inline void *slab_alloc_cpu(struct kmem_cache *s,
 		gfp_t gfpflags, int node, unsigned long addr)
 {
 	void **object;
 	struct kmem_cache_cpu *c;
 	unsigned long tid;
 
-	if (slab_pre_alloc_hook(s, gfpflags))
-		return NULL;
-
 redo:
 
 	/*
@@ -1955,6 +2223,22 @@ redo:
 		stat(s, ALLOC_FASTPATH);
 	}
 
+	return object;
+}
+
+static __always_inline void *slab_alloc(struct kmem_cache *s,
+		gfp_t gfpflags, int node, unsigned long addr)
+{
+	void *object;
+
+	if (slab_pre_alloc_hook(s, gfpflags))
+		return NULL;
+
+	if (mag_usable(s, node))
+		object = mag_alloc(s, gfpflags, addr);
+	else
+		object = slab_alloc_cpu(s, gfpflags, node, addr);
+
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->objsize);
 
@@ -2025,25 +2309,29 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_trace);
  * So we still attempt to reduce cache line usage. Just take the slab
  * lock and free the item. If there is no additional partial page
  * handling required then we can return immediately.
+ *
+ * @head to @tail is a chain of @cnt objects of @page linked by their free
+ * pointers. Only mag_release() frees more than one at a time, and only
+ * while the cache has no debugging enabled, since free_debug_processing()
+ * checks just @head.
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr)
+			void *head, void *tail, int cnt, unsigned long addr)
 {
 	void *prior;
-	void **object = (void *)x;
 	unsigned long flags;
 
 	local_irq_save(flags);
 	slab_lock(page);
 	stat(s, FREE_SLOWPATH);
 
-	if (kmem_cache_debug(s) && !free_debug_processing(s, page, x, addr))
+	if (kmem_cache_debug(s) && !free_debug_processing(s, page, head, addr))
 		goto out_unlock;
 
 	prior = page->freelist;
-	set_freepointer(s, object, prior);
-	page->freelist = object;
-	page->inuse--;
+	set_freepointer(s, tail, prior);
+	page->freelist = head;
+	page->inuse -= cnt;
 
 	if (unlikely(PageSlubFrozen(page))) {
 		stat(s, FREE_FROZEN);
@@ -2092,15 +2380,13 @@ slab_empty:
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
  */
-static __always_inline void slab_free(struct kmem_cache *s,
+static __always_inline void slab_free_cpu(struct kmem_cache *s,
 			struct page *page, void *x, unsigned long addr)
 {
 	void **object = (void *)x;
 	struct kmem_cache_cpu *c;
 	unsigned long tid;
 
-	slab_free_hook(s, x);
-
 redo:
 
 	/*
@@ -2127,8 +2413,19 @@ redo:
 		}
 		stat(s, FREE_FASTPATH);
 	} else
-		__slab_free(s, page, x, addr);
+		__slab_free(s, page, x, x, 1, addr);
+
+}
+
+static __always_inline void slab_free(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	slab_free_hook(s, x);
 
+	if (mag_usable(s, NUMA_NO_NODE) && mag_free(s, page, x, addr))
+		return;
+
+	slab_free_cpu(s, page, x, addr);
 }
 
 void kmem_cache_free(struct kmem_cache *s, void *x)
@@ -4241,8 +4538,11 @@ static ssize_t sanity_checks_store(struct kmem_cache *s,
 				const char *buf, size_t length)
 {
 	s->flags &= ~SLAB_DEBUG_FREE;
-	if (buf[0] == '1')
+	if (buf[0] == '1') {
 		s->flags |= SLAB_DEBUG_FREE;
+		/* Magazines are not used from now on: empty them */
+		flush_all(s);
+	}
 	return length;
 }
 SLAB_ATTR(sanity_checks);
@@ -4256,8 +4556,11 @@ static ssize_t trace_store(struct kmem_cache *s, const char *buf,
 							size_t length)
 {
 	s->flags &= ~SLAB_TRACE;
-	if (buf[0] == '1')
+	if (buf[0] == '1') {
 		s->flags |= SLAB_TRACE;
+		/* Magazines are not used from now on: empty them */
+		flush_all(s);
+	}
 	return length;
 }
 SLAB_ATTR(trace);
@@ -4488,6 +4791,92 @@ STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
 #endif
 
+#ifdef CONFIG_SLUB_MAGAZINE
+/* Magazine values shown besides the counters */
+#define MAG_DEPTH	NR_MAG_STAT_ITEMS
+#define MAG_OBJECTS	(NR_MAG_STAT_ITEMS + 1)
+
+static unsigned long mag_value(struct kmem_cache_mag *m, int item)
+{
+	if (item == MAG_DEPTH)
+		return m->depth;
+	if (item == MAG_OBJECTS)
+		return m->count;
+	return m->stat[item];
+}
+
+static int show_mag(struct kmem_cache *s, char *buf, int item)
+{
+	unsigned long sum = 0;
+	unsigned long *data;
+	int cpu;
+	int len;
+
+	data = kmalloc(nr_cpu_ids * sizeof(unsigned long), GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	for_each_online_cpu(cpu) {
+		unsigned long x = mag_value(&per_cpu_ptr(s->cpu_slab, cpu)->mag,
+					    item);
+
+		data[cpu] = x;
+		sum += x;
+	}
+
+	len = sprintf(buf, "%lu", sum);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		if (data[cpu] && len < PAGE_SIZE - 30)
+			len += sprintf(buf + len, " C%d=%lu", cpu, data[cpu]);
+	}
+#endif
+	kfree(data);
+	return len + sprintf(buf + len, "\n");
+}
+
+static void clear_mag_stat(struct kmem_cache *s, enum mag_stat_item si)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		per_cpu_ptr(s->cpu_slab, cpu)->mag.stat[si] = 0;
+}
+
+#define MAG_STAT_ATTR(si, text) 				\
+static ssize_t text##_show(struct kmem_cache *s, char *buf)	\
+{								\
+	return show_mag(s, buf, si);				\
+}								\
+static ssize_t text##_store(struct kmem_cache *s,		\
+				const char *buf, size_t length)	\
+{								\
+	if (buf[0] != '0')					\
+		return -EINVAL;					\
+	clear_mag_stat(s, si);					\
+	return length;						\
+}								\
+SLAB_ATTR(text);						\
+
+MAG_STAT_ATTR(MAG_ALLOC_HIT, magazine_alloc_hits);
+MAG_STAT_ATTR(MAG_ALLOC_MISS, magazine_alloc_misses);
+MAG_STAT_ATTR(MAG_FREE_HIT, magazine_free_hits);
+MAG_STAT_ATTR(MAG_FREE_MISS, magazine_free_misses);
+
+static ssize_t magazine_depth_show(struct kmem_cache *s, char *buf)
+{
+	return show_mag(s, buf, MAG_DEPTH);
+}
+SLAB_ATTR_RO(magazine_depth);
+
+static ssize_t magazine_objects_show(struct kmem_cache *s, char *buf)
+{
+	return show_mag(s, buf, MAG_OBJECTS);
+}
+SLAB_ATTR_RO(magazine_objects);
+#endif
+
 static struct attribute *slab_attrs[] = {
 	&slab_size_attr.attr,
 	&object_size_attr.attr,
@@ -4544,6 +4933,14 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
 #endif
+#ifdef CONFIG_SLUB_MAGAZINE
+	&magazine_alloc_hits_attr.attr,
+	&magazine_alloc_misses_attr.attr,
+	&magazine_free_hits_attr.attr,
+	&magazine_free_misses_attr.attr,
+	&magazine_depth_attr.attr,
+	&magazine_objects_attr.attr,
+#endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
 #endif
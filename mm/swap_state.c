@@ -13,6 +13,7 @@
 #include <linux/swap.h>
 #include <linux/swapops.h>
 #include <linux/init.h>
+#include <linux/highmem.h>
 #include <linux/pagemap.h>
 #include <linux/buffer_head.h>
 #include <linux/backing-dev.h>
@@ -47,6 +48,37 @@ struct address_space swapper_space = {
 
 #define INC_CACHE_INFO(x)	do { swap_cache_info.x++; } while (0)
 
+/*
+ * With swap_vma_readahead set, a swap fault reads in the swap entries
+ * found in the page table around the faulting address rather than the
+ * neighbouring slots of the swap device.  The window for each VMA is
+ * sized from how many of the pages it read ahead last time were faulted
+ * on since, and is kept in vma->swap_readahead_info together with the
+ * address of the last fault and that hit count.
+ */
+int sysctl_swap_vma_readahead __read_mostly;
+
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* The window is read from a copy of the page table kept on the stack */
+#ifdef CONFIG_64BIT
+#define SWAP_RA_ORDER_CEILING	5
+#else
+#define SWAP_RA_ORDER_CEILING	3
+#endif
+
 static struct {
 	unsigned long add_total;
 	unsigned long del_total;
@@ -260,14 +292,32 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page * lookup_swap_cache(swp_entry_t entry,
+			struct vm_area_struct *vma, unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
+		bool readahead = TestClearPageReadahead(page);
+
 		INC_CACHE_INFO(find_success);
+		if (readahead)
+			count_vm_event(SWAP_RA_HIT);
+
+		if (vma && swap_use_vma_readahead()) {
+			unsigned long ra_val;
+			unsigned int hits;
+
+			ra_val = atomic_long_read(&vma->swap_readahead_info);
+			hits = SWAP_RA_HITS(ra_val);
+			if (readahead && hits < SWAP_RA_HITS_MAX)
+				hits++;
+			atomic_long_set(&vma->swap_readahead_info,
+				SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val), hits));
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -279,8 +329,9 @@ struct page * lookup_swap_cache(swp_entry_t entry)
  * A failure return means that either the page allocation failed or that
  * the swap entry is no longer in use.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr, bool *new_page_read)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
@@ -330,11 +381,13 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = __add_to_swap_cache(new_page, entry);
 		if (likely(!err)) {
 			radix_tree_preload_end();
+			workingset_refault(&swapper_space, entry.val);
 			/*
 			 * Initiate read into locked page and return.
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
+			*new_page_read = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -352,6 +405,38 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool new_page_read = false;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &new_page_read);
+}
+
+/*
+ * Start reading in @entry ahead of a fault on another page.  Pages that
+ * had to be read are marked so that lookup_swap_cache() can tell when
+ * the readahead paid off.  Returns false when nothing can be read.
+ */
+static bool swap_readahead_page(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool new_page_read = false;
+	struct page *page;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &new_page_read);
+	if (!page)
+		return false;
+	if (new_page_read) {
+		SetPageReadahead(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+	return true;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -389,12 +474,118 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (offset == swp_offset(entry)) {
+			page = read_swap_cache_async(entry, gfp_mask, vma, addr);
+			if (!page)
+				break;
+			page_cache_release(page);
+		} else if (!swap_readahead_page(swp_entry(swp_type(entry),
+						offset), gfp_mask, vma, addr))
 			break;
-		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Pages to read around a fault at @pfn, after one at @prev_pfn: two more
+ * than were used of the last window, rounded up to a power of two, or
+ * just the faulting page when nothing was used and the fault is not next
+ * to the last one.  The window halves at most per fault.
+ */
+static unsigned int swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+			unsigned int hits, unsigned int max_win,
+			unsigned int prev_win)
+{
+	unsigned int win = hits + 2;
+
+	if (win == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else {
+		win = roundup_pow_of_two(win);
+	}
+	if (win > max_win)
+		win = max_win;
+	if (win < prev_win / 2)
+		win = prev_win / 2;
+	return win;
+}
+
+/**
+ * swap_vma_readahead - swap in the pages mapped around a faulting address
+ * @entry: swap entry of the faulting page
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the address belongs to
+ * @addr: faulting address
+ * @pmd: pmd covering @addr
+ *
+ * Returns the struct page for @entry, after queueing reads for the swap
+ * entries of neighbouring ptes in the same vma and page table.  Reading
+ * goes forward from the fault when the last one in this vma was just
+ * below it, backward when it was just above, and around it otherwise.
+ * At most 1 << page_cluster pages are read.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swap_vma_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			pmd_t *pmd)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING], *pte;
+	unsigned long ra_val, pfn, prev_pfn, start, end, before, after;
+	unsigned int max_win, win, i;
+	struct page *page;
+
+	max_win = 1 << min_t(unsigned int, page_cluster,
+			     SWAP_RA_ORDER_CEILING);
+	pfn = addr >> PAGE_SHIFT;
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = SWAP_RA_ADDR(ra_val) >> PAGE_SHIFT;
+	win = swap_ra_window(prev_pfn, pfn, SWAP_RA_HITS(ra_val), max_win,
+			     SWAP_RA_WIN(ra_val));
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+
+	/* The faulting page goes first, the rest is only a guess */
+	page = read_swap_cache_async(entry, gfp_mask, vma, addr);
+	if (!page || win <= 1)
+		return page;
+
+	if (pfn == prev_pfn + 1) {
+		before = 0;
+		after = win;
+	} else if (pfn == prev_pfn - 1) {
+		before = win - 1;
+		after = 1;
+	} else {
+		before = (win - 1) / 2;
+		after = win - before;
+	}
+	start = max3(pfn - min(before, pfn), vma->vm_start >> PAGE_SHIFT,
+		     (addr & PMD_MASK) >> PAGE_SHIFT);
+	end = min3(pfn + after, vma->vm_end >> PAGE_SHIFT,
+		   ((addr & PMD_MASK) + PMD_SIZE) >> PAGE_SHIFT);
+
+	/* Copy the ptes, as the reads below may sleep */
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < end - start; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0; i < end - start; i++) {
+		swp_entry_t ra_entry;
+
+		if (start + i == pfn)
+			continue;
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		ra_entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(ra_entry)))
+			continue;
+		swap_readahead_page(ra_entry, gfp_mask, vma,
+				    (start + i) << PAGE_SHIFT);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+	return page;
+}
@@ -1532,6 +1532,37 @@ EXPORT_SYMBOL(vmap);
 static void *__vmalloc_node(unsigned long size, unsigned long align,
 			    gfp_t gfp_mask, pgprot_t prot,
 			    int node, void *caller);
+/*
+ * Start @pages with runs of 1 << vmap_large_order contiguous pages, for
+ * as long as the page allocator has them to spare without trying hard,
+ * and split them for __vunmap() to free page by page.  Returns how many
+ * pages that made.
+ */
+static unsigned int vmalloc_large_runs(struct page **pages,
+				       unsigned int nr_pages, gfp_t gfp_mask,
+				       int node)
+{
+	const int order = vmap_large_order;
+	unsigned int i, j;
+
+	gfp_mask |= __GFP_NOWARN | __GFP_NORETRY | __GFP_NO_KSWAPD;
+	for (i = 0; order && i + (1U << order) <= nr_pages; i += 1U << order) {
+		struct page *page;
+
+		if (node < 0)
+			page = alloc_pages(gfp_mask, order);
+		else
+			page = alloc_pages_node(node, gfp_mask, order);
+		if (!page)
+			break;
+
+		split_page(page, order);
+		for (j = 0; j < 1U << order; j++)
+			pages[i + j] = page + j;
+	}
+	return i;
+}
+
 static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 				 pgprot_t prot, int node, void *caller)
 {
@@ -1560,7 +1591,21 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 		return NULL;
 	}
 
-	for (i = 0; i < area->nr_pages; i++) {
+	/*
+	 * Take large runs for an area aligned for them, then as many pages
+	 * as the per-cpu lists will give in one go, and fall back to one at
+	 * a time for the rest.  On NUMA, memory for no particular node is
+	 * left to alloc_page(), to follow the mempolicy.
+	 */
+	i = 0;
+	if (vmap_large_order &&
+	    IS_ALIGNED((unsigned long)area->addr, PAGE_SIZE << vmap_large_order))
+		i = vmalloc_large_runs(pages, area->nr_pages, gfp_mask, node);
+	if (node >= 0 || !NUMA_BUILD)
+		i = alloc_pages_bulk_array_node(gfp_mask | __GFP_NOWARN, node,
+						area->nr_pages, pages);
+
+	for (; i < area->nr_pages; i++) {
 		struct page *page;
 		gfp_t tmp_mask = gfp_mask | __GFP_NOWARN;
 
@@ -1579,6 +1624,8 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 
 	if (map_vm_area(area, prot, &pages))
 		goto fail;
+	vmap_large_pages((unsigned long)area->addr,
+			 (unsigned long)area->addr + area->size - PAGE_SIZE);
 	return area->addr;
 
 fail:
@@ -1616,6 +1663,11 @@ void *__vmalloc_node_range(unsigned long size, unsigned long align,
 	if (!size || (size >> PAGE_SHIFT) > totalram_pages)
 		return NULL;
 
+	/* Room for at least one large run: align the area for it */
+	if (vmap_large_order && size >= PAGE_SIZE << vmap_large_order &&
+	    align < PAGE_SIZE << vmap_large_order)
+		align = PAGE_SIZE << vmap_large_order;
+
 	area = __get_vm_area_node(size, align, VM_ALLOC, start, end, node,
 				  gfp_mask, caller);
 
@@ -43,6 +43,7 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/mmu_notifier.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -522,6 +523,7 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 
 	if (PageSwapCache(page)) {
 		swp_entry_t swap = { .val = page_private(page) };
+		workingset_eviction(mapping, swap.val);
 		__delete_from_swap_cache(page);
 		spin_unlock_irq(&mapping->tree_lock);
 		swapcache_free(swap, page);
@@ -530,6 +532,7 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 
 		freepage = mapping->a_ops->freepage;
 
+		workingset_eviction(mapping, page->index);
 		__delete_from_page_cache(page);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
@@ -637,6 +640,211 @@ redo:
 	put_page(page);		/* drop ref from isolate */
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The lru_gen reclaim mode, selected with lru_gen=on on the command line.
+ *
+ * Instead of an rmap walk for every mapped page reclaim looks at, the
+ * page tables of all mms are walked every LRU_GEN_INTERVAL for accessed
+ * bits, and the pages found accessed are marked as generation 0 in
+ * page->flags (see page_lru_gen()).  Reclaim takes that mark as the
+ * reference and otherwise ages a mapped page by one generation per trip
+ * around the inactive list, evicting it only once it is the oldest.
+ * A walk clears the accessed bits of a whole page table under one lock
+ * and one TLB flush, and costs nothing per page it does not find.
+ *
+ * Only kswapd walks, so only global reclaim can rely on the marks: limit
+ * reclaim of a memory cgroup does not wake kswapd and keeps using the
+ * rmap, see lru_gen_reclaim().
+ */
+int lru_gen_enabled __read_mostly;
+
+static int __init setup_lru_gen(char *str)
+{
+	if (!strcmp(str, "on") || !strcmp(str, "1"))
+		lru_gen_enabled = 1;
+	else if (!strcmp(str, "off") || !strcmp(str, "0"))
+		lru_gen_enabled = 0;
+	else
+		return 0;
+	return 1;
+}
+__setup("lru_gen=", setup_lru_gen);
+
+#define LRU_GEN_INTERVAL	(HZ / 2)
+
+/*
+ * An mm is on the list from the time it gets its context until its last
+ * mm_count reference goes, so a walker holding mm_count can leave the list
+ * lock and come back to the mm's entry.
+ */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static DEFINE_MUTEX(lru_gen_walk_mutex);
+static unsigned long lru_gen_walked;
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+struct lru_gen_walk {
+	struct vm_area_struct *vma;
+	unsigned long nr_young;
+};
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr,
+			    unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *lgw = walk->private;
+	struct vm_area_struct *vma = lgw->vma;
+	unsigned long start = addr;
+	pte_t *orig_pte, *pte;
+	spinlock_t *ptl;
+	int flush = 0;
+
+	/* Huge pages are left to page_referenced(), see lru_gen_referenced() */
+	if (pmd_trans_huge(*pmd) || pmd_none_or_clear_bad(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+		int young;
+
+		if (!pte_present(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || !PageLRU(page))
+			continue;
+
+		young = ptep_test_and_clear_young(vma, addr, pte);
+		flush |= young;
+		young |= mmu_notifier_clear_flush_young(walk->mm, addr);
+		if (young) {
+			set_page_lru_gen(page, 0);
+			lgw->nr_young++;
+		}
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	if (flush)
+		flush_tlb_range(vma, start, end);
+	cond_resched();
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, struct lru_gen_walk *lgw)
+{
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_walk_pmd,
+		.mm = mm,
+		.private = lgw,
+	};
+	struct vm_area_struct *vma;
+
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_LOCKED | VM_IO | VM_PFNMAP | VM_HUGETLB))
+			continue;
+		lgw->vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Walk the page tables of every mm for accessed bits, unless that was
+ * done less than LRU_GEN_INTERVAL ago or is being done right now.  Only
+ * kswapd does this: the walk may drop the last reference to an mm, which
+ * direct reclaim under filesystem locks must not do.
+ */
+static void lru_gen_age(void)
+{
+	struct lru_gen_walk lgw = { .nr_young = 0 };
+	struct mm_struct *mm, *prev = NULL;
+	struct list_head *pos;
+
+	if (time_before(jiffies, lru_gen_walked + LRU_GEN_INTERVAL) ||
+	    !mutex_trylock(&lru_gen_walk_mutex))
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	pos = lru_gen_mm_list.next;
+	while (pos != &lru_gen_mm_list) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		pos = pos->next;
+		if (!atomic_inc_not_zero(&mm->mm_count))
+			continue;
+		spin_unlock(&lru_gen_mm_lock);
+
+		if (prev)
+			mmdrop(prev);
+		prev = mm;
+		if (atomic_inc_not_zero(&mm->mm_users)) {
+			lru_gen_walk_mm(mm, &lgw);
+			mmput(mm);
+			count_vm_event(LRU_GEN_WALK);
+		}
+
+		spin_lock(&lru_gen_mm_lock);
+		pos = mm->lru_gen_list.next;
+	}
+	spin_unlock(&lru_gen_mm_lock);
+	if (prev)
+		mmdrop(prev);
+
+	count_vm_events(LRU_GEN_YOUNG, lgw.nr_young);
+	lru_gen_walked = jiffies;
+	mutex_unlock(&lru_gen_walk_mutex);
+}
+
+/*
+ * The reference the last walk found, if any; transparent huge pages are
+ * not aged by the walk and still go through the rmap.
+ */
+static int lru_gen_referenced(struct page *page, int is_locked,
+			      struct scan_control *sc, unsigned long *vm_flags)
+{
+	if (unlikely(PageTransHuge(page)))
+		return page_referenced(page, is_locked, sc->mem_cgroup,
+				       vm_flags);
+
+	*vm_flags = 0;
+	if (page_lru_gen(page))
+		return 0;
+	set_page_lru_gen(page, 1);
+	return 1;
+}
+#else
+static inline void lru_gen_age(void)
+{
+}
+
+static inline int lru_gen_referenced(struct page *page, int is_locked,
+				     struct scan_control *sc,
+				     unsigned long *vm_flags)
+{
+	return 0;
+}
+#endif
+
+/* Whether @sc can go by the generations the kswapd walks left behind */
+static inline int lru_gen_reclaim(struct scan_control *sc)
+{
+	return lru_gen_enabled && scanning_global_lru(sc);
+}
+
 enum page_references {
 	PAGEREF_RECLAIM,
 	PAGEREF_RECLAIM_CLEAN,
@@ -650,7 +858,11 @@ static enum page_references page_check_references(struct page *page,
 	int referenced_ptes, referenced_page;
 	unsigned long vm_flags;
 
-	referenced_ptes = page_referenced(page, 1, sc->mem_cgroup, &vm_flags);
+	if (lru_gen_reclaim(sc))
+		referenced_ptes = lru_gen_referenced(page, 1, sc, &vm_flags);
+	else
+		referenced_ptes = page_referenced(page, 1, sc->mem_cgroup,
+						  &vm_flags);
 	referenced_page = TestClearPageReferenced(page);
 
 	/* Lumpy reclaim - ignore references */
@@ -689,6 +901,17 @@ static enum page_references page_check_references(struct page *page,
 		return PAGEREF_KEEP;
 	}
 
+	/*
+	 * Without an rmap walk a mapped page is only known to be idle
+	 * since the last page table walk: let it age to the oldest
+	 * generation, over as many walks, before it goes.
+	 */
+	if (lru_gen_reclaim(sc) && page_mapped(page) &&
+	    page_lru_gen(page) < LRU_GEN_OLDEST) {
+		set_page_lru_gen(page, page_lru_gen(page) + 1);
+		return PAGEREF_KEEP;
+	}
+
 	/* Reclaim if clean, defer dirty pages to writeback */
 	if (referenced_page && !PageSwapBacked(page))
 		return PAGEREF_RECLAIM_CLEAN;
@@ -1582,7 +1805,21 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 			continue;
 		}
 
-		if (page_referenced(page, 0, sc->mem_cgroup, &vm_flags)) {
+		if (lru_gen_enabled) {
+			/*
+			 * The walk does not tell VM_EXEC mappings apart, so
+			 * every mapped file page found in use gets another
+			 * trip around the active list.
+			 */
+			if (lru_gen_referenced(page, 0, sc, &vm_flags)) {
+				nr_rotated += hpage_nr_pages(page);
+				if (page_mapped(page) &&
+				    page_is_file_cache(page)) {
+					list_add(&page->lru, &l_active);
+					continue;
+				}
+			}
+		} else if (page_referenced(page, 0, sc->mem_cgroup, &vm_flags)) {
 			nr_rotated += hpage_nr_pages(page);
 			/*
 			 * Identify referenced, file-backed active pages and
@@ -2422,6 +2659,8 @@ loop_again:
 	sc.nr_reclaimed = 0;
 	sc.may_writepage = !laptop_mode;
 	count_vm_event(PAGEOUTRUN);
+	if (lru_gen_enabled)
+		lru_gen_age();
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
 		unsigned long lru_pages = 0;
@@ -2793,8 +3032,13 @@ static int kswapd(void *p)
 		 * after returning from the refrigerator
 		 */
 		if (!ret) {
+			u64 runtime = task_sched_runtime(tsk);
+
 			trace_mm_vmscan_kswapd_wake(pgdat->node_id, order);
 			order = balance_pgdat(pgdat, order, &classzone_idx);
+			count_vm_events(KSWAPD_CPU_US,
+				div_u64(task_sched_runtime(tsk) - runtime,
+					NSEC_PER_USEC));
 		}
 	}
 	return 0;
@@ -0,0 +1,99 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Refault estimate for comparing reclaim modes
+ *
+ * A refault is a page that reclaim evicted and that had to be read in
+ * again soon after: the more of those, the worse reclaim picked what to
+ * evict.  Nothing of an evicted page is kept in its mapping, so instead
+ * eviction sets a bit for (mapping, index) in a bitmap, and a page added
+ * to the page cache or swap cache whose bit is set counts as a refault.
+ *
+ * Two bitmaps take turns.  Eviction sets bits in the current one while
+ * clearing a slice of the other, so that the other is empty by the time
+ * half of RAM has been evicted and they swap roles; "soon" thus means
+ * within the last half to whole RAM's worth of evictions.  Unrelated
+ * pages that hash to the same bit, and races between eviction and the
+ * clearing, make the count an estimate, which is good enough to compare
+ * two runs of the same workload.
+ */
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/hash.h>
+#include <linux/bitmap.h>
+#include <linux/log2.h>
+#include <linux/vmalloc.h>
+#include <linux/vmstat.h>
+#include <linux/init.h>
+#include <linux/module.h>
+
+/* Bits per page of RAM, and bits cleared in the other map per eviction */
+#define WORKINGSET_MAP_SHIFT	3
+#define WORKINGSET_CLEAR_SHIFT	4
+
+static unsigned long *workingset_maps[2];
+static unsigned int workingset_bits;	/* log2 of the bits per map */
+static atomic_long_t workingset_clock;
+
+static unsigned long workingset_hash(struct address_space *mapping,
+				     unsigned long index)
+{
+	unsigned long key = hash_long((unsigned long)mapping, BITS_PER_LONG);
+
+	return hash_long(key ^ index, workingset_bits);
+}
+
+void workingset_eviction(struct address_space *mapping, unsigned long index)
+{
+	unsigned int period = workingset_bits - WORKINGSET_CLEAR_SHIFT;
+	unsigned long clock;
+	int cur;
+
+	if (unlikely(!workingset_maps[0]))
+		return;
+
+	clock = atomic_long_inc_return(&workingset_clock);
+	cur = (clock >> period) & 1;
+	set_bit(workingset_hash(mapping, index), workingset_maps[cur]);
+	bitmap_clear(workingset_maps[!cur],
+		     (clock & ((1UL << period) - 1)) << WORKINGSET_CLEAR_SHIFT,
+		     1 << WORKINGSET_CLEAR_SHIFT);
+}
+
+void workingset_refault(struct address_space *mapping, unsigned long index)
+{
+	unsigned long hash;
+
+	if (unlikely(!workingset_maps[0]))
+		return;
+
+	hash = workingset_hash(mapping, index);
+	if (test_and_clear_bit(hash, workingset_maps[0]) |
+	    test_and_clear_bit(hash, workingset_maps[1]))
+		count_vm_event(WORKINGSET_REFAULT);
+}
+
+static int __init workingset_init(void)
+{
+	unsigned long *maps;
+	unsigned int bits;
+
+	bits = ilog2(roundup_pow_of_two(totalram_pages)) +
+	       WORKINGSET_MAP_SHIFT;
+	if (bits < WORKINGSET_CLEAR_SHIFT + ilog2(BITS_PER_LONG))
+		bits = WORKINGSET_CLEAR_SHIFT + ilog2(BITS_PER_LONG);
+
+	maps = vzalloc(2 * BITS_TO_LONGS(1UL << bits) * sizeof(long));
+	if (!maps) {
+		printk(KERN_WARNING "workingset: no memory for refault "
+		       "tracking\n");
+		return -ENOMEM;
+	}
+
+	workingset_bits = bits;
+	workingset_maps[1] = maps + BITS_TO_LONGS(1UL << bits);
+	smp_wmb();
+	workingset_maps[0] = maps;
+	return 0;
+}
+module_init(workingset_init)
@@ -1443,7 +1443,7 @@ static int ax25_sendmsg(struct kiocb *iocb, struct socket *sock,
 	size_t size;
 	int lv, err, addr_len = msg->msg_namelen;
 
-	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_EOR|MSG_CMSG_COMPAT))
+	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_EOR|MSG_BATCH|MSG_CMSG_COMPAT))
 		return -EINVAL;
 
 	lock_sock(sk);
@@ -3239,7 +3239,7 @@ int netif_receive_skb(struct sk_buff *skb)
 		return NET_RX_SUCCESS;
 
 #ifdef CONFIG_RPS
-	{
+	if (!__this_cpu_read(softnet_data.in_backlog_gro)) {
 		struct rps_dev_flow voidflow, *rflow = &voidflow;
 		int cpu, ret;
 
@@ -3257,9 +3257,8 @@ int netif_receive_skb(struct sk_buff *skb)
 
 		return ret;
 	}
-#else
-	return __netif_receive_skb(skb);
 #endif
+	return __netif_receive_skb(skb);
 }
 EXPORT_SYMBOL(netif_receive_skb);
 
@@ -3622,6 +3621,48 @@ static void net_rps_action_and_irq_enable(struct softnet_data *sd)
 		local_irq_enable();
 }
 
+/*
+ * Software GRO for drivers that use netif_rx() rather than NAPI and set
+ * IFF_RX_BACKLOG_GRO: their packets are aggregated here, as
+ * napi_gro_receive() does for NAPI drivers, using the backlog's own
+ * napi_struct. What GRO hands on was already steered by netif_rx(), so
+ * RPS is kept from queueing it to a backlog again.
+ */
+static void backlog_receive_skb(struct softnet_data *sd, struct sk_buff *skb)
+{
+	if (!(skb->dev->priv_flags & IFF_RX_BACKLOG_GRO)) {
+		__netif_receive_skb(skb);
+		return;
+	}
+
+#ifdef CONFIG_RPS
+	sd->in_backlog_gro = true;
+	napi_gro_receive(&sd->backlog, skb);
+	sd->in_backlog_gro = false;
+#else
+	napi_gro_receive(&sd->backlog, skb);
+#endif
+}
+
+/*
+ * Held segments never outlive the process_backlog() run that queued them:
+ * they are flushed when it returns, whether the queue ran empty or the
+ * quota ran out.
+ */
+static void backlog_gro_flush(struct softnet_data *sd)
+{
+	if (!sd->backlog.gro_list)
+		return;
+
+#ifdef CONFIG_RPS
+	sd->in_backlog_gro = true;
+	napi_gro_flush(&sd->backlog);
+	sd->in_backlog_gro = false;
+#else
+	napi_gro_flush(&sd->backlog);
+#endif
+}
+
 static int process_backlog(struct napi_struct *napi, int quota)
 {
 	int work = 0;
@@ -3644,11 +3685,12 @@ static int process_backlog(struct napi_struct *napi, int quota)
 
 		while ((skb = __skb_dequeue(&sd->process_queue))) {
 			local_irq_enable();
-			__netif_receive_skb(skb);
+			backlog_receive_skb(sd, skb);
 			local_irq_disable();
 			input_queue_head_incr(sd);
 			if (++work >= quota) {
 				local_irq_enable();
+				backlog_gro_flush(sd);
 				return work;
 			}
 		}
@@ -3675,6 +3717,7 @@ static int process_backlog(struct napi_struct *napi, int quota)
 		rps_unlock(sd);
 	}
 	local_irq_enable();
+	backlog_gro_flush(sd);
 
 	return work;
 }
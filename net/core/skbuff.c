@@ -40,6 +40,7 @@
 #include <linux/types.h>
 #include <linux/kernel.h>
 #include <linux/kmemcheck.h>
+#include <linux/cpu.h>
 #include <linux/mm.h>
 #include <linux/interrupt.h>
 #include <linux/in.h>
@@ -405,6 +406,8 @@ static void skb_release_all(struct sk_buff *skb)
 	skb_release_data(skb);
 }
 
+static void skb_pool_recycle(struct sk_buff *skb);
+
 /**
  *	__kfree_skb - private function
  *	@skb: buffer
@@ -416,6 +419,10 @@ static void skb_release_all(struct sk_buff *skb)
 
 void __kfree_skb(struct sk_buff *skb)
 {
+	if (skb->pool) {
+		skb_pool_recycle(skb);
+		return;
+	}
 	skb_release_all(skb);
 	kfree_skbmem(skb);
 }
@@ -488,7 +495,7 @@ bool skb_recycle_check(struct sk_buff *skb, int skb_size)
 	if (skb_end_pointer(skb) - skb->head < skb_size)
 		return false;
 
-	if (skb_shared(skb) || skb_cloned(skb))
+	if (skb_shared(skb) || skb_cloned(skb) || skb->pool)
 		return false;
 
 	skb_release_head_state(skb);
@@ -505,6 +512,238 @@ bool skb_recycle_check(struct sk_buff *skb, int skb_size)
 }
 EXPORT_SYMBOL(skb_recycle_check);
 
+/*
+ * Receive buffer pools: a driver that allocates fixed size receive
+ * buffers can take them from a pool, to which they return when the stack
+ * frees them, instead of going through the slab allocator twice per
+ * packet. Each CPU has its own list, only ever touched by that CPU with
+ * interrupts disabled, so neither allocation nor recycling takes a lock.
+ *
+ * Every skb carrying a ->pool pointer, on a list or in flight, holds a
+ * reference to the pool, so that the pool outlives the last of them.
+ */
+struct skb_pool_cpu {
+	struct sk_buff_head	list;
+	struct skb_pool_stats	stats;
+};
+
+struct skb_pool {
+	unsigned int		size;
+	unsigned int		depth;
+	bool			dead;
+	atomic_t		refcnt;
+	struct skb_pool_cpu __percpu *cpu;
+};
+
+static void skb_pool_put(struct skb_pool *pool)
+{
+	if (atomic_dec_and_test(&pool->refcnt)) {
+		free_percpu(pool->cpu);
+		kfree(pool);
+	}
+}
+
+/* Release an skb whose head state has already been released */
+static void skb_pool_release(struct sk_buff *skb)
+{
+	struct skb_pool *pool = skb->pool;
+
+	skb_release_data(skb);
+	kfree_skbmem(skb);
+	skb_pool_put(pool);
+}
+
+static void skb_pool_recycle(struct sk_buff *skb)
+{
+	struct skb_pool *pool = skb->pool;
+	struct skb_shared_info *shinfo;
+	struct skb_pool_cpu *pc;
+	unsigned long flags;
+
+	skb_release_head_state(skb);
+
+	/* Pool skbs are never fclones, so only the data can be shared */
+	if (skb_is_nonlinear(skb) || skb->cloned ||
+	    skb_end_pointer(skb) - skb->head < pool->size) {
+		irqsafe_cpu_inc(pool->cpu->stats.recycle_reject);
+		skb_pool_release(skb);
+		return;
+	}
+
+	shinfo = skb_shinfo(skb);
+	memset(shinfo, 0, offsetof(struct skb_shared_info, dataref));
+	atomic_set(&shinfo->dataref, 1);
+
+	memset(skb, 0, offsetof(struct sk_buff, tail));
+	skb->pool = pool;
+	atomic_set(&skb->users, 1);
+	skb->data = skb->head;
+	skb_reset_tail_pointer(skb);
+#ifdef NET_SKBUFF_DATA_USES_OFFSET
+	skb->mac_header = ~0U;
+#endif
+
+	local_irq_save(flags);
+	pc = this_cpu_ptr(pool->cpu);
+	if (!pool->dead && skb_queue_len(&pc->list) < pool->depth) {
+		__skb_queue_head(&pc->list, skb);
+		pc->stats.recycled++;
+		skb = NULL;
+	} else {
+		pc->stats.recycle_full++;
+	}
+	local_irq_restore(flags);
+
+	if (skb)
+		skb_pool_release(skb);
+}
+
+/**
+ *	skb_pool_create - create a receive buffer pool
+ *	@size: data size of the buffers, as would be passed to netdev_alloc_skb()
+ *	@depth: maximum number of free buffers kept per CPU
+ *
+ *	Returns the new pool, or %NULL if there was no memory for it.
+ */
+struct skb_pool *skb_pool_create(unsigned int size, unsigned int depth)
+{
+	struct skb_pool *pool;
+	int cpu;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->cpu = alloc_percpu(struct skb_pool_cpu);
+	if (!pool->cpu) {
+		kfree(pool);
+		return NULL;
+	}
+
+	for_each_possible_cpu(cpu)
+		__skb_queue_head_init(&per_cpu_ptr(pool->cpu, cpu)->list);
+
+	pool->size = SKB_DATA_ALIGN(size + NET_SKB_PAD);
+	pool->depth = depth;
+	atomic_set(&pool->refcnt, 1);
+
+	return pool;
+}
+EXPORT_SYMBOL(skb_pool_create);
+
+static void skb_pool_drain(struct skb_pool *pool, int cpu)
+{
+	struct skb_pool_cpu *pc = per_cpu_ptr(pool->cpu, cpu);
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(&pc->list)))
+		skb_pool_release(skb);
+}
+
+static void skb_pool_drain_local(void *data)
+{
+	skb_pool_drain(data, smp_processor_id());
+}
+
+/**
+ *	skb_pool_destroy - destroy a receive buffer pool
+ *	@pool: pool to destroy
+ *
+ *	Frees the buffers held by the pool. Those still in use are freed to
+ *	the slab allocator when the stack is done with them, and the pool
+ *	itself goes away with the last of them. Must not be called from
+ *	atomic context.
+ */
+void skb_pool_destroy(struct skb_pool *pool)
+{
+	int cpu;
+
+	pool->dead = true;
+
+	/*
+	 * Each CPU drains its own list, with interrupts disabled, which is
+	 * how the list is otherwise accessed. After that the CPU sees
+	 * ->dead and puts nothing more on it.
+	 */
+	get_online_cpus();
+	on_each_cpu(skb_pool_drain_local, pool, 1);
+	for_each_possible_cpu(cpu)
+		if (!cpu_online(cpu))
+			skb_pool_drain(pool, cpu);
+	put_online_cpus();
+
+	skb_pool_put(pool);
+}
+EXPORT_SYMBOL(skb_pool_destroy);
+
+/**
+ *	skb_pool_alloc - allocate a receive buffer from a pool
+ *	@pool: pool to allocate from
+ *	@dev: network device to receive on
+ *	@gfp_mask: allocation mask, for when the pool is empty
+ *
+ *	Like __netdev_alloc_skb() for the size the pool was created with,
+ *	but the skb comes from, and returns to, the pool if it can. May be
+ *	called from interrupt context.
+ *
+ *	%NULL is returned if the pool was empty and there is no free memory.
+ */
+struct sk_buff *skb_pool_alloc(struct skb_pool *pool, struct net_device *dev,
+			       gfp_t gfp_mask)
+{
+	struct skb_pool_cpu *pc;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pc = this_cpu_ptr(pool->cpu);
+	skb = __skb_dequeue(&pc->list);
+	if (skb)
+		pc->stats.alloc_hit++;
+	else
+		pc->stats.alloc_miss++;
+	local_irq_restore(flags);
+
+	if (!skb) {
+		skb = __alloc_skb(pool->size, gfp_mask, 0, NUMA_NO_NODE);
+		if (unlikely(!skb))
+			return NULL;
+
+		atomic_inc(&pool->refcnt);
+		skb->pool = pool;
+	}
+
+	skb_reserve(skb, NET_SKB_PAD);
+	skb->dev = dev;
+
+	return skb;
+}
+EXPORT_SYMBOL(skb_pool_alloc);
+
+/**
+ *	skb_pool_get_stats - sum up the counters of a receive buffer pool
+ *	@pool: pool
+ *	@stats: where to store the sums
+ */
+void skb_pool_get_stats(struct skb_pool *pool, struct skb_pool_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for_each_possible_cpu(cpu) {
+		const struct skb_pool_stats *s =
+			&per_cpu_ptr(pool->cpu, cpu)->stats;
+
+		stats->alloc_hit += s->alloc_hit;
+		stats->alloc_miss += s->alloc_miss;
+		stats->recycled += s->recycled;
+		stats->recycle_full += s->recycle_full;
+		stats->recycle_reject += s->recycle_reject;
+	}
+}
+EXPORT_SYMBOL(skb_pool_get_stats);
+
 static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 {
 	new->tstamp		= old->tstamp;
@@ -630,6 +869,9 @@ struct sk_buff *skb_clone(struct sk_buff *skb, gfp_t gfp_mask)
 		n->fclone = SKB_FCLONE_UNAVAILABLE;
 	}
 
+	/* The data belongs to the original: a clone is never recycled */
+	n->pool = NULL;
+
 	return __skb_clone(n, skb);
 }
 EXPORT_SYMBOL(skb_clone);
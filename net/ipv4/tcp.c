@@ -363,6 +363,43 @@ static int retrans_to_secs(u8 retrans, int timeout, int rto_max)
 	return period;
 }
 
+/*
+ * Loopback friends: once both ends of a loopback connection know each
+ * other (see tcp_v4_make_friends()), data is queued straight to the
+ * peer's receive queue instead of passing through IP, the loopback
+ * device and the receive softirq. The sender's view of the receive
+ * buffer replaces the advertised window.
+ */
+static inline int tcp_friend_receiving(struct sock *friend)
+{
+	return ((1 << friend->sk_state) &
+		(TCPF_ESTABLISHED | TCPF_FIN_WAIT1 | TCPF_FIN_WAIT2)) &&
+	       !sock_flag(friend, SOCK_DEAD) &&
+	       !(friend->sk_shutdown & RCV_SHUTDOWN);
+}
+
+static inline int tcp_friend_room(struct sock *friend)
+{
+	return atomic_read(&friend->sk_rmem_alloc) + friend->sk_backlog.len <
+	       friend->sk_rcvbuf;
+}
+
+/* Called without the socket lock, the friend is read under RCU like a
+ * hash table lookup would be: TCP sockets are SLAB_DESTROY_BY_RCU.
+ */
+static int tcp_friend_writable(struct sock *sk)
+{
+	struct sock *friend;
+	int ret = 1;
+
+	rcu_read_lock();
+	friend = ACCESS_ONCE(tcp_sk(sk)->friend);
+	if (friend && tcp_friend_receiving(friend))
+		ret = tcp_friend_room(friend);
+	rcu_read_unlock();
+	return ret;
+}
+
 /*
  *	Wait for a TCP event.
  *
@@ -435,7 +472,8 @@ unsigned int tcp_poll(struct file *file, struct socket *sock, poll_table *wait)
 			mask |= POLLIN | POLLRDNORM;
 
 		if (!(sk->sk_shutdown & SEND_SHUTDOWN)) {
-			if (sk_stream_wspace(sk) >= sk_stream_min_wspace(sk)) {
+			if (sk_stream_wspace(sk) >= sk_stream_min_wspace(sk) &&
+			    tcp_friend_writable(sk)) {
 				mask |= POLLOUT | POLLWRNORM;
 			} else {  /* send SIGIO later */
 				set_bit(SOCK_ASYNC_NOSPACE,
@@ -446,7 +484,8 @@ unsigned int tcp_poll(struct file *file, struct socket *sock, poll_table *wait)
 				 * wspace test but before the flags are set,
 				 * IO signal will be lost.
 				 */
-				if (sk_stream_wspace(sk) >= sk_stream_min_wspace(sk))
+				if (sk_stream_wspace(sk) >= sk_stream_min_wspace(sk) &&
+				    tcp_friend_writable(sk))
 					mask |= POLLOUT | POLLWRNORM;
 			}
 		} else
@@ -911,6 +950,229 @@ static inline int select_size(struct sock *sk, int sg)
 	return tmp;
 }
 
+/*
+ * Wake writers on @friend waiting in tcp_friend_wait() or poll().  We do
+ * not own @friend's socket lock, so sk_callback_lock keeps sock_orphan()
+ * from freeing its struct socket under sk_wake_async().
+ */
+static void tcp_friend_wake(struct sock *friend)
+{
+	struct socket_wq *wq;
+
+	read_lock_bh(&friend->sk_callback_lock);
+	if (!sock_flag(friend, SOCK_DEAD)) {
+		rcu_read_lock();
+		wq = rcu_dereference(friend->sk_wq);
+		if (wq_has_sleeper(wq))
+			wake_up_interruptible_poll(&wq->wait, POLLOUT |
+						   POLLWRNORM | POLLWRBAND);
+		rcu_read_unlock();
+		sk_wake_async(friend, SOCK_WAKE_SPACE, POLL_OUT);
+	}
+	read_unlock_bh(&friend->sk_callback_lock);
+}
+
+/* Called when @sk enters TCP_CLOSE, after the state has been stored */
+static void tcp_friend_release(struct sock *sk)
+{
+	struct sock *friend = xchg(&tcp_sk(sk)->friend, NULL);
+
+	if (friend) {
+		tcp_friend_wake(friend);
+		sock_put(friend);
+	}
+}
+
+/*
+ * Data may only bypass the stack while nothing of ours is queued or in
+ * flight, so that the friend's rcv_nxt is our snd_nxt and ordering with
+ * segments sent the normal way is kept.
+ */
+static int tcp_friend_usable(struct sock *sk, struct sock *friend, int flags)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	return tp->friend == friend && !(flags & MSG_OOB) &&
+	       ((1 << sk->sk_state) & (TCPF_ESTABLISHED | TCPF_CLOSE_WAIT)) &&
+	       !tcp_write_queue_head(sk) && tp->snd_una == tp->snd_nxt &&
+	       !sk->sk_err && !(sk->sk_shutdown & SEND_SHUTDOWN) &&
+	       tcp_friend_receiving(friend);
+}
+
+static int tcp_friend_wait(struct sock *sk, struct sock *friend, int flags,
+			   long *timeo)
+{
+	DEFINE_WAIT(wait);
+	int err = 0;
+
+	while (!tcp_friend_room(friend)) {
+		if (!*timeo) {
+			err = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			err = sock_intr_errno(*timeo);
+			break;
+		}
+		prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
+		sk_wait_event(sk, timeo, tcp_friend_room(friend) ||
+				  !tcp_friend_usable(sk, friend, flags));
+		finish_wait(sk_sleep(sk), &wait);
+		if (!tcp_friend_usable(sk, friend, flags))
+			break;
+	}
+	return err;
+}
+
+/* Build an skb carrying @size bytes from the user, laid out like one
+ * that came in from the network: an all-zero TCP header before the data.
+ */
+static struct sk_buff *tcp_friend_alloc_skb(struct sock *sk,
+					    struct msghdr *msg, int size,
+					    int *err)
+{
+	int linear = size <= SKB_MAX_HEAD(MAX_TCP_HEADER) ? size : 0;
+	struct sk_buff *skb;
+	int i;
+
+	*err = -ENOBUFS;
+	skb = alloc_skb(MAX_TCP_HEADER + linear, sk->sk_allocation);
+	if (!skb)
+		return NULL;
+	skb_reserve(skb, MAX_TCP_HEADER);
+	skb_push(skb, sizeof(struct tcphdr));
+	memset(skb->data, 0, sizeof(struct tcphdr));
+	skb_reset_transport_header(skb);
+	__skb_pull(skb, sizeof(struct tcphdr));
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+
+	if (linear) {
+		*err = memcpy_fromiovec(skb_put(skb, size), msg->msg_iov, size);
+		if (*err)
+			goto fail;
+		return skb;
+	}
+
+	for (i = 0; size; i++) {
+		int copy = min_t(int, size, PAGE_SIZE);
+		struct page *page = alloc_page(sk->sk_allocation);
+
+		*err = -ENOBUFS;
+		if (!page)
+			goto fail;
+		skb_fill_page_desc(skb, i, page, 0, copy);
+		skb->len += copy;
+		skb->data_len += copy;
+		skb->truesize += PAGE_SIZE;
+
+		*err = memcpy_fromiovec(page_address(page), msg->msg_iov, copy);
+		if (*err)
+			goto fail;
+		size -= copy;
+	}
+	return skb;
+
+fail:
+	kfree_skb(skb);
+	return NULL;
+}
+
+static void tcp_friend_deliver(struct sock *sk, struct sock *friend,
+			       struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	int len = skb->len;
+
+	TCP_SKB_CB(skb)->seq = tp->snd_nxt;
+	TCP_SKB_CB(skb)->end_seq = tp->snd_nxt + len;
+	TCP_SKB_CB(skb)->flags = TCPHDR_ACK | TCPHDR_PSH;
+	TCP_SKB_CB(skb)->sacked = TCPCB_FRIEND;
+
+	local_bh_disable();
+	bh_lock_sock(friend);
+	if (!sock_owned_by_user(friend)) {
+		tcp_friend_rcv(friend, skb);
+	} else {
+		/* tcp_v4_do_rcv() passes it on when the owner lets go */
+		__sk_add_backlog(friend, skb);
+		friend->sk_backlog.len += skb->truesize;
+	}
+	bh_unlock_sock(friend);
+	local_bh_enable();
+
+	tp->write_seq += len;
+	tp->snd_nxt += len;
+	tp->snd_una = tp->snd_nxt;
+	tp->pushed_seq = tp->write_seq;
+	tp->lsndtime = tcp_time_stamp;
+}
+
+/*
+ * Send as much of @msg as possible directly to the friend. Returns the
+ * number of bytes sent, the rest, if any, goes the normal way: either
+ * the friend went away, or the connection is no longer in a state the
+ * shortcut can be used in. *err is set if nothing more can be sent.
+ */
+static int tcp_friend_sendmsg(struct sock *sk, struct msghdr *msg,
+			      size_t size, long *timeo, int *err)
+{
+	struct sock *friend = tcp_sk(sk)->friend;
+	int flags = msg->msg_flags;
+	struct sk_buff *skb;
+	int copied = 0;
+
+	*err = 0;
+	sock_hold(friend);
+	while (copied < size && tcp_friend_usable(sk, friend, flags)) {
+		int chunk = min_t(size_t, size - copied,
+				  (MAX_SKB_FRAGS - 2) * PAGE_SIZE);
+
+		*err = tcp_friend_wait(sk, friend, flags, timeo);
+		if (*err)
+			break;
+		if (!tcp_friend_usable(sk, friend, flags))
+			break;
+
+		skb = tcp_friend_alloc_skb(sk, msg, chunk, err);
+		if (!skb)
+			break;
+		tcp_friend_deliver(sk, friend, skb);
+		copied += chunk;
+	}
+	sock_put(friend);
+	return copied;
+}
+
+void tcp_friend_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!tcp_friend_receiving(sk) ||
+	    WARN_ON_ONCE(TCP_SKB_CB(skb)->seq != tp->rcv_nxt)) {
+		kfree_skb(skb);
+		return;
+	}
+
+	/* The sender has already counted the data as delivered, so it
+	 * cannot be dropped here; tcp_friend_room() bounds the excess.
+	 */
+	if (!sk_rmem_schedule(sk, skb->truesize)) {
+		int amt = sk_mem_pages(skb->truesize);
+
+		sk->sk_forward_alloc += amt * SK_MEM_QUANTUM;
+		atomic_long_add(amt, sk->sk_prot->memory_allocated);
+	}
+	skb_set_owner_r(skb, sk);
+	__skb_queue_tail(&sk->sk_receive_queue, skb);
+
+	tp->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+	tp->rcv_wup = tp->rcv_nxt;
+	inet_csk(sk)->icsk_ack.lrcvtime = tcp_time_stamp;
+
+	sk->sk_data_ready(sk, 0);
+}
+EXPORT_SYMBOL(tcp_friend_rcv);
+
 int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t size)
 {
@@ -946,6 +1208,12 @@ int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	if (sk->sk_err || (sk->sk_shutdown & SEND_SHUTDOWN))
 		goto out_err;
 
+	if (tp->friend) {
+		copied = tcp_friend_sendmsg(sk, msg, size, &timeo, &err);
+		if (err)
+			goto do_error;
+	}
+
 	sg = sk->sk_route_caps & NETIF_F_SG;
 
 	while (--iovlen >= 0) {
@@ -1247,6 +1515,13 @@ void tcp_cleanup_rbuf(struct sock *sk, int copied)
 	}
 	if (time_to_ack)
 		tcp_send_ack(sk);
+
+	if (copied > 0) {
+		struct sock *friend = ACCESS_ONCE(tp->friend);
+
+		if (friend)
+			tcp_friend_wake(friend);
+	}
 }
 
 static void tcp_prequeue_process(struct sock *sk)
@@ -1812,6 +2087,9 @@ void tcp_set_state(struct sock *sk, int state)
 	 */
 	sk->sk_state = state;
 
+	if (state == TCP_CLOSE)
+		tcp_friend_release(sk);
+
 #ifdef STATE_TRACE
 	SOCK_DEBUG(sk, "TCP sk=%p, State %s -> %s\n", sk, statename[oldstate], statename[state]);
 #endif
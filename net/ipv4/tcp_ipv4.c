@@ -86,6 +86,8 @@
 int sysctl_tcp_tw_reuse __read_mostly;
 int sysctl_tcp_low_latency __read_mostly;
 EXPORT_SYMBOL(sysctl_tcp_low_latency);
+int sysctl_tcp_friends __read_mostly;
+EXPORT_SYMBOL(sysctl_tcp_friends);
 
 
 #ifdef CONFIG_TCP_MD5SIG
@@ -1404,6 +1406,65 @@ drop:
 EXPORT_SYMBOL(tcp_v4_conn_request);
 
 
+/*
+ * A connection accepted over loopback has its connecting end in this
+ * host's established hash already. Let both ends point at each other,
+ * each holding a reference that is dropped when it enters TCP_CLOSE,
+ * and tcp_sendmsg() will queue data straight to the other end.
+ */
+static void tcp_v4_make_friends(struct sock *sk, struct sk_buff *skb)
+{
+	struct inet_sock *inet = inet_sk(sk);
+	struct sock *peer;
+
+#ifdef CONFIG_TCP_MD5SIG
+	if (tcp_sk(sk)->md5sig_info)
+		return;
+#endif
+	peer = __inet_lookup_established(sock_net(sk), &tcp_hashinfo,
+					 inet->inet_saddr, inet->inet_sport,
+					 inet->inet_daddr,
+					 ntohs(inet->inet_dport),
+					 inet_iif(skb));
+	if (!peer)
+		return;
+	if (peer->sk_state == TCP_TIME_WAIT) {
+		inet_twsk_put(inet_twsk(peer));
+		return;
+	}
+	if (peer == sk || peer->sk_state != TCP_ESTABLISHED ||
+	    peer->sk_family != AF_INET
+#ifdef CONFIG_TCP_MD5SIG
+	    || tcp_sk(peer)->md5sig_info
+#endif
+	    ) {
+		sock_put(peer);
+		return;
+	}
+
+	/* The lookup reference becomes ours, sk is still locked and
+	 * cannot close under us.
+	 */
+	tcp_sk(sk)->friend = peer;
+	sock_hold(sk);
+	if (cmpxchg(&tcp_sk(peer)->friend, NULL, sk)) {
+		tcp_sk(sk)->friend = NULL;
+		__sock_put(sk);
+		sock_put(peer);
+		return;
+	}
+
+	/* Pairs with the xchg() in tcp_friend_release(): if the peer has
+	 * closed meanwhile, exactly one of us sees the other's update.
+	 */
+	if (peer->sk_state == TCP_CLOSE) {
+		struct sock *friend = xchg(&tcp_sk(peer)->friend, NULL);
+
+		if (friend)
+			sock_put(friend);
+	}
+}
+
 /*
  * The three way handshake has completed - we got a valid synack -
  * now create the new socket.
@@ -1482,6 +1543,10 @@ struct sock *tcp_v4_syn_recv_sock(struct sock *sk, struct sk_buff *skb,
 		goto put_and_exit;
 	__inet_hash_nolisten(newsk, NULL);
 
+	if (sysctl_tcp_friends && skb->dev && (skb->dev->flags & IFF_LOOPBACK) &&
+	    newsk->sk_family == AF_INET)
+		tcp_v4_make_friends(newsk, skb);
+
 	return newsk;
 
 exit_overflow:
@@ -1561,6 +1626,13 @@ static __sum16 tcp_v4_checksum_init(struct sk_buff *skb)
 int tcp_v4_do_rcv(struct sock *sk, struct sk_buff *skb)
 {
 	struct sock *rsk;
+
+	/* Put on the backlog by a loopback friend, there are no headers */
+	if (unlikely(TCP_SKB_CB(skb)->sacked & TCPCB_FRIEND)) {
+		tcp_friend_rcv(sk, skb);
+		return 0;
+	}
+
 #ifdef CONFIG_TCP_MD5SIG
 	/*
 	 * We really want to reject the packet as early as possible
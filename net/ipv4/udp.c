@@ -785,6 +785,77 @@ out:
 	return err;
 }
 
+/*
+ * sendmmsg() marks every message but the last of a call MSG_BATCH. An
+ * unconnected socket keeps the route of such a message for the next
+ * ones of the batch to the same destination, so that a relay sending a
+ * burst to each peer looks a route up once per burst rather than once
+ * per datagram. The first send not so marked drops the route again, as
+ * does sendmmsg() through ->batch_end() when it stops early.
+ */
+static struct rtable *udp_batch_route_get(struct sock *sk,
+					  struct flowi4 *fl4)
+{
+	struct udp_sock *up = udp_sk(sk);
+	const struct flowi4 *key = &up->batch_key;
+	struct rtable *rt;
+
+	spin_lock(&sk->sk_dst_lock);
+	rt = up->batch_rt;
+	if (!rt || key->daddr != fl4->daddr || key->saddr != fl4->saddr ||
+	    key->fl4_dport != fl4->fl4_dport ||
+	    key->flowi4_oif != fl4->flowi4_oif ||
+	    key->flowi4_tos != fl4->flowi4_tos ||
+	    key->flowi4_mark != fl4->flowi4_mark ||
+	    key->flowi4_flags != fl4->flowi4_flags) {
+		spin_unlock(&sk->sk_dst_lock);
+		return NULL;
+	}
+	if (rt->dst.obsolete && !rt->dst.ops->check(&rt->dst, 0)) {
+		up->batch_rt = NULL;
+		spin_unlock(&sk->sk_dst_lock);
+		ip_rt_put(rt);
+		return NULL;
+	}
+	dst_clone(&rt->dst);
+	*fl4 = up->batch_fl4;
+	spin_unlock(&sk->sk_dst_lock);
+
+	return rt;
+}
+
+static void udp_batch_route_set(struct sock *sk, const struct flowi4 *key,
+				const struct flowi4 *fl4, struct rtable *rt)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct rtable *old;
+
+	dst_clone(&rt->dst);
+	spin_lock(&sk->sk_dst_lock);
+	old = up->batch_rt;
+	up->batch_rt = rt;
+	up->batch_key = *key;
+	up->batch_fl4 = *fl4;
+	spin_unlock(&sk->sk_dst_lock);
+	ip_rt_put(old);
+}
+
+void udp_batch_route_flush(struct sock *sk)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct rtable *rt;
+
+	if (likely(!up->batch_rt))
+		return;
+
+	spin_lock(&sk->sk_dst_lock);
+	rt = up->batch_rt;
+	up->batch_rt = NULL;
+	spin_unlock(&sk->sk_dst_lock);
+	ip_rt_put(rt);
+}
+EXPORT_SYMBOL(udp_batch_route_flush);
+
 int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t len)
 {
@@ -922,6 +993,8 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	if (rt == NULL) {
 		struct net *net = sock_net(sk);
+		bool batch = !connected && (msg->msg_flags & MSG_BATCH);
+		struct flowi4 key;
 
 		fl4 = &fl4_stack;
 		flowi4_init_output(fl4, ipc.oif, sk->sk_mark, tos,
@@ -930,6 +1003,12 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 				   faddr, saddr, dport, inet->inet_sport);
 
 		security_sk_classify_flow(sk, flowi4_to_flowi(fl4));
+		if (batch) {
+			rt = udp_batch_route_get(sk, fl4);
+			if (rt)
+				goto have_route;
+			key = *fl4;
+		}
 		rt = ip_route_output_flow(net, fl4, sk);
 		if (IS_ERR(rt)) {
 			err = PTR_ERR(rt);
@@ -945,7 +1024,10 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 			goto out;
 		if (connected)
 			sk_dst_set(sk, dst_clone(&rt->dst));
+		else if (batch)
+			udp_batch_route_set(sk, &key, fl4, rt);
 	}
+have_route:
 
 	if (msg->msg_flags&MSG_CONFIRM)
 		goto do_confirm;
@@ -1003,6 +1085,8 @@ out:
 	ip_rt_put(rt);
 	if (free)
 		kfree(ipc.opt);
+	if (!(msg->msg_flags & MSG_BATCH))
+		udp_batch_route_flush(sk);
 	if (!err)
 		return len;
 	/*
@@ -1719,6 +1803,7 @@ void udp_destroy_sock(struct sock *sk)
 	bool slow = lock_sock_fast(sk);
 	udp_flush_pending_frames(sk);
 	unlock_sock_fast(sk, slow);
+	udp_batch_route_flush(sk);
 }
 
 /*
@@ -1929,6 +2014,7 @@ struct proto udp_prot = {
 	.sendmsg	   = udp_sendmsg,
 	.recvmsg	   = udp_recvmsg,
 	.sendpage	   = udp_sendpage,
+	.batch_end	   = udp_batch_route_flush,
 	.backlog_rcv	   = __udp_queue_rcv_skb,
 	.hash		   = udp_lib_hash,
 	.unhash		   = udp_lib_unhash,
@@ -1234,6 +1234,8 @@ void udpv6_destroy_sock(struct sock *sk)
 	lock_sock(sk);
 	udp_v6_flush_pending_frames(sk);
 	release_sock(sk);
+	/* v4-mapped sends went through udp_sendmsg() */
+	udp_batch_route_flush(sk);
 
 	inet6_destroy_sock(sk);
 }
@@ -1462,6 +1464,7 @@ struct proto udpv6_prot = {
 	.getsockopt	   = udpv6_getsockopt,
 	.sendmsg	   = udpv6_sendmsg,
 	.recvmsg	   = udpv6_recvmsg,
+	.batch_end	   = udp_batch_route_flush,
 	.backlog_rcv	   = udpv6_queue_rcv_skb,
 	.hash		   = udp_lib_hash,
 	.unhash		   = udp_lib_unhash,
@@ -90,7 +90,7 @@ static int pn_sendmsg(struct kiocb *iocb, struct sock *sk,
 	int err;
 
 	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_EOR|MSG_NOSIGNAL|
-				MSG_CMSG_COMPAT))
+				MSG_BATCH|MSG_CMSG_COMPAT))
 		return -EOPNOTSUPP;
 
 	if (msg->msg_name == NULL)
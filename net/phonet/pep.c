@@ -1046,7 +1046,7 @@ static int pep_sendmsg(struct kiocb *iocb, struct sock *sk,
 	int err, done;
 
 	if ((msg->msg_flags & ~(MSG_DONTWAIT|MSG_EOR|MSG_NOSIGNAL|
-				MSG_CMSG_COMPAT)) ||
+				MSG_BATCH|MSG_CMSG_COMPAT)) ||
 			!(msg->msg_flags & MSG_EOR))
 		return -EOPNOTSUPP;
 
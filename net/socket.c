@@ -2027,6 +2027,7 @@ int __sys_sendmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 	struct compat_mmsghdr __user *compat_entry;
 	struct msghdr msg_sys;
 	struct used_address used_address;
+	unsigned int oflags = flags;
 
 	if (vlen > UIO_MAXIOV)
 		vlen = UIO_MAXIOV;
@@ -2043,6 +2044,15 @@ int __sys_sendmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 	err = 0;
 
 	while (datagrams < vlen) {
+		/*
+		 * Tell the protocol that more messages follow in this call,
+		 * so that it may keep state, such as a route, for them.
+		 */
+		if (datagrams == vlen - 1)
+			flags = oflags;
+		else
+			flags |= MSG_BATCH;
+
 		if (MSG_CMSG_COMPAT & flags) {
 			err = __sys_sendmsg(sock, (struct msghdr __user *)compat_entry,
 					    &msg_sys, flags, &used_address);
@@ -2064,6 +2074,13 @@ int __sys_sendmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 		++datagrams;
 	}
 
+	/*
+	 * On an error the message that would have ended the batch was never
+	 * sent, so let the protocol drop what it kept for the rest of it.
+	 */
+	if (datagrams < vlen && sock->sk && sock->sk->sk_prot->batch_end)
+		sock->sk->sk_prot->batch_end(sock->sk);
+
 	fput_light(sock->file, fput_needed);
 
 	/* We only return an error if no datagrams were able to be sent */
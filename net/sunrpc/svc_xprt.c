@@ -589,7 +589,7 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 	struct svc_serv		*serv = rqstp->rq_server;
 	struct svc_pool		*pool = rqstp->rq_pool;
 	int			len, i;
-	int			pages;
+	int			pages, filled;
 	struct xdr_buf		*arg;
 	DECLARE_WAITQUEUE(wait, current);
 	long			time_left;
@@ -608,19 +608,19 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 
 	/* now allocate needed pages.  If we get a failure, sleep briefly */
 	pages = (serv->sv_max_mesg + PAGE_SIZE) / PAGE_SIZE;
-	for (i = 0; i < pages ; i++)
-		while (rqstp->rq_pages[i] == NULL) {
-			struct page *p = alloc_page(GFP_KERNEL);
-			if (!p) {
-				set_current_state(TASK_INTERRUPTIBLE);
-				if (signalled() || kthread_should_stop()) {
-					set_current_state(TASK_RUNNING);
-					return -EINTR;
-				}
-				schedule_timeout(msecs_to_jiffies(500));
-			}
-			rqstp->rq_pages[i] = p;
+	for (filled = 0; ; filled = i) {
+		i = alloc_pages_bulk_array(GFP_KERNEL, pages, rqstp->rq_pages);
+		if (i == pages)
+			break;
+		if (i > filled)
+			continue;
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (signalled() || kthread_should_stop()) {
+			set_current_state(TASK_RUNNING);
+			return -EINTR;
 		}
+		schedule_timeout(msecs_to_jiffies(500));
+	}
 	rqstp->rq_pages[i++] = NULL; /* this might be seen in nfs_read_actor */
 	BUG_ON(pages >= RPCSVC_MAXPAGES);
 
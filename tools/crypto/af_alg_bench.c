@@ -0,0 +1,344 @@
+/*
+ * af_alg_bench.c -- AF_ALG skcipher throughput, copying and zero-copy
+ *
+ * Encrypts records of several sizes through an AF_ALG skcipher socket,
+ * the way a userspace TLS terminator would, using three paths:
+ *
+ *   copy      sendmsg() the record in, read() the result back out
+ *   vmsplice  vmsplice() + splice() the record in, read() the result into
+ *             pinned user pages
+ *   splice    vmsplice() + splice() the record in, splice() the result out
+ *             to a pipe and on to /dev/null, as it would go to a socket
+ *
+ * and reports records per second and CPU cycles per byte. Cycles come
+ * from a perf counter covering user and kernel time of this process, or,
+ * where that is not available, CPU nanoseconds per byte are given.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o af_alg_bench af_alg_bench.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/if_alg.h>
+#include <linux/perf_event.h>
+
+#ifndef AF_ALG
+#define AF_ALG		38
+#endif
+#ifndef SOL_ALG
+#define SOL_ALG		279
+#endif
+
+#define MAX_RECORD	(64 * 1024)
+
+enum path { PATH_COPY, PATH_VMSPLICE, PATH_SPLICE, NR_PATHS };
+
+static const char * const path_names[NR_PATHS] = {
+	"copy", "vmsplice", "splice",
+};
+
+static const char *alg_name = "cbc(aes)";
+static unsigned int ivlen = 16;
+static unsigned int records = 10000;
+static unsigned int sizes[16] = { 256, 1024, 4096, 16384 };
+static unsigned int nr_sizes = 4;
+
+static int pipe_in[2], pipe_out[2];
+static int null_fd;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static int alg_open(void)
+{
+	static const unsigned char key[16] = "0123456789abcdef";
+	struct sockaddr_alg sa = {
+		.salg_family = AF_ALG,
+		.salg_type = "skcipher",
+	};
+	int tfm, op;
+
+	strncpy((char *)sa.salg_name, alg_name, sizeof(sa.salg_name) - 1);
+
+	tfm = socket(AF_ALG, SOCK_SEQPACKET, 0);
+	if (tfm < 0)
+		die("socket(AF_ALG)");
+	if (bind(tfm, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		die(alg_name);
+	if (setsockopt(tfm, SOL_ALG, ALG_SET_KEY, key, sizeof(key)) < 0)
+		die("ALG_SET_KEY");
+
+	op = accept(tfm, NULL, 0);
+	if (op < 0)
+		die("accept");
+	close(tfm);
+
+	return op;
+}
+
+/* Start a record: operation and IV, plus the data if it is copied in */
+static void alg_start(int op, void *buf, size_t len, int more)
+{
+	char cbuf[CMSG_SPACE(sizeof(uint32_t)) +
+		  CMSG_SPACE(sizeof(struct af_alg_iv) + 64)] = { 0 };
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	struct msghdr msg = {
+		.msg_control = cbuf,
+		.msg_controllen = CMSG_SPACE(sizeof(uint32_t)) +
+				  CMSG_SPACE(sizeof(struct af_alg_iv) + ivlen),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	struct cmsghdr *cmsg;
+	struct af_alg_iv *iv;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_ALG;
+	cmsg->cmsg_type = ALG_SET_OP;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+	*(uint32_t *)CMSG_DATA(cmsg) = ALG_OP_ENCRYPT;
+
+	cmsg = CMSG_NXTHDR(&msg, cmsg);
+	cmsg->cmsg_level = SOL_ALG;
+	cmsg->cmsg_type = ALG_SET_IV;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(*iv) + ivlen);
+	iv = (struct af_alg_iv *)CMSG_DATA(cmsg);
+	iv->ivlen = ivlen;
+	memset(iv->iv, 0, ivlen);
+
+	if (sendmsg(op, &msg, more ? MSG_MORE : 0) != (ssize_t)len)
+		die("sendmsg");
+}
+
+static void splice_all(int in, int out, size_t len, unsigned int flags)
+{
+	while (len) {
+		ssize_t n = splice(in, NULL, out, NULL, len, flags);
+
+		if (n <= 0)
+			die("splice");
+		len -= n;
+	}
+}
+
+static void read_all(int fd, char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = read(fd, buf, len);
+
+		if (n <= 0)
+			die("read");
+		buf += n;
+		len -= n;
+	}
+}
+
+static void one_record(int op, enum path path, char *in, char *out,
+		       size_t len)
+{
+	struct iovec iov = { .iov_base = in, .iov_len = len };
+
+	if (path == PATH_COPY) {
+		alg_start(op, in, len, 0);
+		read_all(op, out, len);
+		return;
+	}
+
+	alg_start(op, NULL, 0, 1);
+	while (iov.iov_len) {
+		ssize_t n = vmsplice(pipe_in[1], &iov, 1, 0);
+
+		if (n <= 0)
+			die("vmsplice");
+		splice_all(pipe_in[0], op, n, iov.iov_len > (size_t)n ?
+						SPLICE_F_MORE : 0);
+		iov.iov_base = (char *)iov.iov_base + n;
+		iov.iov_len -= n;
+	}
+
+	if (path == PATH_VMSPLICE) {
+		read_all(op, out, len);
+		return;
+	}
+
+	while (len) {
+		ssize_t n = splice(op, NULL, pipe_out[1], NULL, len, 0);
+
+		if (n <= 0)
+			die("splice from AF_ALG");
+		splice_all(pipe_out[0], null_fd, n, 0);
+		len -= n;
+	}
+}
+
+static int cycles_open(void)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CPU_CYCLES,
+		.disabled = 1,
+	};
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t cpu_ns(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+static uint64_t wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench(int op, int cycles_fd, enum path path, char *in, char *out,
+		  size_t len)
+{
+	uint64_t t0, c0, cycles = 0, bytes = (uint64_t)len * records;
+	double secs;
+	unsigned int i;
+
+	/* Warm up, and check the result once against the copy path */
+	one_record(op, PATH_COPY, in, out + MAX_RECORD, len);
+	one_record(op, path, in, out, len);
+	if (path != PATH_SPLICE && memcmp(out, out + MAX_RECORD, len)) {
+		fprintf(stderr, "%s: result differs from copy path\n",
+			path_names[path]);
+		exit(1);
+	}
+
+	if (cycles_fd >= 0) {
+		ioctl(cycles_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(cycles_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	c0 = cpu_ns();
+	t0 = wall_ns();
+
+	for (i = 0; i < records; i++)
+		one_record(op, path, in, out, len);
+
+	secs = (wall_ns() - t0) / 1e9;
+	c0 = cpu_ns() - c0;
+	if (cycles_fd >= 0) {
+		ioctl(cycles_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(cycles_fd, &cycles, sizeof(cycles)) != sizeof(cycles))
+			cycles = 0;
+	}
+
+	printf("%-9s %6zu %10.0f %9.1f ", path_names[path], len,
+	       records / secs, bytes / secs / 1e6);
+	if (cycles)
+		printf("%8.2f cycles/byte\n", (double)cycles / bytes);
+	else
+		printf("%8.2f ns/byte\n", (double)c0 / bytes);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-a alg] [-i ivlen] [-n records] [-s size[,size...]]\n"
+		"  -a  skcipher to use, default cbc(aes)\n"
+		"  -i  IV length in bytes, default 16\n"
+		"  -n  records per size and path, default 10000\n"
+		"  -s  record sizes, default 256,1024,4096,16384\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	char *in, *out, *p;
+	int op, cycles_fd, opt;
+	unsigned int i;
+	enum path path;
+
+	while ((opt = getopt(argc, argv, "a:i:n:s:")) != -1) {
+		switch (opt) {
+		case 'a':
+			alg_name = optarg;
+			break;
+		case 'i':
+			ivlen = atoi(optarg);
+			if (ivlen > 64)
+				usage(argv[0]);
+			break;
+		case 'n':
+			records = atoi(optarg);
+			break;
+		case 's':
+			nr_sizes = 0;
+			for (p = strtok(optarg, ","); p && nr_sizes < 16;
+			     p = strtok(NULL, ","))
+				sizes[nr_sizes++] = atoi(p);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!records || !nr_sizes)
+		usage(argv[0]);
+	for (i = 0; i < nr_sizes; i++)
+		if (!sizes[i] || sizes[i] > MAX_RECORD)
+			usage(argv[0]);
+
+	/* Page aligned, as a real record buffer would be for DMA */
+	in = mmap(NULL, MAX_RECORD, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	out = mmap(NULL, 2 * MAX_RECORD, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (in == MAP_FAILED || out == MAP_FAILED)
+		die("mmap");
+	for (i = 0; i < MAX_RECORD; i++)
+		in[i] = i * 7;
+
+	if (pipe(pipe_in) || pipe(pipe_out))
+		die("pipe");
+	null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd < 0)
+		die("/dev/null");
+
+	op = alg_open();
+	cycles_fd = cycles_open();
+
+	printf("%s, %u records per size\n", alg_name, records);
+	printf("%-9s %6s %10s %9s %s\n", "path", "bytes", "records/s", "MB/s",
+	       cycles_fd >= 0 ? "cycles" : "CPU time");
+
+	for (i = 0; i < nr_sizes; i++)
+		for (path = 0; path < NR_PATHS; path++)
+			bench(op, cycles_fd, path, in, out, sizes[i]);
+
+	return 0;
+}
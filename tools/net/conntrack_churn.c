@@ -0,0 +1,229 @@
+/*
+ * conntrack_churn.c -- new connection tracking entries per second
+ *
+ * Each of a number of worker processes, one per CPU by default, sends
+ * single UDP datagrams over loopback to a new destination address and
+ * port every time, so that every packet creates a conntrack entry. The
+ * old ones age out through the UDP timeout, which is best lowered for
+ * the run so that the table reaches a steady state well below
+ * nf_conntrack_max, e.g.
+ *
+ *   echo 2 > /proc/sys/net/netfilter/nf_conntrack_udp_timeout
+ *
+ * Conntrack only sees the traffic once it is loaded, e.g. by any rule in
+ * the iptables raw or filter table. The aggregate rate is printed every
+ * second, with the current nf_conntrack_count and the growth of the
+ * insert_failed and early_drop statistics.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o conntrack_churn conntrack_churn.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define MAX_WORKERS	256
+
+struct worker_stat {
+	volatile uint64_t sent;
+	char pad[56];
+};
+
+static unsigned int workers;
+static unsigned int seconds = 10;
+static unsigned int first_port = 1024;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/*
+ * Walk 127.<worker>.x.y and ports first_port..65535, so that no two
+ * workers ever send to the same destination.
+ */
+static void worker(unsigned int id, struct worker_stat *st)
+{
+	struct sockaddr_in sa = { .sin_family = AF_INET };
+	unsigned int host = 1, port = first_port;
+	char byte = 0;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		die("socket");
+
+	for (;;) {
+		sa.sin_addr.s_addr = htonl(0x7f000000 | (id & 0xff) << 16 |
+					   host);
+		sa.sin_port = htons(port);
+		if (sendto(fd, &byte, 1, 0, (struct sockaddr *)&sa,
+			   sizeof(sa)) < 0 && errno != ECONNREFUSED &&
+		    errno != EPERM)
+			die("sendto");
+		st->sent++;
+
+		if (++port > 65535) {
+			port = first_port;
+			if (++host > 0xfffe)
+				host = 1;
+		}
+	}
+}
+
+static long read_count(void)
+{
+	FILE *f = fopen("/proc/sys/net/netfilter/nf_conntrack_count", "r");
+	long count = -1;
+
+	if (f) {
+		if (fscanf(f, "%ld", &count) != 1)
+			count = -1;
+		fclose(f);
+	}
+	return count;
+}
+
+/* Sum of insert_failed and early_drop over all CPUs */
+static void read_stat(uint64_t *insert_failed, uint64_t *early_drop)
+{
+	FILE *f = fopen("/proc/net/stat/nf_conntrack", "r");
+	unsigned int v[17];
+	char line[512];
+
+	*insert_failed = *early_drop = 0;
+	if (!f)
+		return;
+	if (!fgets(line, sizeof(line), f))
+		goto out;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%x %x %x %x %x %x %x %x %x %x %x %x",
+			   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+			   &v[7], &v[8], &v[9], &v[10], &v[11]) != 12)
+			continue;
+		*insert_failed += v[9];
+		*early_drop += v[11];
+	}
+out:
+	fclose(f);
+}
+
+static uint64_t total_sent(struct worker_stat *st)
+{
+	uint64_t sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < workers; i++)
+		sum += st[i].sent;
+	return sum;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-w workers] [-t seconds] [-p first_port]\n"
+		"  -w  sending processes, default one per online CPU\n"
+		"  -t  run time, default 10 seconds\n"
+		"  -p  lowest destination port, default 1024\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t sent, last_sent = 0, if0, ed0, ifn, edn;
+	double t0, last, t, total_secs;
+	struct worker_stat *st;
+	pid_t pids[MAX_WORKERS];
+	unsigned int i;
+	int opt;
+
+	workers = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "w:t:p:")) != -1) {
+		switch (opt) {
+		case 'w':
+			workers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			first_port = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!workers || workers > MAX_WORKERS || !seconds ||
+	    !first_port || first_port > 65535)
+		usage(argv[0]);
+
+	st = mmap(NULL, MAX_WORKERS * sizeof(*st), PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (st == MAP_FAILED)
+		die("mmap");
+
+	read_stat(&if0, &ed0);
+	printf("%u workers, %u seconds\n", workers, seconds);
+	printf("%4s %12s %10s %13s %10s\n", "time", "new conns/s", "count",
+	       "insert_failed", "early_drop");
+
+	for (i = 0; i < workers; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			die("fork");
+		if (!pids[i])
+			worker(i, &st[i]);
+	}
+
+	t0 = last = now();
+	for (i = 1; i <= seconds; i++) {
+		usleep((t0 + i - now()) * 1e6);
+		t = now();
+		sent = total_sent(st);
+		read_stat(&ifn, &edn);
+		printf("%4u %12.0f %10ld %13llu %10llu\n", i,
+		       (sent - last_sent) / (t - last), read_count(),
+		       (unsigned long long)(ifn - if0),
+		       (unsigned long long)(edn - ed0));
+		fflush(stdout);
+		last_sent = sent;
+		last = t;
+	}
+	total_secs = now() - t0;
+	sent = total_sent(st);
+
+	for (i = 0; i < workers; i++)
+		kill(pids[i], SIGKILL);
+	while (wait(NULL) > 0)
+		;
+
+	printf("average %.0f new conns/s\n", sent / total_secs);
+	return 0;
+}
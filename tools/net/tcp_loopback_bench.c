@@ -0,0 +1,288 @@
+/*
+ * tcp_loopback_bench.c -- TCP latency and throughput over 127.0.0.1
+ *
+ * A client and a server process talk over a fresh loopback connection
+ * per test, the way a web server talks to a local database or cache:
+ *
+ *   pingpong  -s byte requests answered by -s byte replies, one at a
+ *             time; transactions per second and the mean round trip
+ *   stream    -b byte writes in one direction as fast as the receiver
+ *             drains them; megabytes per second
+ *
+ * The current net.ipv4.tcp_friends setting is reported. With -c, both
+ * tests run once with it off and once with it on, which needs write
+ * access to /proc/sys/net/ipv4/tcp_friends; the old value is put back
+ * afterwards.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o tcp_loopback_bench tcp_loopback_bench.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define FRIENDS_SYSCTL	"/proc/sys/net/ipv4/tcp_friends"
+#define MAX_BUF		(1024 * 1024)
+
+enum test { TEST_PINGPONG, TEST_STREAM, NR_TESTS };
+
+static const char * const test_names[NR_TESTS] = {
+	"pingpong", "stream",
+};
+
+static unsigned int msg_size = 64;
+static unsigned int buf_size = 64 * 1024;
+static unsigned int seconds = 5;
+static unsigned int port = 21000;
+
+static char buf[MAX_BUF];
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_friends(void)
+{
+	FILE *f = fopen(FRIENDS_SYSCTL, "r");
+	int val = -1;
+
+	if (f) {
+		if (fscanf(f, "%d", &val) != 1)
+			val = -1;
+		fclose(f);
+	}
+	return val;
+}
+
+static int write_friends(int val)
+{
+	FILE *f = fopen(FRIENDS_SYSCTL, "w");
+
+	if (!f)
+		return -1;
+	fprintf(f, "%d\n", val);
+	return fclose(f);
+}
+
+static void read_all(int fd, size_t len)
+{
+	while (len) {
+		ssize_t n = read(fd, buf, len);
+
+		if (n <= 0)
+			die("read");
+		len -= n;
+	}
+}
+
+static void write_all(int fd, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t n = write(fd, p, len);
+
+		if (n <= 0)
+			die("write");
+		p += n;
+		len -= n;
+	}
+}
+
+/* Answer requests, or drain the stream, until the client hangs up */
+static void server(int fd, enum test test)
+{
+	ssize_t n;
+
+	for (;;) {
+		if (test == TEST_STREAM) {
+			n = read(fd, buf, buf_size);
+			if (n <= 0)
+				break;
+			continue;
+		}
+		n = recv(fd, buf, msg_size, MSG_WAITALL);
+		if (n != (ssize_t)msg_size)
+			break;
+		write_all(fd, msg_size);
+	}
+	exit(0);
+}
+
+/* Connect a client to a freshly accepted server process */
+static int open_pair(int lfd, enum test test, pid_t *pid)
+{
+	struct sockaddr_in sa = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		.sin_port = htons(port),
+	};
+	int one = 1, fd, sfd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		die("connect");
+	sfd = accept(lfd, NULL, NULL);
+	if (sfd < 0)
+		die("accept");
+	setsockopt(sfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	fflush(stdout);
+	*pid = fork();
+	if (*pid < 0)
+		die("fork");
+	if (!*pid) {
+		close(fd);
+		server(sfd, test);
+	}
+	close(sfd);
+	return fd;
+}
+
+static void bench(int lfd, enum test test, int friends)
+{
+	uint64_t ops = 0;
+	double t0, t, secs;
+	pid_t pid;
+	int fd;
+
+	fd = open_pair(lfd, test, &pid);
+	t0 = now();
+	do {
+		if (test == TEST_PINGPONG) {
+			write_all(fd, msg_size);
+			read_all(fd, msg_size);
+		} else {
+			write_all(fd, buf_size);
+		}
+		ops++;
+		t = now();
+	} while (t - t0 < seconds);
+	secs = t - t0;
+
+	close(fd);
+	waitpid(pid, NULL, 0);
+
+	if (friends < 0)
+		printf("%7s ", "?");
+	else
+		printf("%7d ", friends);
+	if (test == TEST_PINGPONG)
+		printf("%-9s %7u %12.0f %9.2f us\n", test_names[test], msg_size,
+		       ops / secs, secs / ops * 1e6);
+	else
+		printf("%-9s %7u %12.0f %9.1f MB/s\n", test_names[test],
+		       buf_size, ops / secs, ops * (double)buf_size / secs / 1e6);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c] [-s size] [-b size] [-t seconds] [-p port]\n"
+		"  -c  compare tcp_friends off and on\n"
+		"  -s  pingpong message bytes, default 64\n"
+		"  -b  stream write bytes, default 65536\n"
+		"  -t  run time per test, default 5 seconds\n"
+		"  -p  port to listen on, default 21000\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in sa = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int compare = 0, old, one = 1, lfd, opt, pass;
+	enum test test;
+
+	while ((opt = getopt(argc, argv, "cs:b:t:p:")) != -1) {
+		switch (opt) {
+		case 'c':
+			compare = 1;
+			break;
+		case 's':
+			msg_size = atoi(optarg);
+			break;
+		case 'b':
+			buf_size = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!msg_size || msg_size > MAX_BUF || !buf_size ||
+	    buf_size > MAX_BUF || !seconds || !port || port > 65535)
+		usage(argv[0]);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		die("socket");
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	sa.sin_port = htons(port);
+	if (bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		die("bind");
+	if (listen(lfd, 16) < 0)
+		die("listen");
+
+	old = read_friends();
+	printf("tcp_friends=%s, %u seconds per test\n",
+	       old < 0 ? "unavailable" : old ? "1" : "0", seconds);
+	printf("%7s %-9s %7s %12s %12s\n", "friends", "test", "bytes",
+	       "ops/s", "result");
+
+	for (pass = 0; pass < (compare ? 2 : 1); pass++) {
+		int friends = old;
+
+		if (compare) {
+			if (write_friends(pass) < 0)
+				die(FRIENDS_SYSCTL);
+			friends = pass;
+		}
+		for (test = 0; test < NR_TESTS; test++)
+			bench(lfd, test, friends);
+	}
+
+	if (compare && old >= 0)
+		write_friends(old);
+	return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * udp_batch_bench.c -- UDP packets per second over loopback, one
+ * sendto() per datagram against sendmmsg() batches
+ *
+ * A sender process transmits datagrams from an unconnected socket to
+ * one or more receiver ports on 127.0.0.1, the pattern of a media relay
+ * forwarding to its peers, for a fixed time per mode:
+ *
+ *   sendto    one system call per datagram
+ *   sendmmsg  batches of -b datagrams, -r consecutive ones per destination
+ *
+ * while a receiver process drains all ports with recvmmsg(). Both the
+ * rate the sender achieved and the rate that was received are reported.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o udp_batch_bench udp_batch_bench.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define MAX_BATCH	1024
+#define MAX_PEERS	64
+#define MAX_SIZE	1472
+
+enum mode { MODE_SENDTO, MODE_SENDMMSG, NR_MODES };
+
+static const char * const mode_names[NR_MODES] = {
+	"sendto", "sendmmsg",
+};
+
+static unsigned int batch = 32;
+static unsigned int run_len = 32;
+static unsigned int peers = 1;
+static unsigned int size = 172;		/* 160 byte G.711 frame + RTP */
+static unsigned int seconds = 5;
+static unsigned int base_port = 20000;
+
+static struct sockaddr_in peer_addr[MAX_PEERS];
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Drain every port until killed, counting datagrams in *count */
+static void receiver(int *fds, volatile uint64_t *count)
+{
+	static char bufs[MAX_BATCH][MAX_SIZE];
+	struct mmsghdr msgs[MAX_BATCH];
+	struct iovec iovs[MAX_BATCH];
+	struct pollfd pfd[MAX_PEERS];
+	unsigned int i;
+	int n;
+
+	for (i = 0; i < MAX_BATCH; i++) {
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = MAX_SIZE;
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	for (i = 0; i < peers; i++) {
+		pfd[i].fd = fds[i];
+		pfd[i].events = POLLIN;
+	}
+
+	for (;;) {
+		if (poll(pfd, peers, -1) < 0 && errno != EINTR)
+			die("poll");
+		for (i = 0; i < peers; i++) {
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+			n = recvmmsg(fds[i], msgs, MAX_BATCH, MSG_DONTWAIT,
+				     NULL);
+			if (n > 0)
+				*count += n;
+		}
+	}
+}
+
+static uint64_t send_sendto(int fd, const char *buf)
+{
+	uint64_t sent = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < batch; i += run_len)
+		for (j = 0; j < run_len && i + j < batch; j++)
+			if (sendto(fd, buf, size, 0,
+				   (struct sockaddr *)&peer_addr[(i / run_len) %
+								peers],
+				   sizeof(peer_addr[0])) == (ssize_t)size)
+				sent++;
+	return sent;
+}
+
+static uint64_t send_sendmmsg(int fd, struct mmsghdr *msgs)
+{
+	int n = sendmmsg(fd, msgs, batch, 0);
+
+	if (n < 0 && errno != ENOBUFS && errno != EAGAIN)
+		die("sendmmsg");
+	return n > 0 ? n : 0;
+}
+
+static void bench(enum mode mode, int fd, int *rx_fds, char *buf,
+		  struct mmsghdr *msgs, volatile uint64_t *received)
+{
+	uint64_t sent = 0, rx0;
+	double t0, t, secs;
+	pid_t pid;
+
+	*received = 0;
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid)
+		receiver(rx_fds, received);
+
+	usleep(100000);
+	rx0 = *received;
+	t0 = now();
+	do {
+		if (mode == MODE_SENDTO)
+			sent += send_sendto(fd, buf);
+		else
+			sent += send_sendmmsg(fd, msgs);
+		t = now();
+	} while (t - t0 < seconds);
+	secs = t - t0;
+
+	/* Let the receiver catch up with what is already queued */
+	usleep(100000);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	printf("%-9s %5u %5u %12.0f %12.0f\n", mode_names[mode], batch,
+	       run_len, sent / secs, (*received - rx0) / secs);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-b batch] [-r run] [-d peers] [-s size] [-t seconds] [-p port]\n"
+		"  -b  datagrams per sendmmsg() call, default 32\n"
+		"  -r  consecutive datagrams to one peer, default 32\n"
+		"  -d  receiving ports, default 1\n"
+		"  -s  payload bytes, default 172\n"
+		"  -t  run time per mode, default 5 seconds\n"
+		"  -p  first receiving port, default 20000\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static struct mmsghdr msgs[MAX_BATCH];
+	static struct iovec iov;
+	volatile uint64_t *received;
+	int fd, rx_fds[MAX_PEERS], opt;
+	unsigned int i;
+	enum mode mode;
+	char *buf;
+
+	while ((opt = getopt(argc, argv, "b:r:d:s:t:p:")) != -1) {
+		switch (opt) {
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'r':
+			run_len = atoi(optarg);
+			break;
+		case 'd':
+			peers = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			base_port = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!batch || batch > MAX_BATCH || !run_len || !peers ||
+	    peers > MAX_PEERS || !size || size > MAX_SIZE || !seconds ||
+	    base_port + peers > 65536)
+		usage(argv[0]);
+
+	received = mmap(NULL, sizeof(*received), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (received == MAP_FAILED)
+		die("mmap");
+	buf = calloc(1, MAX_SIZE);
+	if (!buf)
+		die("calloc");
+
+	for (i = 0; i < peers; i++) {
+		int rcvbuf = 4 << 20;
+
+		peer_addr[i].sin_family = AF_INET;
+		peer_addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		peer_addr[i].sin_port = htons(base_port + i);
+
+		rx_fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+		if (rx_fds[i] < 0)
+			die("socket");
+		setsockopt(rx_fds[i], SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+			   sizeof(rcvbuf));
+		if (bind(rx_fds[i], (struct sockaddr *)&peer_addr[i],
+			 sizeof(peer_addr[i])) < 0)
+			die("bind");
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		die("socket");
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	for (i = 0; i < batch; i++) {
+		msgs[i].msg_hdr.msg_name = &peer_addr[(i / run_len) % peers];
+		msgs[i].msg_hdr.msg_namelen = sizeof(peer_addr[0]);
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	printf("%u byte datagrams to %u port%s, %u seconds per mode\n", size,
+	       peers, peers > 1 ? "s" : "", seconds);
+	printf("%-9s %5s %5s %12s %12s\n", "mode", "batch", "run", "sent/s",
+	       "received/s");
+	for (mode = 0; mode < NR_MODES; mode++)
+		bench(mode, fd, rx_fds, buf, msgs, received);
+
+	return 0;
+}
@@ -39,6 +39,9 @@ struct slabinfo {
 	unsigned long cpuslab_flush, deactivate_full, deactivate_empty;
 	unsigned long deactivate_to_head, deactivate_to_tail;
 	unsigned long deactivate_remote_frees, order_fallback;
+	unsigned long magazine_alloc_hits, magazine_alloc_misses;
+	unsigned long magazine_free_hits, magazine_free_misses;
+	unsigned long magazine_depth, magazine_objects;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -477,6 +480,33 @@ static void slab_stats(struct slabinfo *s)
 			s->deactivate_to_tail, (s->deactivate_to_tail * 100) / total);
 }
 
+static void mag_stats(struct slabinfo *s)
+{
+	unsigned long total_alloc;
+	unsigned long total_free;
+
+	total_alloc = s->magazine_alloc_hits + s->magazine_alloc_misses;
+	total_free = s->magazine_free_hits + s->magazine_free_misses;
+
+	if (!total_alloc || !total_free)
+		return;
+
+	printf("\n");
+	printf("Magazine                Alloc     Free %%Al %%Fr\n");
+	printf("--------------------------------------------------\n");
+	printf("Hit                  %8lu %8lu %3lu %3lu\n",
+		s->magazine_alloc_hits, s->magazine_free_hits,
+		s->magazine_alloc_hits * 100 / total_alloc,
+		s->magazine_free_hits * 100 / total_free);
+	printf("Miss                 %8lu %8lu %3lu %3lu\n",
+		s->magazine_alloc_misses, s->magazine_free_misses,
+		s->magazine_alloc_misses * 100 / total_alloc,
+		s->magazine_free_misses * 100 / total_free);
+	printf("Total                %8lu %8lu\n\n", total_alloc, total_free);
+	printf("Depth (all cpus) %lu  Objects held %lu\n",
+		s->magazine_depth, s->magazine_objects);
+}
+
 static void report(struct slabinfo *s)
 {
 	if (strcmp(s->name, "*") == 0)
@@ -516,6 +546,7 @@ static void report(struct slabinfo *s)
 	show_tracking(s);
 	slab_numa(s, 1);
 	slab_stats(s);
+	mag_stats(s);
 }
 
 static void slabcache(struct slabinfo *s)
@@ -1190,6 +1221,12 @@ static void read_slab_dir(void)
 			slab->deactivate_to_tail = get_obj("deactivate_to_tail");
 			slab->deactivate_remote_frees = get_obj("deactivate_remote_frees");
 			slab->order_fallback = get_obj("order_fallback");
+			slab->magazine_alloc_hits = get_obj("magazine_alloc_hits");
+			slab->magazine_alloc_misses = get_obj("magazine_alloc_misses");
+			slab->magazine_free_hits = get_obj("magazine_free_hits");
+			slab->magazine_free_misses = get_obj("magazine_free_misses");
+			slab->magazine_depth = get_obj("magazine_depth");
+			slab->magazine_objects = get_obj("magazine_objects");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;
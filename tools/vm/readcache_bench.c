@@ -0,0 +1,185 @@
+/*
+ * readcache_bench.c -- buffered sequential read through readahead
+ *
+ * A file is written and synced, then read from start to end with read(2)
+ * a number of times.  Before each cold pass the file is dropped from the
+ * page cache with POSIX_FADV_DONTNEED, so every page is allocated, added
+ * to the page cache and read in by readahead; each cold pass is followed
+ * by a hot one over the now cached file.  The difference between the two
+ * is the cost per page of readahead: allocation, page cache insertion and
+ * the I/O itself.
+ *
+ * To keep the device out of the way, put the file on a ramdisk with a
+ * filesystem that reads through mpage_readpages() or ->readpage, e.g.
+ *
+ *   modprobe brd rd_size=262144
+ *   mkfs.ext2 /dev/ram0 && mount /dev/ram0 /mnt
+ *   ./readcache_bench -f /mnt/file
+ *
+ * tmpfs will run, but it never drops its pages, so cold and hot passes
+ * are the same there: it only shows the copy-out cost for comparison.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o readcache_bench readcache_bench.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *path = "readcache_bench.dat";
+static unsigned long file_mb = 64;
+static unsigned long block_kb = 128;
+static int passes = 5;
+static int keep;
+
+static long page_size;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_file(char *buf, size_t len)
+{
+	size_t off, done;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(path);
+	for (off = 0; off < (file_mb << 20); off += done) {
+		memset(buf, off / len, len);
+		done = write(fd, buf, len);
+		if ((ssize_t)done <= 0)
+			die("write");
+	}
+	if (fsync(fd) < 0)
+		die("fsync");
+	close(fd);
+}
+
+static double read_file(int fd, char *buf, size_t len)
+{
+	unsigned long long total = 0;
+	ssize_t done;
+	double t0;
+
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		die("lseek");
+	t0 = now();
+	while ((done = read(fd, buf, len)) > 0)
+		total += done;
+	if (done < 0)
+		die("read");
+	if (total != (unsigned long long)file_mb << 20) {
+		fprintf(stderr, "short read: %llu bytes\n", total);
+		exit(1);
+	}
+	return now() - t0;
+}
+
+static void report(const char *what, double secs)
+{
+	unsigned long pages = (file_mb << 20) / page_size;
+
+	printf("%-5s %10.1f %10.1f\n", what, file_mb / secs,
+	       secs / pages * 1e9);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-k] [-f file] [-s MB] [-b KB] [-n passes]\n"
+		"  -k  keep the file afterwards\n"
+		"  -f  file to create and read, default %s\n"
+		"  -s  file size, default 64 MB\n"
+		"  -b  read(2) size, default 128 KB\n"
+		"  -n  cold/hot passes, default 5\n",
+		prog, path);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	double cold, hot, best_cold = 0, best_hot = 0;
+	size_t len;
+	char *buf;
+	int fd, opt, pass;
+
+	while ((opt = getopt(argc, argv, "kf:s:b:n:")) != -1) {
+		switch (opt) {
+		case 'k':
+			keep = 1;
+			break;
+		case 'f':
+			path = optarg;
+			break;
+		case 's':
+			file_mb = atol(optarg);
+			break;
+		case 'b':
+			block_kb = atol(optarg);
+			break;
+		case 'n':
+			passes = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!file_mb || !block_kb || passes < 1)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	len = block_kb << 10;
+	buf = malloc(len);
+	if (!buf)
+		die("malloc");
+
+	make_file(buf, len);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die(path);
+
+	printf("%s: %lu MB, %lu KB reads\n", path, file_mb, block_kb);
+	printf("%-5s %10s %10s\n", "pass", "MB/s", "ns/page");
+	for (pass = 0; pass < passes; pass++) {
+		if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+			die("posix_fadvise");
+		cold = read_file(fd, buf, len);
+		hot = read_file(fd, buf, len);
+		report("cold", cold);
+		report("hot", hot);
+		if (!pass || cold < best_cold)
+			best_cold = cold;
+		if (!pass || hot < best_hot)
+			best_hot = hot;
+	}
+	printf("best cold %.1f ns/page, hot %.1f ns/page, difference %.1f\n",
+	       best_cold / ((file_mb << 20) / page_size) * 1e9,
+	       best_hot / ((file_mb << 20) / page_size) * 1e9,
+	       (best_cold - best_hot) / ((file_mb << 20) / page_size) * 1e9);
+
+	close(fd);
+	if (!keep)
+		unlink(path);
+	return 0;
+}
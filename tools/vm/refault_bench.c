@@ -0,0 +1,244 @@
+/*
+ * refault_bench.c -- keeping a mapped working set under page cache pressure
+ *
+ * A "hot" file is mapped and its pages read over and over, standing in
+ * for the code of the programs running on a system, while a child process
+ * reads a "stream" file larger than memory from start to end for the
+ * duration of the run.  Reclaim has to keep evicting the streamed pages
+ * without throwing out the mapped ones.
+ *
+ * Reported are the passes over the hot mapping per second with the major
+ * faults they took, and the growth of these /proc/vmstat counters:
+ *
+ *   workingset_refault   evicted pages read in again soon after
+ *   kswapd_cpu_us        CPU time kswapd spent reclaiming
+ *   lru_gen_young        accessed pages found by page table walks
+ *
+ * Run it once with the kernel booted with lru_gen=off and once with
+ * lru_gen=on to compare the two reclaim modes.  The files are created in
+ * the current directory unless -d says otherwise; the stream file defaults
+ * to the size of memory, and both are removed afterwards.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o refault_bench refault_bench.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *dir = ".";
+static unsigned long hot_mb = 32;
+static unsigned long stream_mb;
+static int seconds = 30;
+
+static long page_size;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long read_vmstat(const char *name)
+{
+	FILE *f = fopen("/proc/vmstat", "r");
+	unsigned long long val, ret = 0;
+	char key[64];
+
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %llu", key, &val) == 2) {
+		if (!strcmp(key, name)) {
+			ret = val;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static unsigned long mem_total_mb(void)
+{
+	FILE *f = fopen("/proc/meminfo", "r");
+	unsigned long kb = 0;
+
+	if (f) {
+		if (fscanf(f, "MemTotal: %lu kB", &kb) != 1)
+			kb = 0;
+		fclose(f);
+	}
+	return kb >> 10;
+}
+
+static void make_file(const char *path, unsigned long mb)
+{
+	size_t len = 1 << 20, off;
+	char *buf = malloc(len);
+	ssize_t done;
+	int fd;
+
+	if (!buf)
+		die("malloc");
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(path);
+	for (off = 0; off < mb; off++) {
+		memset(buf, off, len);
+		done = write(fd, buf, len);
+		if (done != (ssize_t)len)
+			die("write");
+	}
+	if (fsync(fd) < 0)
+		die("fsync");
+	close(fd);
+	free(buf);
+}
+
+/* Read the stream file round and round until killed */
+static void stream(const char *path)
+{
+	size_t len = 1 << 20;
+	char *buf = malloc(len);
+	ssize_t done;
+	int fd;
+
+	if (!buf)
+		die("malloc");
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die(path);
+	for (;;) {
+		if (lseek(fd, 0, SEEK_SET) < 0)
+			die("lseek");
+		while ((done = read(fd, buf, len)) > 0)
+			;
+		if (done < 0)
+			die("read");
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d dir] [-H MB] [-s MB] [-t seconds]\n"
+		"  -d  directory for the files, default the current one\n"
+		"  -H  size of the mapped hot file, default 32 MB\n"
+		"  -s  size of the streamed file, default all of RAM\n"
+		"  -t  duration, default 30 s\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long refault0, kswapd0, young0;
+	char hot_path[4096], stream_path[4096];
+	unsigned long passes = 0;
+	struct rusage ru0, ru1;
+	volatile char *hot;
+	size_t len, off;
+	double t0, t;
+	int fd, opt;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "d:H:s:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'H':
+			hot_mb = atol(optarg);
+			break;
+		case 's':
+			stream_mb = atol(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!stream_mb)
+		stream_mb = mem_total_mb();
+	if (!hot_mb || !stream_mb || seconds < 1)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	snprintf(hot_path, sizeof(hot_path), "%s/refault_bench.hot", dir);
+	snprintf(stream_path, sizeof(stream_path), "%s/refault_bench.stream",
+		 dir);
+	make_file(hot_path, hot_mb);
+	make_file(stream_path, stream_mb);
+
+	len = hot_mb << 20;
+	fd = open(hot_path, O_RDONLY);
+	if (fd < 0)
+		die(hot_path);
+	hot = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (hot == MAP_FAILED)
+		die("mmap");
+	for (off = 0; off < len; off += page_size)
+		(void)hot[off];
+
+	printf("%lu MB mapped hot file, %lu MB stream, %d s\n",
+	       hot_mb, stream_mb, seconds);
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid)
+		stream(stream_path);
+
+	refault0 = read_vmstat("workingset_refault");
+	kswapd0 = read_vmstat("kswapd_cpu_us");
+	young0 = read_vmstat("lru_gen_young");
+	getrusage(RUSAGE_SELF, &ru0);
+	t0 = now();
+	do {
+		for (off = 0; off < len; off += page_size)
+			(void)hot[off];
+		passes++;
+		t = now() - t0;
+	} while (t < seconds);
+	getrusage(RUSAGE_SELF, &ru1);
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	printf("%12s %12s %18s %14s %14s\n", "passes/s", "hot_majflt",
+	       "workingset_refault", "kswapd_cpu_ms", "lru_gen_young");
+	printf("%12.2f %12ld %18llu %14.1f %14llu\n", passes / t,
+	       ru1.ru_majflt - ru0.ru_majflt,
+	       read_vmstat("workingset_refault") - refault0,
+	       (read_vmstat("kswapd_cpu_us") - kswapd0) / 1e3,
+	       read_vmstat("lru_gen_young") - young0);
+
+	munmap((void *)hot, len);
+	close(fd);
+	unlink(hot_path);
+	unlink(stream_path);
+	return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * swapin_bench.c -- latency of faulting anonymous memory back in from swap
+ *
+ * An anonymous region is filled, optionally rewritten in random page
+ * order so that the order it goes out to swap in has nothing to do with
+ * its addresses, and pushed out by a child process that touches enough
+ * memory to force reclaim. The region is then read back one page at a
+ * time in one of these orders, and each access is timed:
+ *
+ *   seq       ascending addresses
+ *   reverse   descending addresses
+ *   stride    every -S'th page, wrapping round until all are read
+ *   random    a random permutation
+ *
+ * The mean, median, 99th percentile and worst access are reported with
+ * the major faults taken and the growth of the swap_ra (pages read
+ * ahead) and swap_ra_hit (of those, pages used) counters in /proc/vmstat.
+ * With -c every order is run with vm.swap_vma_readahead off and on,
+ * which needs write access to /proc/sys/vm/swap_vma_readahead; the old
+ * value is put back afterwards.
+ *
+ * Swap must be enabled, and -p should be large enough to push most of the
+ * region out; the share of it found swapped out is shown.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o swapin_bench swapin_bench.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VMA_RA_SYSCTL	"/proc/sys/vm/swap_vma_readahead"
+
+enum order { ORDER_SEQ, ORDER_REVERSE, ORDER_STRIDE, ORDER_RANDOM,
+	     NR_ORDERS };
+
+static const char * const order_names[NR_ORDERS] = {
+	"seq", "reverse", "stride", "random",
+};
+
+static unsigned long region_mb = 64;
+static unsigned long pressure_mb;
+static unsigned int stride = 16;
+static int shuffle = 1;
+
+static long page_size;
+static size_t nr_pages;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_int(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	int val = -1;
+
+	if (f) {
+		if (fscanf(f, "%d", &val) != 1)
+			val = -1;
+		fclose(f);
+	}
+	return val;
+}
+
+static int write_int(const char *path, int val)
+{
+	FILE *f = fopen(path, "w");
+
+	if (!f)
+		return -1;
+	fprintf(f, "%d\n", val);
+	return fclose(f);
+}
+
+static unsigned long long read_vmstat(const char *name)
+{
+	FILE *f = fopen("/proc/vmstat", "r");
+	unsigned long long val, ret = 0;
+	char key[64];
+
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %llu", key, &val) == 2) {
+		if (!strcmp(key, name)) {
+			ret = val;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static unsigned long mem_total_mb(void)
+{
+	FILE *f = fopen("/proc/meminfo", "r");
+	unsigned long kb = 0;
+
+	if (f) {
+		if (fscanf(f, "MemTotal: %lu kB", &kb) != 1)
+			kb = 0;
+		fclose(f);
+	}
+	return kb >> 10;
+}
+
+static void shuffle_array(size_t *a, size_t n)
+{
+	size_t i, j, t;
+
+	for (i = n - 1; i > 0; i--) {
+		j = random() % (i + 1);
+		t = a[i];
+		a[i] = a[j];
+		a[j] = t;
+	}
+}
+
+static void make_order(size_t *idx, enum order order)
+{
+	size_t i, n = 0, first;
+
+	switch (order) {
+	case ORDER_SEQ:
+		for (i = 0; i < nr_pages; i++)
+			idx[i] = i;
+		break;
+	case ORDER_REVERSE:
+		for (i = 0; i < nr_pages; i++)
+			idx[i] = nr_pages - 1 - i;
+		break;
+	case ORDER_STRIDE:
+		for (first = 0; first < stride && first < nr_pages; first++)
+			for (i = first; i < nr_pages; i += stride)
+				idx[n++] = i;
+		break;
+	default:
+		for (i = 0; i < nr_pages; i++)
+			idx[i] = i;
+		shuffle_array(idx, nr_pages);
+		break;
+	}
+}
+
+/* Touch pressure_mb of memory in a child so that reclaim swaps us out */
+static void push_out(void)
+{
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid) {
+		size_t len = pressure_mb << 20, off;
+		char *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p == MAP_FAILED)
+			die("mmap pressure");
+		for (off = 0; off < len; off += page_size)
+			p[off] = 1;
+		exit(0);
+	}
+	waitpid(pid, NULL, 0);
+}
+
+static double swapped_share(char *region)
+{
+	unsigned char *vec = malloc(nr_pages);
+	size_t i, out = 0;
+
+	if (!vec)
+		die("malloc");
+	if (mincore(region, nr_pages * page_size, vec) < 0)
+		die("mincore");
+	for (i = 0; i < nr_pages; i++)
+		if (!(vec[i] & 1))
+			out++;
+	free(vec);
+	return 100.0 * out / nr_pages;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void bench(enum order order, int vma_ra, size_t *idx, double *lat)
+{
+	unsigned long long ra0, hit0;
+	struct rusage ru0, ru1;
+	double t0, sum = 0, out;
+	size_t i, len = nr_pages * page_size;
+	char *region;
+
+	region = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED)
+		die("mmap");
+
+	for (i = 0; i < nr_pages; i++)
+		*(size_t *)(region + i * page_size) = i;
+	if (shuffle) {
+		make_order(idx, ORDER_RANDOM);
+		for (i = 0; i < nr_pages; i++)
+			region[idx[i] * page_size + sizeof(size_t)]++;
+	}
+
+	push_out();
+	out = swapped_share(region);
+
+	make_order(idx, order);
+	ra0 = read_vmstat("swap_ra");
+	hit0 = read_vmstat("swap_ra_hit");
+	getrusage(RUSAGE_SELF, &ru0);
+
+	for (i = 0; i < nr_pages; i++) {
+		volatile size_t *p = (size_t *)(region + idx[i] * page_size);
+		size_t v;
+
+		t0 = now();
+		v = *p;
+		lat[i] = now() - t0;
+		if (v != idx[i]) {
+			fprintf(stderr, "page %zu reads back %zu\n", idx[i], v);
+			exit(1);
+		}
+		sum += lat[i];
+	}
+
+	getrusage(RUSAGE_SELF, &ru1);
+	qsort(lat, nr_pages, sizeof(*lat), cmp_double);
+
+	if (vma_ra < 0)
+		printf("%6s ", "?");
+	else
+		printf("%6d ", vma_ra);
+	printf("%-8s %7.1f%% %8ld %9.2f %9.2f %9.2f %9.1f %9llu %9llu\n",
+	       order_names[order], out, ru1.ru_majflt - ru0.ru_majflt,
+	       sum / nr_pages * 1e6, lat[nr_pages / 2] * 1e6,
+	       lat[nr_pages * 99 / 100] * 1e6, lat[nr_pages - 1] * 1e6,
+	       read_vmstat("swap_ra") - ra0,
+	       read_vmstat("swap_ra_hit") - hit0);
+	fflush(stdout);
+
+	munmap(region, len);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c] [-n] [-s MB] [-p MB] [-S stride] [-o order]\n"
+		"  -c  compare swap_vma_readahead off and on\n"
+		"  -n  do not scatter the region in swap, write it in order\n"
+		"  -s  region size, default 64 MB\n"
+		"  -p  memory touched to push it out, default all of RAM\n"
+		"  -S  pages between accesses for the stride order, default 16\n"
+		"  -o  seq, reverse, stride or random, default all\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int compare = 0, old, opt, pass, only = -1;
+	enum order order;
+	size_t *idx;
+	double *lat;
+
+	while ((opt = getopt(argc, argv, "cns:p:S:o:")) != -1) {
+		switch (opt) {
+		case 'c':
+			compare = 1;
+			break;
+		case 'n':
+			shuffle = 0;
+			break;
+		case 's':
+			region_mb = atol(optarg);
+			break;
+		case 'p':
+			pressure_mb = atol(optarg);
+			break;
+		case 'S':
+			stride = atoi(optarg);
+			break;
+		case 'o':
+			for (order = 0; order < NR_ORDERS; order++)
+				if (!strcmp(optarg, order_names[order]))
+					only = order;
+			if (only < 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!pressure_mb)
+		pressure_mb = mem_total_mb();
+	if (!region_mb || !pressure_mb || !stride)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nr_pages = (region_mb << 20) / page_size;
+	idx = malloc(nr_pages * sizeof(*idx));
+	lat = malloc(nr_pages * sizeof(*lat));
+	if (!idx || !lat)
+		die("malloc");
+	srandom(time(NULL));
+
+	old = read_int(VMA_RA_SYSCTL);
+	printf("%lu MB region%s, %lu MB pressure, swap_vma_readahead=%s\n",
+	       region_mb, shuffle ? " scattered in swap" : "", pressure_mb,
+	       old < 0 ? "unavailable" : old ? "1" : "0");
+	printf("%6s %-8s %8s %8s %9s %9s %9s %9s %9s %9s\n", "vma_ra",
+	       "order", "swapped", "majflt", "mean_us", "p50_us", "p99_us",
+	       "max_us", "swap_ra", "ra_hit");
+
+	for (pass = 0; pass < (compare ? 2 : 1); pass++) {
+		int vma_ra = old;
+
+		if (compare) {
+			if (write_int(VMA_RA_SYSCTL, pass) < 0)
+				die(VMA_RA_SYSCTL);
+			vma_ra = pass;
+		}
+		for (order = 0; order < NR_ORDERS; order++)
+			if (only < 0 || (int)order == only)
+				bench(order, vma_ra, idx, lat);
+	}
+
+	if (compare && old >= 0)
+		write_int(VMA_RA_SYSCTL, old);
+	return 0;
+}